@@ -1,27 +1,37 @@
 import sys
+import zlib
+
+
+def write_array(out, name, data):
+    out.write(f"const uint8_t {name}[] = {{\n")
+
+    for i in range(0, len(data), 16):
+        line = ", ".join(f"0x{b:02x}" for b in data[i : i + 16])
+        out.write(f"\t{line},\n")
+
+    out.write("};\n\n")
+    out.write(f"const uint32_t {name}_len = sizeof({name});\n")
 
 
 def main():
-    if len(sys.argv) != 4:
-        print("Usage: python bin2c.py [input] [output] [name]")
+    if len(sys.argv) not in (4, 5) or (len(sys.argv) == 5 and sys.argv[4] != "--deflate"):
+        print("Usage: python bin2c.py [input] [output] [name] [--deflate]")
         sys.exit(-1)
 
     input_path, output_path, name = sys.argv[1], sys.argv[2], sys.argv[3]
+    deflate = len(sys.argv) == 5
+
+    with open(input_path, "rb") as f:
+        data = f.read()
 
     with open(output_path, "w", newline="\n") as out:
         out.write("#include <stdint.h>\n\n")
-        out.write(f"const uint8_t {name}[] = {{\n")
-
-        with open(input_path, "rb") as f:
-            while True:
-                chunk = f.read(16)
-                if not chunk:
-                    break
-                line = ", ".join(f"0x{b:02x}" for b in chunk)
-                out.write(f"\t{line},\n")
-
-        out.write("};\n\n")
-        out.write(f"const uint32_t {name}_len = sizeof({name});\n")
+        write_array(out, name, data)
+
+        # 同时嵌入 zlib 压缩后的副本，命名为 {name}_defl
+        if deflate:
+            out.write("\n")
+            write_array(out, f"{name}_defl", zlib.compress(data, 9))
 
 
 if __name__ == "__main__":
@@ -0,0 +1,190 @@
+#include "diff.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/md5.h"
+#include "utils.h"
+
+// 先按较大的块比较，只有不一致的块才逐扇区细分，减少命令往返次数
+#define DIFF_CHUNK_SIZE (64 * 1024)
+
+// 取回区域内各块的 MD5。flash 一次请求取回全部摘要，其余目标逐块计算
+static int
+hash_chunks(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
+		uint32_t size, uint32_t chunk_size, uint8_t *digests)
+{
+	int ret;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	if (target == TARGET_FLASH) {
+		return cskburn_serial_hash_map(dev, addr, size, chunk_size, digests);
+	}
+
+	for (uint32_t offset = 0, i = 0; offset < size; offset += chunk_size, i++) {
+		uint32_t length = size - offset < chunk_size ? size - offset : chunk_size;
+		if ((ret = cskburn_serial_verify(dev, target, addr + offset, length,
+					 digests + MD5_SIZE * i)) != 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blank_md5(uint32_t size, uint8_t *md5)
+{
+	static uint8_t blank[DIFF_CHUNK_SIZE];
+	memset(blank, 0xFF, sizeof(blank));
+	mbedtls_md5(blank, size, md5);
+}
+
+static void
+mark(diff_range_t *ranges, uint32_t *count, uint32_t offset, uint32_t size)
+{
+	if (*count > 0) {
+		diff_range_t *last = &ranges[*count - 1];
+		if (last->offset + last->size == offset) {
+			last->size += size;
+			return;
+		}
+	}
+
+	ranges[*count].offset = offset;
+	ranges[*count].size = size;
+	(*count)++;
+}
+
+int
+diff_scan(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
+		const uint8_t *image, uint32_t size, diff_range_t **ranges, uint32_t *count)
+{
+	int ret;
+	uint8_t *digests = NULL;
+	bool *dirty = NULL;
+
+	// 相邻的不一致扇区会被合并，因此区间数不超过扇区数的一半
+	uint32_t sectors = (size + DIFF_SECTOR_SIZE - 1) / DIFF_SECTOR_SIZE;
+	*ranges = (diff_range_t *)malloc(sizeof(diff_range_t) * (sectors / 2 + 1));
+	*count = 0;
+	// 扇区摘要的缓冲区也够放下各块的摘要
+	uint32_t chunks = (size + DIFF_CHUNK_SIZE - 1) / DIFF_CHUNK_SIZE;
+	digests = (uint8_t *)malloc(MD5_SIZE * sectors + 1);
+	dirty = (bool *)calloc(chunks + 1, sizeof(bool));
+	if (*ranges == NULL || digests == NULL || dirty == NULL) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	if ((ret = hash_chunks(dev, target, addr, size, DIFF_CHUNK_SIZE, digests)) != 0) {
+		goto err;
+	}
+	for (uint32_t i = 0; i < chunks; i++) {
+		uint32_t chunk = DIFF_CHUNK_SIZE * i;
+		uint32_t chunk_size = size - chunk < DIFF_CHUNK_SIZE ? size - chunk : DIFF_CHUNK_SIZE;
+
+		uint8_t image_md5[MD5_SIZE] = {0};
+		mbedtls_md5(image + chunk, chunk_size, image_md5);
+		dirty[i] = memcmp(digests + MD5_SIZE * i, image_md5, MD5_SIZE) != 0;
+	}
+
+	// 连续不一致的块合并为一次请求，取回其中各扇区的摘要
+	for (uint32_t i = 0; i < chunks;) {
+		if (!dirty[i]) {
+			i++;
+			continue;
+		}
+
+		uint32_t j = i;
+		while (j < chunks && dirty[j]) {
+			j++;
+		}
+
+		uint32_t start = DIFF_CHUNK_SIZE * i;
+		uint32_t end = j == chunks ? size : DIFF_CHUNK_SIZE * j;
+		if ((ret = hash_chunks(dev, target, addr + start, end - start, DIFF_SECTOR_SIZE,
+					 digests)) != 0) {
+			goto err;
+		}
+
+		for (uint32_t offset = start, k = 0; offset < end; offset += DIFF_SECTOR_SIZE, k++) {
+			uint32_t sector_size =
+					end - offset < DIFF_SECTOR_SIZE ? end - offset : DIFF_SECTOR_SIZE;
+
+			uint8_t image_md5[MD5_SIZE] = {0};
+			mbedtls_md5(image + offset, sector_size, image_md5);
+			if (memcmp(digests + MD5_SIZE * k, image_md5, MD5_SIZE) != 0) {
+				mark(*ranges, count, offset, sector_size);
+			}
+		}
+
+		i = j;
+	}
+
+	free(dirty);
+	free(digests);
+	return 0;
+
+err:
+	free(dirty);
+	free(digests);
+	free(*ranges);
+	*ranges = NULL;
+	*count = 0;
+	return ret;
+}
+
+int
+diff_scan_blank(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
+		uint32_t size, diff_range_t **ranges, uint32_t *count)
+{
+	int ret;
+	uint8_t *digests = NULL;
+
+	uint8_t chunk_md5[MD5_SIZE] = {0};
+	blank_md5(DIFF_CHUNK_SIZE, chunk_md5);
+
+	uint32_t chunks = (size + DIFF_CHUNK_SIZE - 1) / DIFF_CHUNK_SIZE;
+	*ranges = (diff_range_t *)malloc(sizeof(diff_range_t) * (chunks / 2 + 1));
+	*count = 0;
+	digests = (uint8_t *)malloc(MD5_SIZE * chunks + 1);
+	if (*ranges == NULL || digests == NULL) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	if ((ret = hash_chunks(dev, target, addr, size, DIFF_CHUNK_SIZE, digests)) != 0) {
+		goto err;
+	}
+
+	for (uint32_t i = 0; i < chunks; i++) {
+		uint32_t chunk = DIFF_CHUNK_SIZE * i;
+		uint32_t chunk_size = size - chunk < DIFF_CHUNK_SIZE ? size - chunk : DIFF_CHUNK_SIZE;
+
+		uint8_t tail_md5[MD5_SIZE] = {0};
+		if (chunk_size != DIFF_CHUNK_SIZE) {
+			blank_md5(chunk_size, tail_md5);
+		}
+
+		if (memcmp(digests + MD5_SIZE * i, chunk_size == DIFF_CHUNK_SIZE ? chunk_md5 : tail_md5,
+					MD5_SIZE) != 0) {
+			mark(*ranges, count, chunk, chunk_size);
+		}
+	}
+
+	free(digests);
+	return 0;
+
+err:
+	free(digests);
+	free(*ranges);
+	*ranges = NULL;
+	*count = 0;
+	return ret;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "cskburn_serial.h"
+
+#define DIFF_SECTOR_SIZE (4 * 1024)
+
+typedef struct {
+	uint32_t offset;
+	uint32_t size;
+} diff_range_t;
+
+/**
+ * @brief Compare an image with the flash content at addr sector by sector
+ *
+ * @param ranges Receives the merged ranges (relative to addr) that differ, free() after use
+ * @param count Receives the number of ranges
+ *
+ * @retval 0 if successful
+ * @retval Error code from cskburn_serial_hash_map() or cskburn_serial_verify() otherwise
+ */
+int diff_scan(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
+		const uint8_t *image, uint32_t size, diff_range_t **ranges, uint32_t *count);
+
+/**
+ * @brief Find the parts of a flash region that are not blank (all 0xFF)
+ *
+ * The region is checked in chunks of 64 KB, so the ranges are only as precise as that.
+ *
+ * @param ranges Receives the merged ranges (relative to addr) that are not blank, free() after use
+ * @param count Receives the number of ranges
+ *
+ * @retval 0 if successful
+ * @retval Error code from cskburn_serial_hash_map() or cskburn_serial_verify() otherwise
+ */
+int diff_scan_blank(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
+		uint32_t size, diff_range_t **ranges, uint32_t *count);
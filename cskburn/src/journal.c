@@ -0,0 +1,138 @@
+#include "journal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define MD5_STR_LEN (MD5_SIZE * 2)
+
+typedef struct {
+	uint32_t addr;
+	uint32_t size;
+	char md5[MD5_STR_LEN + 1];
+	uint32_t done;
+} journal_entry_t;
+
+struct _journal_t {
+	FILE *file;
+	journal_entry_t *entries;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+static journal_entry_t *
+find(journal_t *journal, uint32_t addr, uint32_t size, const char *md5)
+{
+	for (uint32_t i = 0; i < journal->count; i++) {
+		journal_entry_t *entry = &journal->entries[i];
+		if (entry->addr == addr && entry->size == size && strcmp(entry->md5, md5) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static int
+update(journal_t *journal, uint32_t addr, uint32_t size, const char *md5, uint32_t done)
+{
+	journal_entry_t *entry = find(journal, addr, size, md5);
+	if (entry == NULL) {
+		if (journal->count == journal->capacity) {
+			uint32_t capacity = journal->capacity > 0 ? journal->capacity * 2 : 8;
+			journal_entry_t *entries = (journal_entry_t *)realloc(
+					journal->entries, sizeof(journal_entry_t) * capacity);
+			if (entries == NULL) {
+				return -ENOMEM;
+			}
+			journal->entries = entries;
+			journal->capacity = capacity;
+		}
+
+		entry = &journal->entries[journal->count++];
+		entry->addr = addr;
+		entry->size = size;
+		strcpy(entry->md5, md5);
+	}
+
+	entry->done = done;
+	return 0;
+}
+
+journal_t *
+journal_open(const char *path)
+{
+	journal_t *journal = (journal_t *)calloc(1, sizeof(journal_t));
+	if (journal == NULL) {
+		return NULL;
+	}
+
+	FILE *file = fopen(path, "r");
+	if (file != NULL) {
+		char line[128];
+		while (fgets(line, sizeof(line), file) != NULL) {
+			uint32_t addr, size, done;
+			char md5[MD5_STR_LEN + 1];
+			// 中断时可能留下不完整的最后一行，格式不符的行直接忽略
+			if (sscanf(line, "%x %u %32s %u", &addr, &size, md5, &done) != 4 ||
+					strlen(md5) != MD5_STR_LEN || done > size) {
+				continue;
+			}
+			update(journal, addr, size, md5, done);
+		}
+		fclose(file);
+	}
+
+	if ((journal->file = fopen(path, "a")) == NULL) {
+		journal_close(&journal);
+		return NULL;
+	}
+
+	return journal;
+}
+
+void
+journal_close(journal_t **journal)
+{
+	if (*journal == NULL) {
+		return;
+	}
+
+	if ((*journal)->file != NULL) {
+		fclose((*journal)->file);
+	}
+	free((*journal)->entries);
+	free(*journal);
+	*journal = NULL;
+}
+
+uint32_t
+journal_lookup(journal_t *journal, uint32_t addr, uint32_t size, const uint8_t *md5)
+{
+	char md5_str[MD5_STR_LEN + 1] = {0};
+	md5_to_str(md5_str, (uint8_t *)md5);
+
+	journal_entry_t *entry = find(journal, addr, size, md5_str);
+	return entry != NULL ? entry->done : 0;
+}
+
+int
+journal_record(journal_t *journal, uint32_t addr, uint32_t size, const uint8_t *md5, uint32_t done)
+{
+	char md5_str[MD5_STR_LEN + 1] = {0};
+	md5_to_str(md5_str, (uint8_t *)md5);
+
+	int ret = update(journal, addr, size, md5_str, done);
+	if (ret != 0) {
+		return ret;
+	}
+
+	// 每条记录立即写出，进程随时退出都不会丢失已确认的进度
+	if (fprintf(journal->file, "%08X %u %s %u\n", addr, size, md5_str, done) < 0 ||
+			fflush(journal->file) != 0) {
+		return -EIO;
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Progress of partition writes kept on disk so that a failed burn can be resumed.
+ *
+ * A journal belongs to one device. Each line records how many bytes of a partition,
+ * identified by its address, size and image MD5, were acknowledged by the device:
+ *
+ *     <addr> <size> <md5> <done>
+ *
+ * Lines are only appended, the last one for a partition wins.
+ */
+typedef struct _journal_t journal_t;
+
+/**
+ * @brief Load the journal at path and open it for appending, creating it if needed
+ *
+ * @return Journal handle, or NULL if the file cannot be opened
+ */
+journal_t *journal_open(const char *path);
+
+void journal_close(journal_t **journal);
+
+/**
+ * @brief Get the number of bytes of a partition recorded as written, 0 if none
+ */
+uint32_t journal_lookup(journal_t *journal, uint32_t addr, uint32_t size, const uint8_t *md5);
+
+/**
+ * @brief Record that the first done bytes of a partition were written
+ *
+ * @retval 0 if successful
+ * @retval -ENOMEM if out of memory
+ * @retval -EIO if the journal cannot be written
+ */
+int journal_record(
+		journal_t *journal, uint32_t addr, uint32_t size, const uint8_t *md5, uint32_t done);
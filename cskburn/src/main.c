@@ -16,12 +16,17 @@ int _isatty(int);
 #include "log.h"
 #include "msleep.h"
 #include "read_parts.h"
+#include "time_monotonic.h"
 #include "utils.h"
 #ifndef WITHOUT_USB
 #include "cskburn_usb.h"
 #endif
 #include "cskburn_serial.h"
+#include "diff.h"
 #include "fsio.h"
+#include "journal.h"
+#include "mbedtls/md5.h"
+#include "memio.h"
 #include "verify.h"
 
 #define MAX_IMAGE_SIZE (32 * 1024 * 1024)
@@ -58,6 +63,10 @@ int _isatty(int);
 
 #define DEFAULT_BAUD 3000000
 
+// --baud auto：先以初始波特率进入烧录模式，再由低到高逐级探测
+#define AUTO_BAUD_INIT 115200
+static const uint32_t auto_baud_candidates[] = {921600, 1500000, 2000000, 3000000};
+
 #define DEFAULT_PROBE_TIMEOUT 10 * 1000
 #define DEFAULT_RESET_ATTEMPTS 4
 #define DEFAULT_RESET_DELAY 500
@@ -97,10 +106,14 @@ static struct option long_options[] = {
 		{"erase-all", no_argument, NULL, 0},
 		{"verify", required_argument, NULL, 0},
 		{"verify-all", no_argument, NULL, 0},
+		{"diff", no_argument, NULL, 0},
+		{"resume", no_argument, NULL, 0},
+		{"blank-check", no_argument, NULL, 0},
 		{"probe-timeout", required_argument, NULL, 0},
 		{"reset-attempts", required_argument, NULL, 0},
 		{"reset-delay", required_argument, NULL, 0},
 		{"timeout", required_argument, NULL, 0},
+		{"write-window", required_argument, NULL, 0},
 		{"pass-delay", required_argument, NULL, 0},
 		{"fail-delay", required_argument, NULL, 0},
 		{"burner", required_argument, NULL, 0},
@@ -244,6 +257,7 @@ static struct {
 #endif
 	char *serial;
 	uint32_t serial_baud;
+	bool serial_baud_auto;
 	cskburn_serial_target_t target;
 	bool read_chip_id;
 	uint16_t read_count;
@@ -264,10 +278,14 @@ static struct {
 		uint32_t size;
 	} verify_parts[MAX_VERIFY_PARTS];
 	bool verify_all;
+	bool diff;
+	bool resume;
+	bool blank_check;
 	uint32_t probe_timeout;
 	uint32_t reset_attempts;
 	uint32_t reset_delay;
 	int32_t timeout;
+	uint32_t write_window;
 	char *burner;
 	uint8_t *burner_buf;
 	uint32_t burner_len;
@@ -297,10 +315,14 @@ static struct {
 		.erase_all = false,
 		.verify_count = 0,
 		.verify_all = false,
+		.diff = false,
+		.resume = false,
+		.blank_check = false,
 		.probe_timeout = DEFAULT_PROBE_TIMEOUT,
 		.reset_attempts = DEFAULT_RESET_ATTEMPTS,
 		.reset_delay = DEFAULT_RESET_DELAY,
 		.timeout = 0,
+		.write_window = 0,
 		.burner = NULL,
 		.burner_len = 0,
 		.reset_strategy_auto = true,
@@ -361,7 +383,9 @@ print_help(const char *progname)
 
 	LOGI("Serial burning options:");
 	LOGI("  -b, --baud <rate>");
-	LOGI("    baud rate used for serial burning (default: %d)", DEFAULT_BAUD);
+	LOGI("    baud rate used for serial burning (default: %d), or \"auto\" to use the fastest",
+			DEFAULT_BAUD);
+	LOGI("    rate that the link proves to sustain");
 #ifndef WITHOUT_USB
 	LOGI("  -C, --chip <family>");
 	LOGI("    chip family (default: %s), acceptable values:", chip_features[DEFAULT_CHIP].code);
@@ -373,6 +397,14 @@ print_help(const char *progname)
 	LOGI("    read unique chip ID");
 	LOGI("  --verify-all");
 	LOGI("    verify all partitions after burning");
+	LOGI("  --diff");
+	LOGI("    only erase and write the sectors that differ from flash content");
+	LOGI("  --resume");
+	LOGI("    record burning progress in cskburn-<chip-id>.journal under the current");
+	LOGI("    directory, and continue an interrupted burn after the part already written;");
+	LOGI("    cannot be used with --diff");
+	LOGI("  --blank-check");
+	LOGI("    skip erasing the parts of a region that are already blank");
 	LOGI("  -n, --nand");
 	LOGI("    burn to NAND flash (CSK6 only)");
 	LOGI("  --probe-timeout <ms>");
@@ -390,6 +422,8 @@ print_help(const char *progname)
 	LOGI("       n: timeout after n milliseconds (n > 0)");
 	LOGI("    this option does not affect the timeout of probing device, use "
 		 "--probe-timeout if needed");
+	LOGI("  --write-window <n>");
+	LOGI("    number of flash blocks sent ahead of their acknowledgements (default: 1)");
 	LOGI("  --reset-strategy <name>");
 	LOGI("    reset strategy for entering burn mode (default: auto), acceptable values:");
 	LOGI("      auto:         auto-select by chip; for LS26 alternates dtr-boot and");
@@ -446,6 +480,12 @@ validate_flash_bounds(uint32_t addr, uint32_t size, uint64_t flash_size, const c
 }
 
 static int serial_burn(cskburn_partition_t *parts, int parts_cnt);
+static int serial_erase(cskburn_serial_device_t *dev, uint32_t addr, uint32_t size);
+static int serial_erase_all(cskburn_serial_device_t *dev, uint64_t flash_size);
+static int serial_write_diff(cskburn_serial_device_t *dev, cskburn_partition_t *parts, int index,
+		int parts_cnt);
+static int serial_write_resume(cskburn_serial_device_t *dev, journal_t *journal,
+		cskburn_partition_t *parts, int index, int parts_cnt);
 
 int
 main(int argc, char **argv)
@@ -475,7 +515,10 @@ main(int argc, char **argv)
 				options.serial = optarg;
 				break;
 			case 'b':
-				if (sscanf(optarg, "%d", &options.serial_baud) != 1) {
+				if (strcmp(optarg, "auto") == 0) {
+					options.serial_baud = AUTO_BAUD_INIT;
+					options.serial_baud_auto = true;
+				} else if (sscanf(optarg, "%d", &options.serial_baud) != 1) {
 					ERR_CTX(CSKBURN_ERR_ARG_INVALID, "--baud: %s", optarg);
 					return CSKBURN_ERR_ARG_INVALID;
 				}
@@ -572,6 +615,15 @@ main(int argc, char **argv)
 				} else if (strcmp(name, "verify-all") == 0) {
 					options.verify_all = true;
 					break;
+				} else if (strcmp(name, "diff") == 0) {
+					options.diff = true;
+					break;
+				} else if (strcmp(name, "resume") == 0) {
+					options.resume = true;
+					break;
+				} else if (strcmp(name, "blank-check") == 0) {
+					options.blank_check = true;
+					break;
 				} else if (strcmp(name, "probe-timeout") == 0) {
 					if (sscanf(optarg, "%d", &options.probe_timeout) != 1) {
 						ERR_CTX(CSKBURN_ERR_ARG_INVALID, "--probe-timeout: %s", optarg);
@@ -596,6 +648,12 @@ main(int argc, char **argv)
 						return CSKBURN_ERR_ARG_INVALID;
 					}
 					break;
+				} else if (strcmp(name, "write-window") == 0) {
+					if (!scan_int(optarg, &options.write_window) || options.write_window == 0) {
+						ERR_CTX(CSKBURN_ERR_ARG_INVALID, "--write-window: %s", optarg);
+						return CSKBURN_ERR_ARG_INVALID;
+					}
+					break;
 				} else if (strcmp(name, "burner") == 0) {
 					options.burner = optarg;
 					break;
@@ -739,6 +797,12 @@ main(int argc, char **argv)
 		}
 	}
 
+	// --diff 按 flash 内容决定写入范围，与按记录续写互相冲突
+	if (options.diff && options.resume) {
+		ERR_CTX(CSKBURN_ERR_ARG_INVALID, "--resume cannot be used with --diff");
+		return CSKBURN_ERR_ARG_INVALID;
+	}
+
 	if (options.burner != NULL) {
 		options.burner_buf = (uint8_t *)malloc(MAX_IMAGE_SIZE);
 		options.burner_len = read_file(options.burner, options.burner_buf, MAX_IMAGE_SIZE);
@@ -1026,6 +1090,15 @@ serial_connect(cskburn_serial_device_t *dev, cskburn_reset_strategy_t *out_strat
 
 	cskburn_reset_strategy_t effective = candidates[0];
 
+	// 上次烧录未复位设备时 burner 仍在运行，直接复用，免去复位与上传
+	if (options.burner_len == 0 && cskburn_serial_attach(dev, options.serial_baud) == 0) {
+		LOGI("Reusing running burner...");
+		if (out_strategy != NULL) {
+			*out_strategy = effective;
+		}
+		return 0;
+	}
+
 	for (uint32_t i = 0; options.wait || i < options.reset_attempts + 1; i++) {
 		uint32_t reset_delay = i == 0 ? 0 : options.reset_delay;
 		uint32_t probe_timeout;
@@ -1078,6 +1151,8 @@ static int
 serial_burn(cskburn_partition_t *parts, int parts_cnt)
 {
 	int ret;
+	journal_t *journal = NULL;
+	char journal_path[64] = {0};
 
 	cskburn_reset_strategy_t effective_strategy = CSKBURN_RESET_RTS_BOOT;
 
@@ -1105,17 +1180,36 @@ serial_burn(cskburn_partition_t *parts, int parts_cnt)
 		goto err_open;
 	}
 
+	if (options.write_window > 0 &&
+			cskburn_serial_set_write_window(dev, options.write_window) != 0) {
+		ERR_CTX(CSKBURN_ERR_ARG_INVALID, "--write-window: %u", options.write_window);
+		ret = -CSKBURN_ERR_ARG_INVALID;
+		cskburn_serial_close(&dev);
+		goto err_open;
+	}
+
+	// 不自动擦除的芯片在写入前会显式擦除整个分区，空白块无需再写
+	cskburn_serial_set_skip_blank(dev, !options.chip->flash_auto_erase);
+
 	if ((ret = serial_connect(dev, &effective_strategy)) != 0) {
 		goto err_enter;
 	}
 
-	if (options.read_chip_id) {
-		uint8_t id[CHIP_ID_LEN] = {0};
+	bool resume = options.resume && options.target == TARGET_FLASH && parts_cnt > 0;
+	uint8_t id[CHIP_ID_LEN] = {0};
+	if (options.read_chip_id || resume) {
 		if ((ret = cskburn_serial_read_chip_id(dev, id)) != 0) {
-			ERR_RET_NO_CTX(ret);
-			goto err_enter;
+			if (options.read_chip_id) {
+				ERR_RET_NO_CTX(ret);
+				goto err_enter;
+			}
+			// 进度按芯片 ID 记录，读不到时照常烧录，只是不记录进度
+			LOGI_RET(ret, "WARNING: Failed to read chip ID, burning without --resume");
+			resume = false;
 		}
+	}
 
+	if (options.read_chip_id) {
 		if (options.chip->serial == CHIP_ARCS) {
 			LOGI("chip-id: %02x%02x%02x%02x%02x%02x%02x%02x", id[0], id[1], id[2], id[3], id[4],
 					id[5], id[6], id[7]);
@@ -1125,6 +1219,18 @@ serial_burn(cskburn_partition_t *parts, int parts_cnt)
 		}
 	}
 
+	// 进度按芯片记录，换了一颗芯片不会误用上一颗的进度
+	if (resume) {
+		snprintf(journal_path, sizeof(journal_path),
+				"cskburn-%02X%02X%02X%02X%02X%02X%02X%02X.journal", id[0], id[1], id[2], id[3],
+				id[4], id[5], id[6], id[7]);
+		if ((journal = journal_open(journal_path)) == NULL) {
+			ERR_CTX(CSKBURN_ERR_FILE_WRITE_FAILED, "%s", journal_path);
+			ret = -CSKBURN_ERR_FILE_WRITE_FAILED;
+			goto err_enter;
+		}
+	}
+
 	uint64_t flash_size = 0;
 
 	if (options.target == TARGET_FLASH) {
@@ -1147,6 +1253,18 @@ serial_burn(cskburn_partition_t *parts, int parts_cnt)
 		LOGI("Detected NAND size: %" PRIu64 " MB", flash_size >> 20);
 	}
 
+	// 目标初始化之后再探测，按所选目标检查链路；一个候选都未能检查时不应悄悄停在初始波特率
+	if (options.serial_baud_auto) {
+		uint32_t baud, speed;
+		if ((ret = cskburn_serial_probe_baud(dev, options.target, auto_baud_candidates,
+					 sizeof(auto_baud_candidates) / sizeof(auto_baud_candidates[0]), &baud,
+					 &speed)) != 0) {
+			ERR_RET_NO_CTX(ret);
+			goto err_enter;
+		}
+		LOGI("Using baud rate %u, measured link throughput %.2f KB/s", baud, speed / 1024.0f);
+	}
+
 	for (int i = 0; i < options.read_count; i++) {
 		if ((ret = validate_flash_bounds(options.read_parts[i].addr, options.read_parts[i].size,
 					 flash_size, "read")) != 0) {
@@ -1261,18 +1379,14 @@ serial_burn(cskburn_partition_t *parts, int parts_cnt)
 	}
 
 	if (options.erase_all) {
-		LOGI("Erasing entire flash...");
-		if ((ret = cskburn_serial_erase_all(dev, options.target, flash_size)) != 0) {
-			ERR_RET_NO_CTX(ret);
+		if ((ret = serial_erase_all(dev, flash_size)) != 0) {
 			goto err_enter;
 		}
 	} else {
 		for (int i = 0; i < options.erase_count; i++) {
 			uint32_t addr = options.erase_parts[i].addr;
 			uint32_t size = options.erase_parts[i].size;
-			LOGI("Erasing region 0x%08X-0x%08X...", addr, addr + size);
-			if ((ret = cskburn_serial_erase(dev, options.target, addr, size)) != 0) {
-				ERR_RET(ret, "region 0x%08X-0x%08X", addr, addr + size);
+			if ((ret = serial_erase(dev, addr, size)) != 0) {
 				goto err_enter;
 			}
 		}
@@ -1296,23 +1410,31 @@ serial_burn(cskburn_partition_t *parts, int parts_cnt)
 	uint32_t jump_addr = 0;
 
 	for (int i = 0; i < parts_cnt; i++) {
-		if (options.target == TARGET_FLASH && !options.chip->flash_auto_erase) {
-			uint32_t size = align_up(parts[i].reader->size, FLASH_ALIGN);
-			LOGI("Erasing region 0x%08X-0x%08X...", parts[i].addr, parts[i].addr + size);
-			if ((ret = cskburn_serial_erase(dev, options.target, parts[i].addr, size)) != 0) {
-				ERR_RET(ret, "region 0x%08X-0x%08X", parts[i].addr, parts[i].addr + size);
+		jump_addr = (options.target == TARGET_RAM && i == parts_cnt - 1) ? options.jump_address : 0;
+
+		if (options.diff && options.target == TARGET_FLASH) {
+			if ((ret = serial_write_diff(dev, parts, i, parts_cnt)) != 0) {
 				goto err_write;
 			}
-		}
-
-		jump_addr = (options.target == TARGET_RAM && i == parts_cnt - 1) ? options.jump_address : 0;
+		} else if (journal != NULL) {
+			if ((ret = serial_write_resume(dev, journal, parts, i, parts_cnt)) != 0) {
+				goto err_write;
+			}
+		} else {
+			if (options.target == TARGET_FLASH && !options.chip->flash_auto_erase) {
+				uint32_t size = align_up(parts[i].reader->size, FLASH_ALIGN);
+				if ((ret = serial_erase(dev, parts[i].addr, size)) != 0) {
+					goto err_write;
+				}
+			}
 
-		LOGI("Burning partition %d/%d... (0x%08X, %.2f KB)", i + 1, parts_cnt, parts[i].addr,
-				(float)parts[i].reader->size / 1024.0f);
-		if ((ret = cskburn_serial_write(dev, options.target, parts[i].addr, parts[i].reader,
-					 jump_addr, options.progress ? print_progress : NULL)) != 0) {
-			ERR_RET(ret, "partition %d", i + 1);
-			goto err_write;
+			LOGI("Burning partition %d/%d... (0x%08X, %.2f KB)", i + 1, parts_cnt, parts[i].addr,
+					(float)parts[i].reader->size / 1024.0f);
+			if ((ret = cskburn_serial_write(dev, options.target, parts[i].addr, parts[i].reader,
+						 jump_addr, options.progress ? print_progress : NULL)) != 0) {
+				ERR_RET(ret, "partition %d", i + 1);
+				goto err_write;
+			}
 		}
 
 		if (options.verify_all) {
@@ -1340,6 +1462,12 @@ serial_burn(cskburn_partition_t *parts, int parts_cnt)
 		}
 	}
 
+	// 全部分区写完，不再需要续写
+	if (journal != NULL) {
+		journal_close(&journal);
+		remove(journal_path);
+	}
+
 	if (jump_addr) {
 		LOGI("Jumping to 0x%08X...", jump_addr);
 	} else if (!options.no_reset) {
@@ -1360,7 +1488,322 @@ err_enter:
 	if (ret != 0) {
 		cskburn_serial_reset(dev, options.reset_delay, effective_strategy);
 	}
+	journal_close(&journal);
 	cskburn_serial_close(&dev);
 err_open:
 	return ret;
 }
+
+// 按实测擦除速度约 222KB/s 估算跳过擦除所节省的时间
+#define ERASE_SPEED_KBPS 222
+
+static void
+print_erase_saved(uint32_t skipped, uint64_t scan_ms)
+{
+	float saved = (float)skipped / 1024.0f / ERASE_SPEED_KBPS - (float)scan_ms / 1000.0f;
+	LOGI("Skipped %.2f KB already blank, saved about %.2fs", (float)skipped / 1024.0f,
+			saved > 0 ? saved : 0);
+}
+
+static int
+serial_erase(cskburn_serial_device_t *dev, uint32_t addr, uint32_t size)
+{
+	int ret;
+
+	if (!options.blank_check || options.target != TARGET_FLASH) {
+		LOGI("Erasing region 0x%08X-0x%08X...", addr, addr + size);
+		if ((ret = cskburn_serial_erase(dev, options.target, addr, size)) != 0) {
+			ERR_RET(ret, "region 0x%08X-0x%08X", addr, addr + size);
+		}
+		return ret;
+	}
+
+	diff_range_t *ranges = NULL;
+	uint32_t count = 0;
+
+	LOGI("Checking region 0x%08X-0x%08X...", addr, addr + size);
+	uint64_t t1 = time_monotonic();
+	if ((ret = diff_scan_blank(dev, options.target, addr, size, &ranges, &count)) != 0) {
+		ERR_RET(ret, "region 0x%08X-0x%08X", addr, addr + size);
+		return ret;
+	}
+	uint64_t t2 = time_monotonic();
+
+	uint32_t dirty = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t start = addr + ranges[i].offset;
+		uint32_t end = start + ranges[i].size;
+		LOGI("Erasing region 0x%08X-0x%08X...", start, end);
+		if ((ret = cskburn_serial_erase(dev, options.target, start, ranges[i].size)) != 0) {
+			ERR_RET(ret, "region 0x%08X-0x%08X", start, end);
+			goto exit;
+		}
+		dirty += ranges[i].size;
+	}
+
+	print_erase_saved(size - dirty, t2 - t1);
+
+exit:
+	free(ranges);
+	return ret;
+}
+
+static int
+serial_erase_all(cskburn_serial_device_t *dev, uint64_t flash_size)
+{
+	int ret;
+
+	if (!options.blank_check || options.target != TARGET_FLASH) {
+		LOGI("Erasing entire flash...");
+		if ((ret = cskburn_serial_erase_all(dev, options.target, flash_size)) != 0) {
+			ERR_RET_NO_CTX(ret);
+		}
+		return ret;
+	}
+
+	diff_range_t *ranges = NULL;
+	uint32_t count = 0;
+
+	LOGI("Checking entire flash...");
+	uint64_t t1 = time_monotonic();
+	if ((ret = diff_scan_blank(dev, options.target, 0, (uint32_t)flash_size, &ranges, &count)) !=
+			0) {
+		ERR_RET_NO_CTX(ret);
+		return ret;
+	}
+	uint64_t t2 = time_monotonic();
+
+	uint32_t dirty = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		dirty += ranges[i].size;
+	}
+
+	if (dirty == 0) {
+		print_erase_saved((uint32_t)flash_size, t2 - t1);
+	} else if (dirty > flash_size / 2) {
+		// 大部分区域需要擦除时，整片擦除更快
+		LOGI("Erasing entire flash...");
+		if ((ret = cskburn_serial_erase_all(dev, options.target, flash_size)) != 0) {
+			ERR_RET_NO_CTX(ret);
+		}
+	} else {
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t start = ranges[i].offset;
+			uint32_t end = start + ranges[i].size;
+			LOGI("Erasing region 0x%08X-0x%08X...", start, end);
+			if ((ret = cskburn_serial_erase(dev, options.target, start, ranges[i].size)) != 0) {
+				ERR_RET(ret, "region 0x%08X-0x%08X", start, end);
+				goto exit;
+			}
+		}
+		print_erase_saved((uint32_t)flash_size - dirty, t2 - t1);
+	}
+
+exit:
+	free(ranges);
+	return ret;
+}
+
+static int
+serial_write_diff(
+		cskburn_serial_device_t *dev, cskburn_partition_t *parts, int index, int parts_cnt)
+{
+	int ret;
+	cskburn_partition_t *part = &parts[index];
+	uint32_t size = part->reader->size;
+	diff_range_t *ranges = NULL;
+	uint32_t count = 0;
+
+	uint8_t *image = (uint8_t *)malloc(size > 0 ? size : 1);
+	if (image == NULL) {
+		ERR_CTX(CSKBURN_ERR_FILE_READ_FAILED, "partition %d", index + 1);
+		ret = -CSKBURN_ERR_FILE_READ_FAILED;
+		goto exit;
+	}
+
+	// 整个分区读入内存，同时也让 --verify-all 安装的 hook 计算出完整的 md5
+	if (part->reader->read(part->reader, image, size) != size) {
+		ERR_CTX(CSKBURN_ERR_FILE_READ_FAILED, "partition %d", index + 1);
+		ret = -CSKBURN_ERR_FILE_READ_FAILED;
+		goto exit;
+	}
+
+	LOGI("Comparing partition %d/%d... (0x%08X, %.2f KB)", index + 1, parts_cnt, part->addr,
+			(float)size / 1024.0f);
+	if ((ret = diff_scan(dev, options.target, part->addr, image, size, &ranges, &count)) != 0) {
+		ERR_RET(ret, "partition %d", index + 1);
+		goto exit;
+	}
+
+	uint32_t changed = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		changed += ranges[i].size;
+	}
+	LOGI("Skipped %.2f KB unchanged, %.2f KB in %u range(s) to burn",
+			(float)(size - changed) / 1024.0f, (float)changed / 1024.0f, count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t addr = part->addr + ranges[i].offset;
+		uint32_t length = ranges[i].size;
+
+		if (!options.chip->flash_auto_erase) {
+			uint32_t erase_size = align_up(length, FLASH_ALIGN);
+			LOGI("Erasing region 0x%08X-0x%08X...", addr, addr + erase_size);
+			if ((ret = cskburn_serial_erase(dev, options.target, addr, erase_size)) != 0) {
+				ERR_RET(ret, "region 0x%08X-0x%08X", addr, addr + erase_size);
+				goto exit;
+			}
+		}
+
+		reader_t *reader = memreader_alloc(length);
+		if (reader == NULL) {
+			ERR_CTX(CSKBURN_ERR_FILE_READ_FAILED, "partition %d", index + 1);
+			ret = -CSKBURN_ERR_FILE_READ_FAILED;
+			goto exit;
+		}
+		memreader_feed(reader, image + ranges[i].offset, length);
+
+		LOGI("Burning region 0x%08X-0x%08X...", addr, addr + length);
+		ret = cskburn_serial_write(
+				dev, options.target, addr, reader, 0, options.progress ? print_progress : NULL);
+		reader->close(&reader);
+		if (ret != 0) {
+			ERR_RET(ret, "partition %d", index + 1);
+			goto exit;
+		}
+	}
+
+	ret = 0;
+
+exit:
+	free(ranges);
+	free(image);
+	return ret;
+}
+
+// 续写时每确认这么多数据记录一次进度
+#define JOURNAL_INTERVAL (64 * 1024)
+
+static struct {
+	journal_t *journal;
+	uint32_t addr;
+	uint32_t size;
+	uint8_t md5[MD5_SIZE];
+	uint32_t start;  // 本次从分区内的该偏移开始写入
+	uint32_t recorded;
+} resume_state;
+
+static void
+resume_progress(int32_t wrote_bytes, uint32_t total_bytes)
+{
+	// 进度按整个分区显示，已写入的部分计入其中
+	if (wrote_bytes < 0) {
+		if (options.progress) {
+			print_progress(wrote_bytes, total_bytes);
+		}
+		return;
+	}
+
+	uint32_t done = resume_state.start + (uint32_t)wrote_bytes;
+	if (options.progress) {
+		print_progress((int32_t)done, resume_state.size);
+	}
+
+	if (done >= resume_state.recorded + JOURNAL_INTERVAL) {
+		if (journal_record(resume_state.journal, resume_state.addr, resume_state.size,
+					resume_state.md5, done) != 0) {
+			LOGD("DEBUG: Failed to record progress 0x%08X+%u", resume_state.addr, done);
+		}
+		resume_state.recorded = done;
+	}
+}
+
+static int
+serial_write_resume(cskburn_serial_device_t *dev, journal_t *journal, cskburn_partition_t *parts,
+		int index, int parts_cnt)
+{
+	int ret;
+	cskburn_partition_t *part = &parts[index];
+	uint32_t size = part->reader->size;
+	reader_t *reader = NULL;
+
+	uint8_t *image = (uint8_t *)malloc(size > 0 ? size : 1);
+	if (image == NULL) {
+		ERR_CTX(CSKBURN_ERR_FILE_READ_FAILED, "partition %d", index + 1);
+		ret = -CSKBURN_ERR_FILE_READ_FAILED;
+		goto exit;
+	}
+
+	// 整个分区读入内存以计算 md5 作为进度的标识，同时也让 --verify-all 的 hook 看到全部数据
+	if (part->reader->read(part->reader, image, size) != size) {
+		ERR_CTX(CSKBURN_ERR_FILE_READ_FAILED, "partition %d", index + 1);
+		ret = -CSKBURN_ERR_FILE_READ_FAILED;
+		goto exit;
+	}
+
+	resume_state.journal = journal;
+	resume_state.addr = part->addr;
+	resume_state.size = size;
+	mbedtls_md5(image, size, resume_state.md5);
+	resume_state.start = 0;
+
+	// 记录的进度只说明设备曾确认过这些数据，续写前以一次 md5 确认它们仍在 flash 上
+	uint32_t done = align_down(journal_lookup(journal, part->addr, size, resume_state.md5),
+			FLASH_ALIGN);
+	if (done > 0) {
+		uint8_t image_md5[MD5_SIZE] = {0};
+		uint8_t flash_md5[MD5_SIZE] = {0};
+		mbedtls_md5(image, done, image_md5);
+		if ((ret = cskburn_serial_verify(dev, options.target, part->addr, done, flash_md5)) != 0) {
+			ERR_RET(ret, "partition %d", index + 1);
+			goto exit;
+		}
+		if (memcmp(image_md5, flash_md5, MD5_SIZE) == 0) {
+			LOGI("Confirmed %.2f KB of partition %d/%d already written", (float)done / 1024.0f,
+					index + 1, parts_cnt);
+			resume_state.start = done;
+		} else {
+			LOGI("Partition %d/%d on flash differs from the recorded progress, starting over",
+					index + 1, parts_cnt);
+		}
+	}
+	resume_state.recorded = resume_state.start;
+
+	uint32_t start = resume_state.start;
+	if (start < size) {
+		if (!options.chip->flash_auto_erase) {
+			uint32_t erase_size = align_up(size - start, FLASH_ALIGN);
+			if ((ret = serial_erase(dev, part->addr + start, erase_size)) != 0) {
+				goto exit;
+			}
+		}
+
+		reader = memreader_alloc(size - start);
+		if (reader == NULL) {
+			ERR_CTX(CSKBURN_ERR_FILE_READ_FAILED, "partition %d", index + 1);
+			ret = -CSKBURN_ERR_FILE_READ_FAILED;
+			goto exit;
+		}
+		memreader_feed(reader, image + start, size - start);
+
+		LOGI("Burning partition %d/%d... (0x%08X, %.2f KB)", index + 1, parts_cnt,
+				part->addr + start, (float)(size - start) / 1024.0f);
+		if ((ret = cskburn_serial_write(
+					 dev, options.target, part->addr + start, reader, 0, resume_progress)) != 0) {
+			ERR_RET(ret, "partition %d", index + 1);
+			goto exit;
+		}
+	}
+
+	if (journal_record(journal, part->addr, size, resume_state.md5, size) != 0) {
+		LOGD("DEBUG: Failed to record partition %d as written", index + 1);
+	}
+	ret = 0;
+
+exit:
+	if (reader != NULL) {
+		reader->close(&reader);
+	}
+	free(image);
+	return ret;
+}
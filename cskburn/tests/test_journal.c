@@ -0,0 +1,89 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "journal.h"
+
+#define CHECK(expr)                                                                             \
+	do {                                                                                        \
+		if (!(expr)) {                                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr);          \
+			return false;                                                                       \
+		}                                                                                       \
+	} while (0)
+
+#define JOURNAL_PATH "cskburn_journal_test.journal"
+
+static const uint8_t md5_a[16] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0xfe, 0xdc,
+		0xba, 0x98, 0x76, 0x54, 0x32, 0x10};
+static const uint8_t md5_b[16] = {0xff};
+
+static bool
+test_record_lookup(void)
+{
+	remove(JOURNAL_PATH);
+
+	journal_t *journal = journal_open(JOURNAL_PATH);
+	CHECK(journal != NULL);
+	CHECK(journal_lookup(journal, 0x0, 0x100000, md5_a) == 0);
+
+	CHECK(journal_record(journal, 0x0, 0x100000, md5_a, 0x10000) == 0);
+	CHECK(journal_record(journal, 0x0, 0x100000, md5_a, 0x20000) == 0);
+	CHECK(journal_record(journal, 0x100000, 0x8000, md5_b, 0x8000) == 0);
+	CHECK(journal_lookup(journal, 0x0, 0x100000, md5_a) == 0x20000);
+	CHECK(journal_lookup(journal, 0x100000, 0x8000, md5_b) == 0x8000);
+
+	// 地址、大小或镜像不同都视为另一个分区
+	CHECK(journal_lookup(journal, 0x1000, 0x100000, md5_a) == 0);
+	CHECK(journal_lookup(journal, 0x0, 0x200000, md5_a) == 0);
+	CHECK(journal_lookup(journal, 0x0, 0x100000, md5_b) == 0);
+	journal_close(&journal);
+	CHECK(journal == NULL);
+
+	// 重新打开后恢复每个分区最后一次记录的进度
+	journal = journal_open(JOURNAL_PATH);
+	CHECK(journal != NULL);
+	CHECK(journal_lookup(journal, 0x0, 0x100000, md5_a) == 0x20000);
+	CHECK(journal_lookup(journal, 0x100000, 0x8000, md5_b) == 0x8000);
+	journal_close(&journal);
+
+	remove(JOURNAL_PATH);
+	return true;
+}
+
+static bool
+test_truncated(void)
+{
+	remove(JOURNAL_PATH);
+
+	journal_t *journal = journal_open(JOURNAL_PATH);
+	CHECK(journal != NULL);
+	CHECK(journal_record(journal, 0x0, 0x100000, md5_a, 0x10000) == 0);
+	journal_close(&journal);
+
+	// 写到一半被打断的记录及无效的进度不影响之前的记录
+	FILE *file = fopen(JOURNAL_PATH, "a");
+	CHECK(file != NULL);
+	fputs("00000000 1048576 0123456789abcdeffedcba9876543210 2097152\n", file);
+	fputs("00000000 1048576 0123456789abcdef", file);
+	fclose(file);
+
+	journal = journal_open(JOURNAL_PATH);
+	CHECK(journal != NULL);
+	CHECK(journal_lookup(journal, 0x0, 0x100000, md5_a) == 0x10000);
+	journal_close(&journal);
+
+	remove(JOURNAL_PATH);
+	return true;
+}
+
+int
+main(void)
+{
+	if (!test_record_lookup() || !test_truncated()) {
+		return 1;
+	}
+	puts("journal tests passed");
+	return 0;
+}
@@ -91,6 +91,9 @@ int cskburn_serial_connect(cskburn_serial_device_t *dev, uint32_t reset_delay,
 /**
  * @brief Enter CSK burn mode
  *
+ * Once the burner runs at baud_rate, the session switches from SLIP to COBS framing if the
+ * burner supports it.
+ *
  * @param dev Device handle
  * @param baud_rate Baud rate to use
  * @param burner Custom burner.img to use, NULL to use default
@@ -103,6 +106,72 @@ int cskburn_serial_connect(cskburn_serial_device_t *dev, uint32_t reset_delay,
 int cskburn_serial_enter(
 		cskburn_serial_device_t *dev, uint32_t baud_rate, uint8_t *burner, uint32_t len);
 
+/**
+ * @brief Attach to a burner that is already running on the device
+ *
+ * A previous session that exited without resetting the device leaves the burner resident.
+ * It is looked for at baud_rate first and then at the initial baud rate, and is switched to
+ * baud_rate if found at the latter. On success the device is ready for burning as if
+ * cskburn_serial_connect() and cskburn_serial_enter() had been called, including the framing
+ * negotiated by the latter.
+ *
+ * @param dev Device handle
+ * @param baud_rate Baud rate to use
+ *
+ * @retval 0 if a running burner was found
+ * @retval -ETIMEDOUT if no burner answered, the device needs to be reset
+ * @retval -CSKBURN_ERR_BAUD_REJECTED if the burner refused to change to baud_rate
+ * @retval -CSKBURN_ERR_BAUD_SYNC_LOST if the burner was lost after changing baud rate
+ * @retval -errno on other errors from serial device
+ */
+int cskburn_serial_attach(cskburn_serial_device_t *dev, uint32_t baud_rate);
+
+/**
+ * @brief Find the fastest baud rate that the link sustains
+ *
+ * Must be called after the target is initialized. For flash, the first bytes are read back at
+ * the current baud rate as a reference, then each candidate is switched to in turn and checked by
+ * syncing and reading back the same bytes. Other targets have nothing to read back, and each rate
+ * is checked by a series of sync round trips instead. The search stops at the first candidate that
+ * fails, and the device is switched back to the last stable rate.
+ *
+ * @param dev Device handle
+ * @param target Target the session burns, decides how the link is checked
+ * @param candidates Baud rates to try, in ascending order
+ * @param count Number of candidates
+ * @param baud_rate Chosen baud rate, the device is left at this rate
+ * @param speed Read throughput measured at the chosen rate, in bytes per second
+ *
+ * @retval 0 if successful
+ * @retval -CSKBURN_ERR_BAUD_PROBE_FAILED if the link cannot be checked at the current rate, so no
+ *         candidate was tested
+ * @retval -CSKBURN_ERR_BAUD_SYNC_LOST if the device cannot be brought back to a stable rate
+ * @retval -errno on other errors from serial device
+ */
+int cskburn_serial_probe_baud(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
+		const uint32_t *candidates, uint32_t count, uint32_t *baud_rate, uint32_t *speed);
+
+/**
+ * @brief Set the number of flash data blocks kept in flight while writing
+ *
+ * @param dev Device handle
+ * @param window Number of blocks sent ahead of their acknowledgements, 1 for stop-and-wait
+ *
+ * @retval 0 if successful
+ * @retval -EINVAL if window is out of range
+ */
+int cskburn_serial_set_write_window(cskburn_serial_device_t *dev, uint32_t window);
+
+/**
+ * @brief Skip data blocks that are entirely 0xFF when writing to flash
+ *
+ * Only valid if the region being written has been erased beforehand.
+ *
+ * @param dev Device handle
+ * @param skip Whether to skip blank blocks
+ */
+void cskburn_serial_set_skip_blank(cskburn_serial_device_t *dev, bool skip);
+
 int cskburn_serial_write(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
 		uint32_t addr, reader_t *reader, uint32_t jump,
 		void (*on_progress)(int32_t wrote_bytes, uint32_t total_bytes));
@@ -120,6 +189,27 @@ int cskburn_serial_erase(
 int cskburn_serial_verify(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
 		uint32_t addr, uint32_t size, uint8_t *md5);
 
+/**
+ * @brief Get the MD5 of each chunk of a flash region
+ *
+ * Burners that support it return all digests for one request in a single streamed response,
+ * others are asked for one chunk at a time. Used to find out which parts of the flash already
+ * hold the expected data.
+ *
+ * @param dev Device handle
+ * @param addr Start address of the region
+ * @param size Size of the region
+ * @param chunk_size Size of each chunk, the last chunk may be shorter
+ * @param digests Buffer for the digests, 16 bytes for each of the ceil(size / chunk_size)
+ * chunks, in address order
+ *
+ * @retval 0 if successful
+ * @retval -EINVAL if size or chunk_size is 0
+ * @retval -CSKBURN_ERR_VERIFY_READ_FAILED if the digests cannot be read
+ */
+int cskburn_serial_hash_map(cskburn_serial_device_t *dev, uint32_t addr, uint32_t size,
+		uint32_t chunk_size, uint8_t *digests);
+
 int cskburn_serial_read_chip_id(cskburn_serial_device_t *dev, uint8_t *chip_id);
 
 int cskburn_serial_get_flash_info(
@@ -8,7 +8,6 @@
 
 #include "core.h"
 #include "log.h"
-#include "msleep.h"
 #include "serial.h"
 #include "slip.h"
 #include "time_monotonic.h"
@@ -31,6 +30,9 @@
 #define CMD_READ_FLASH 0x0e
 #define CMD_CHANGE_BAUDRATE 0x0f
 #define CMD_SPI_FLASH_MD5 0x13
+#define CMD_MEM_DEFL_BEGIN 0x15
+#define CMD_MEM_DEFL_DATA 0x16
+#define CMD_MEM_DEFL_END 0x17
 #define CMD_NAND_INIT 0x20
 #define CMD_NAND_BEGIN 0x21
 #define CMD_NAND_DATA 0x22
@@ -39,24 +41,36 @@
 #define CMD_FLASH_ERASE_CHIP 0xD0
 #define CMD_FLASH_ERASE_REGION 0xD1
 #define CMD_READ_FLASH_STREAM 0xD2
+#define CMD_WRITE_FLASH_STREAM 0xD3
+#define CMD_FLASH_LZ_DATA 0xD4
+#define CMD_SET_FRAMING 0xD5
+#define CMD_FLASH_HASH_MAP 0xD6
 #define CMD_READ_FLASH_ID 0xF3
 #define CMD_READ_CHIP_ID 0xF4
 
 #define CHECKSUM_MAGIC 0xef
 #define CHECKSUM_NONE 0
 
+// 校验和只占校验字的低 8 位，回显序号的 burner 以高 24 位携带请求序号
+#define SEQ_SHIFT 8
+#define SEQ_MASK 0xFFFFFF
+
 // 默认指令超时时间
 #define TIMEOUT_DEFAULT 200
 
 // Mem 写入指令超时时间
 #define TIMEOUT_MEM_DATA 500
 
+// 试探 ROM 是否接受较大的 RAM 块时，第一个数据块只在其线路传输时间之外再等待这么久 (ms)。
+// 不接受该块大小的 ROM 可能直接丢弃数据而不应答，无需等满 TIMEOUT_MEM_DATA
+#define TIMEOUT_MEM_PROBE 100
+
 // Flash 写入指令超时时间
 // 实测极限烧录速度为 8M/48s，约 170KB/s
 // 换算可得每 4K-block 的写入耗时为 23.4375ms
 // 因此写入超时取 100ms
 // 当 erase 阻塞导致队列满时，burner 会延迟 100ms 返回 0x0A，故取 500ms 保险值
-// 取值过小会导致正常返回和重试返回叠加，seq 错位
+// 应答不带 seq，超时后迟到的应答会与重发块的应答错位，因此重发前先以一次同步清空管线
 #define TIMEOUT_FLASH_DATA 1000
 
 // Flash 结束写入指令超时时间
@@ -73,6 +87,11 @@
 // 取保守值
 #define TIMEOUT_FLASH_MD5SUM_PER_MB 1000
 
+// 写入块失败后会重发，其超时按实测往返时间调整，TIMEOUT_FLASH_DATA 作为上限；
+// 下限须覆盖 burner 延迟 100ms 返回 0x0A 的情况。超时过早只会多一次同步和重发，
+// 重发前的同步保证应答不会错位
+#define RTT_MIN_FLASH_DATA 200
+
 typedef struct {
 	uint32_t size;
 	uint32_t blocks;
@@ -125,6 +144,25 @@ typedef struct {
 	uint32_t max_in_flight;
 } cmd_read_flash_stream_t;
 
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	uint32_t block_size;
+	uint32_t max_in_flight;
+} cmd_write_flash_stream_t;
+
+typedef struct {
+	uint32_t framing;
+	uint32_t max_frame_len;
+} cmd_set_framing_t;
+
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	uint32_t chunk_size;
+	uint32_t rev;
+} cmd_flash_hash_map_t;
+
 static ssize_t
 command_send(cskburn_serial_device_t *dev, uint8_t op, uint8_t *req_buf, uint32_t req_len,
 		uint32_t timeout)
@@ -132,8 +170,65 @@ command_send(cskburn_serial_device_t *dev, uint8_t op, uint8_t *req_buf, uint32_
 	return slip_write(dev->slip, req_buf, req_len, timeout);
 }
 
+// 分配下一个请求序号，返回需并入校验字的部分；burner 不回显序号时不改动校验字
+static uint32_t
+command_seq_next(cskburn_serial_device_t *dev)
+{
+	dev->req_seq++;
+	return dev->seq_echo ? (dev->req_seq & SEQ_MASK) << SEQ_SHIFT : 0;
+}
+
+// 应答末尾回显的序号须不早于最近一条同步命令，也不晚于最新发出的请求
+static bool
+command_seq_match(cskburn_serial_device_t *dev, ssize_t r)
+{
+	if (!dev->seq_echo) {
+		return true;
+	}
+
+	csk_response_t *res = (csk_response_t *)dev->res_buf;
+	uint32_t end = (uint32_t)sizeof(csk_response_t) + res->size;
+	uint32_t echo;
+	if ((uint32_t)r < end + sizeof(echo)) {
+		return false;
+	}
+	memcpy(&echo, dev->res_buf + end, sizeof(echo));
+
+	return ((echo - dev->seq_min) & SEQ_MASK) <= ((dev->req_seq - dev->seq_min) & SEQ_MASK);
+}
+
+// 判断收到的帧是否为本次命令的应答。不再在每条命令前后清空串口缓冲区，
+// 因此须依靠 op 与载荷长度严格匹配，丢弃此前超时命令迟到的应答等无关帧。
+// burner 回显序号时另按序号丢弃过期应答；否则 op 与长度相同的迟到应答
+// （如超时的 FLASH_MD5、READ_FLASH_ID）无法识别，会被当作本次的应答
+static bool
+command_match(cskburn_serial_device_t *dev, uint8_t op, uint16_t expect_len, ssize_t r)
+{
+	// 短于响应头的残帧无法可靠解析；借助 && 短路避免读取缓冲区里
+	// 上一条响应残留的陈旧头部，从而被误判为本次命令的合法应答
+	csk_response_t *res = (csk_response_t *)dev->res_buf;
+	if (r < (ssize_t)sizeof(csk_response_t) || res->direction != DIR_RES || res->command != op) {
+		return false;
+	}
+
+	// 设备声明的载荷长度不得超过本帧实际收到的长度
+	uint32_t payload = (uint32_t)r - (uint32_t)sizeof(csk_response_t);
+	if (res->size > payload || !command_seq_match(dev, r)) {
+		return false;
+	}
+
+	// 出错应答可能不携带数据，仅要求包含状态字节；正常应答须达到期望长度
+	uint8_t *status = dev->res_buf + sizeof(csk_response_t);
+	if (res->size >= STATUS_BYTES_LEN && status[0] != 0) {
+		return true;
+	}
+	return res->size >= expect_len;
+}
+
+// 接收 op 或 alt_op 的应答，alt_op 的应答只要求包含状态字节
 static ssize_t
-command_recv(cskburn_serial_device_t *dev, uint8_t op, uint8_t **res_buf, uint32_t timeout)
+command_recv_alt(cskburn_serial_device_t *dev, uint8_t op, uint16_t expect_len, uint8_t alt_op,
+		uint8_t **res_buf, uint32_t timeout)
 {
 	if (dev->timeout > 0 && op != CMD_SYNC) {
 		timeout = dev->timeout;
@@ -155,29 +250,33 @@ command_recv(cskburn_serial_device_t *dev, uint8_t op, uint8_t **res_buf, uint32
 			return r;
 		}
 
-		// 短于响应头的残帧无法可靠解析；借助 && 短路避免读取缓冲区里
-		// 上一条响应残留的陈旧头部，从而被误判为本次命令的合法应答
-		csk_response_t *res = (csk_response_t *)dev->res_buf;
-		if (r >= (ssize_t)sizeof(csk_response_t) && res->direction == DIR_RES &&
-				res->command == op) {
+		if (command_match(dev, op, expect_len, r) ||
+				(alt_op != op && command_match(dev, alt_op, STATUS_BYTES_LEN, r))) {
 			*res_buf = dev->res_buf;
 			return r;
 		}
+
+		LOG_TRACE("Dropped unmatched frame of %zd bytes while waiting for op=%02X", r, op);
 	} while (TIME_SINCE_MS(start) < timeout || wait_forever);
 
 	return -ETIMEDOUT;
 }
 
+static ssize_t
+command_recv(cskburn_serial_device_t *dev, uint8_t op, uint16_t expect_len, uint8_t **res_buf,
+		uint32_t timeout)
+{
+	return command_recv_alt(dev, op, expect_len, op, res_buf, timeout);
+}
+
 static int
-command(cskburn_serial_device_t *dev, uint8_t op, uint16_t in_len, uint32_t in_chk,
-		uint32_t *out_val, void *out_buf, uint16_t *out_len, uint16_t out_limit, uint32_t timeout)
+command_post(cskburn_serial_device_t *dev, uint8_t op, uint16_t in_len, uint32_t in_chk,
+		uint32_t timeout)
 {
 	int ret;
 
-	serial_discard_input(dev->serial);
-	serial_discard_output(dev->serial);
-
-	LOG_TRACE("> req op=%02X len=%d", op, in_len);
+	uint32_t seq = command_seq_next(dev);
+	LOG_TRACE("> req #%u op=%02X len=%d", dev->req_seq, op, in_len);
 #if TRACE_DATA
 	LOG_DUMP(dev->req_cmd, in_len);
 #endif
@@ -186,18 +285,37 @@ command(cskburn_serial_device_t *dev, uint8_t op, uint16_t in_len, uint32_t in_c
 	req->direction = DIR_REQ;
 	req->command = op;
 	req->size = in_len;
-	req->checksum = in_chk;
+	req->checksum = in_chk | seq;
 
 	uint32_t req_len = sizeof(csk_command_t) + in_len;
 	if ((ret = command_send(dev, op, dev->req_buf, req_len, timeout)) < 0) {
 		if (ret != -ETIMEDOUT) {
 			LOGD_RET(ret, "DEBUG: Failed to write command %02X", op);
 		}
+		return ret;
+	}
+
+	return 0;
+}
+
+// 应答载荷（含状态字节）须至少为 out_limit 字节才被视作本次命令的应答，出错应答除外
+static int
+command(cskburn_serial_device_t *dev, uint8_t op, uint16_t in_len, uint32_t in_chk,
+		uint32_t *out_val, void *out_buf, uint16_t *out_len, uint16_t out_limit, uint32_t timeout)
+{
+	int ret;
+
+	uint64_t start = time_monotonic();
+
+	if ((ret = command_post(dev, op, in_len, in_chk, timeout)) < 0) {
 		goto exit;
 	}
+	// 同步命令之前发出的请求均已结束，其迟到的应答不再有效
+	dev->seq_min = dev->req_seq;
 
 	uint8_t *res_ptr;
-	if ((ret = command_recv(dev, op, &res_ptr, timeout)) < 0) {
+	uint16_t expect_len = out_buf != NULL ? out_limit : 0;
+	if ((ret = command_recv(dev, op, expect_len, &res_ptr, timeout)) < 0) {
 		if (ret != -ETIMEDOUT) {
 			LOGD_RET(ret, "DEBUG: Failed to read command %02X", op);
 		}
@@ -207,7 +325,8 @@ command(cskburn_serial_device_t *dev, uint8_t op, uint16_t in_len, uint32_t in_c
 	csk_response_t *res = (csk_response_t *)res_ptr;
 	uint8_t *res_data = res_ptr + sizeof(csk_response_t);
 
-	LOG_TRACE("< res op=%02X len=%d val=%d", res->command, res->size, res->value);
+	LOG_TRACE("< res #%u op=%02X len=%d val=%d in %d ms", dev->req_seq, res->command, res->size,
+			res->value, TIME_SINCE_MS(start));
 #if TRACE_DATA
 	LOG_DUMP(res_data, res->size);
 #endif
@@ -231,10 +350,11 @@ command(cskburn_serial_device_t *dev, uint8_t op, uint16_t in_len, uint32_t in_c
 		*out_len = res_size;
 	}
 
-	ret = 0;
+	return 0;
 
 exit:
-	serial_discard_input(dev->serial);
+	// 出错后串口中可能残留迟到的应答或半截帧，清空后再继续，使下一条命令从干净的状态开始
+	slip_discard_input(dev->slip);
 	return ret;
 }
 
@@ -286,6 +406,64 @@ calc_timeout(uint32_t size, uint32_t per_mb)
 	return per_mb * (mb == 0 ? 1 : mb);
 }
 
+void
+cmd_init_rtt(cskburn_serial_device_t *dev)
+{
+	rtt_init(&dev->rtt_flash_data, "Flash block", RTT_MIN_FLASH_DATA, TIMEOUT_FLASH_DATA);
+}
+
+// 发送一个数据块但不等待应答，供流水线写入使用。压缩块以 rev1 携带解压后的长度
+static int
+block_send(cskburn_serial_device_t *dev, uint8_t op, uint8_t *data, uint32_t data_len,
+		uint32_t seq, uint32_t raw_len)
+{
+	cmd_flash_block_t *cmd = (cmd_flash_block_t *)dev->req_cmd;
+	memset(cmd, 0, sizeof(cmd_flash_block_t));
+	cmd->size = data_len;
+	cmd->seq = seq;
+	cmd->rev1 = raw_len;
+	cmd->rev2 = 0;
+
+	uint8_t *req_data = (uint8_t *)dev->req_cmd + sizeof(cmd_flash_block_t);
+	memcpy(req_data, data, data_len);
+
+	uint32_t in_len = sizeof(cmd_flash_block_t) + data_len;
+
+	return command_post(dev, op, in_len, checksum(data, data_len), TIMEOUT_FLASH_DATA);
+}
+
+// 接收最早一个在途数据块的应答；burner 按收到的顺序逐一应答，应答中不携带 seq。
+// 压缩块与原始块交错发送，两者的应答均可对应
+static int
+block_recv(cskburn_serial_device_t *dev, uint8_t op, uint8_t alt_op, uint32_t timeout)
+{
+	uint8_t *res_ptr;
+	ssize_t r = command_recv_alt(dev, op, STATUS_BYTES_LEN, alt_op, &res_ptr, timeout);
+	if (r < 0) {
+		if (r != -ETIMEDOUT) {
+			LOGD_RET(r, "DEBUG: Failed to read command %02X", op);
+		}
+		return r;
+	}
+
+	csk_response_t *res = (csk_response_t *)res_ptr;
+	uint8_t *status = res_ptr + sizeof(csk_response_t);
+
+	LOG_TRACE("< res op=%02X len=%d val=%d", res->command, res->size, res->value);
+
+	if ((size_t)r < sizeof(csk_response_t) + STATUS_BYTES_LEN) {
+		LOGD("DEBUG: Interrupted serial read of command %02X", op);
+		return -EIO;
+	}
+
+	if (status[0]) {
+		LOGD("DEBUG: Unexpected device response of command %02X: 0x%02X", op, status[1]);
+		return status[1];
+	}
+
+	return 0;
+}
+
 int
 cmd_sync(cskburn_serial_device_t *dev, uint16_t timeout)
 {
@@ -396,32 +574,16 @@ cmd_nand_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks, uin
 }
 
 int
-cmd_nand_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
+cmd_nand_block_send(
+		cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
 {
-	cmd_flash_block_t *cmd = (cmd_flash_block_t *)dev->req_cmd;
-	memset(cmd, 0, sizeof(cmd_flash_block_t));
-	cmd->size = data_len;
-	cmd->seq = seq;
-	cmd->rev1 = 0;
-	cmd->rev2 = 0;
-
-	uint8_t *req_data = (uint8_t *)dev->req_cmd + sizeof(cmd_flash_block_t);
-	memcpy(req_data, data, data_len);
-
-	uint32_t in_len = sizeof(cmd_flash_block_t) + data_len;
-
-	int ret = check_command(
-			dev, CMD_NAND_DATA, in_len, checksum(data, data_len), NULL, TIMEOUT_FLASH_DATA);
-
-	if (ret != 0) {
-		LOGD("DEBUG: Failed writing block %d", seq);
-	}
-
-	if (ret == 0x0A) {
-		msleep(250);
-	}
+	return block_send(dev, CMD_NAND_DATA, data, data_len, seq, 0);
+}
 
-	return ret;
+int
+cmd_nand_block_recv(cskburn_serial_device_t *dev, uint32_t timeout)
+{
+	return block_recv(dev, CMD_NAND_DATA, CMD_NAND_DATA, timeout);
 }
 
 int
@@ -466,9 +628,9 @@ cmd_nand_md5(cskburn_serial_device_t *dev, uint32_t address, uint32_t size, uint
 	return 0;
 }
 
-int
-cmd_mem_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks, uint32_t block_size,
-		uint32_t offset)
+static int
+mem_begin(cskburn_serial_device_t *dev, uint8_t op, uint32_t size, uint32_t blocks,
+		uint32_t block_size, uint32_t offset)
 {
 	cmd_mem_begin_t *cmd = (cmd_mem_begin_t *)dev->req_cmd;
 	memset(cmd, 0, sizeof(cmd_mem_begin_t));
@@ -477,12 +639,12 @@ cmd_mem_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks, uint
 	cmd->block_size = block_size;
 	cmd->offset = offset;
 
-	return check_command(
-			dev, CMD_MEM_BEGIN, sizeof(cmd_mem_begin_t), CHECKSUM_NONE, NULL, TIMEOUT_DEFAULT);
+	return check_command(dev, op, sizeof(cmd_mem_begin_t), CHECKSUM_NONE, NULL, TIMEOUT_DEFAULT);
 }
 
-int
-cmd_mem_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
+static int
+mem_block(cskburn_serial_device_t *dev, uint8_t op, uint8_t *data, uint32_t data_len,
+		uint32_t seq, uint32_t timeout)
 {
 	cmd_mem_block_t *cmd = (cmd_mem_block_t *)dev->req_cmd;
 	memset(cmd, 0, sizeof(cmd_mem_block_t));
@@ -496,20 +658,70 @@ cmd_mem_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, ui
 
 	uint32_t in_len = sizeof(cmd_mem_block_t) + data_len;
 
-	return check_command(
-			dev, CMD_MEM_DATA, in_len, checksum(data, data_len), NULL, TIMEOUT_MEM_DATA);
+	return check_command(dev, op, in_len, checksum(data, data_len), NULL, timeout);
 }
 
-int
-cmd_mem_finish(cskburn_serial_device_t *dev, cmd_finish_action_t action, uint32_t address)
+static int
+mem_finish(cskburn_serial_device_t *dev, uint8_t op, cmd_finish_action_t action, uint32_t address)
 {
 	cmd_mem_finish_t *cmd = (cmd_mem_finish_t *)dev->req_cmd;
 	memset(cmd, 0, sizeof(cmd_mem_finish_t));
 	cmd->option = action;
 	cmd->address = address;
 
-	return check_command(
-			dev, CMD_MEM_END, sizeof(cmd_mem_finish_t), CHECKSUM_NONE, NULL, TIMEOUT_DEFAULT);
+	return check_command(dev, op, sizeof(cmd_mem_finish_t), CHECKSUM_NONE, NULL, TIMEOUT_DEFAULT);
+}
+
+int
+cmd_mem_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks, uint32_t block_size,
+		uint32_t offset)
+{
+	return mem_begin(dev, CMD_MEM_BEGIN, size, blocks, block_size, offset);
+}
+
+int
+cmd_mem_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
+{
+	return mem_block(dev, CMD_MEM_DATA, data, data_len, seq, TIMEOUT_MEM_DATA);
+}
+
+int
+cmd_mem_block_probe(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
+{
+	uint32_t timeout = TIMEOUT_MEM_DATA;
+	if (dev->baud > 0) {
+		// 8N1 每字节 10 位，转义带来的少量开销由 TIMEOUT_MEM_PROBE 覆盖
+		uint64_t wire = (uint64_t)(sizeof(csk_command_t) + sizeof(cmd_mem_block_t) + data_len) *
+						10 * 1000 / dev->baud;
+		timeout = (uint32_t)wire + TIMEOUT_MEM_PROBE;
+	}
+	return mem_block(dev, CMD_MEM_DATA, data, data_len, seq, timeout);
+}
+
+int
+cmd_mem_finish(cskburn_serial_device_t *dev, cmd_finish_action_t action, uint32_t address)
+{
+	return mem_finish(dev, CMD_MEM_END, action, address);
+}
+
+// size 为解压后的长度，blocks 与 block_size 按压缩数据计算
+int
+cmd_mem_defl_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks,
+		uint32_t block_size, uint32_t offset)
+{
+	return mem_begin(dev, CMD_MEM_DEFL_BEGIN, size, blocks, block_size, offset);
+}
+
+int
+cmd_mem_defl_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
+{
+	return mem_block(dev, CMD_MEM_DEFL_DATA, data, data_len, seq, TIMEOUT_MEM_DATA);
+}
+
+int
+cmd_mem_defl_finish(cskburn_serial_device_t *dev, cmd_finish_action_t action, uint32_t address)
+{
+	return mem_finish(dev, CMD_MEM_DEFL_END, action, address);
 }
 
 int
@@ -528,32 +740,23 @@ cmd_flash_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks, ui
 }
 
 int
-cmd_flash_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
+cmd_flash_block_send(
+		cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
 {
-	cmd_flash_block_t *cmd = (cmd_flash_block_t *)dev->req_cmd;
-	memset(cmd, 0, sizeof(cmd_flash_block_t));
-	cmd->size = data_len;
-	cmd->seq = seq;
-	cmd->rev1 = 0;
-	cmd->rev2 = 0;
-
-	uint8_t *req_data = (uint8_t *)dev->req_cmd + sizeof(cmd_flash_block_t);
-	memcpy(req_data, data, data_len);
-
-	uint32_t in_len = sizeof(cmd_flash_block_t) + data_len;
-
-	int ret = check_command(
-			dev, CMD_FLASH_DATA, in_len, checksum(data, data_len), NULL, TIMEOUT_FLASH_DATA);
-
-	if (ret != 0) {
-		LOGD("DEBUG: Failed writing block %d", seq);
-	}
+	return block_send(dev, CMD_FLASH_DATA, data, data_len, seq, 0);
+}
 
-	if (ret == 0x0A) {
-		msleep(250);
-	}
+int
+cmd_flash_lz_block_send(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len,
+		uint32_t raw_len, uint32_t seq)
+{
+	return block_send(dev, CMD_FLASH_LZ_DATA, data, data_len, seq, raw_len);
+}
 
-	return ret;
+int
+cmd_flash_block_recv(cskburn_serial_device_t *dev, uint32_t timeout)
+{
+	return block_recv(dev, CMD_FLASH_DATA, CMD_FLASH_LZ_DATA, timeout);
 }
 
 int
@@ -622,20 +825,27 @@ cmd_flash_md5sum(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
 	return 0;
 }
 
+// 一次请求取回区域内各块的 MD5：burner 先应答，再以不带命令头的帧依次发出摘要，
+// 除最后一帧外每帧 FLASH_HASH_MAP_FRAME 个。帧长不符说明丢了数据，整个请求作废
 int
-cmd_read_flash(cskburn_serial_device_t *dev, uint32_t address, uint32_t size, uint8_t *data,
-		uint32_t *data_len)
+cmd_flash_hash_map(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
+		uint32_t chunk_size, uint8_t *digests)
 {
-	uint8_t ret_buf[STATUS_BYTES_LEN + 64];
+	uint8_t ret_buf[STATUS_BYTES_LEN];
 	uint16_t ret_len = 0;
 
-	cmd_read_flash_t *cmd = (cmd_read_flash_t *)dev->req_cmd;
-	memset(cmd, 0, sizeof(cmd_read_flash_t));
+	if (chunk_size == 0) {
+		return -EINVAL;
+	}
+
+	cmd_flash_hash_map_t *cmd = (cmd_flash_hash_map_t *)dev->req_cmd;
+	memset(cmd, 0, sizeof(cmd_flash_hash_map_t));
 	cmd->address = address;
 	cmd->size = size;
+	cmd->chunk_size = chunk_size;
 
-	int ret = command(dev, CMD_READ_FLASH, sizeof(cmd_read_flash_t), CHECKSUM_NONE, NULL, ret_buf,
-			&ret_len, sizeof(ret_buf), TIMEOUT_FLASH_DATA);
+	int ret = command(dev, CMD_FLASH_HASH_MAP, sizeof(cmd_flash_hash_map_t), CHECKSUM_NONE, NULL,
+			ret_buf, &ret_len, sizeof(ret_buf), TIMEOUT_DEFAULT);
 	if (ret != 0) {
 		return ret;
 	}
@@ -646,43 +856,130 @@ cmd_read_flash(cskburn_serial_device_t *dev, uint32_t address, uint32_t size, ui
 	}
 
 	if (ret_buf[0] != 0) {
-		LOGD("DEBUG: Unexpected device response: 0x%02X", ret_buf[1]);
+		LOGD("DEBUG: flash_hash_map rejected: 0x%02X", ret_buf[1]);
 		return ret_buf[1];
 	}
 
-	*data_len = ret_len - STATUS_BYTES_LEN;
-	memcpy(data, ret_buf + STATUS_BYTES_LEN, *data_len);
+	// 每帧的超时按该帧覆盖的数据量计算，一帧覆盖的数据不会超过整个区域
+	uint32_t total = (uint32_t)(((uint64_t)size + chunk_size - 1) / chunk_size) * MD5_LEN;
+	uint64_t frame_size = (uint64_t)chunk_size * FLASH_HASH_MAP_FRAME;
+	if (frame_size > size) {
+		frame_size = size;
+	}
+	uint32_t timeout = calc_timeout((uint32_t)frame_size, TIMEOUT_FLASH_MD5SUM_PER_MB);
+	for (uint32_t received = 0; received < total;) {
+		ssize_t r = slip_read(dev->slip, dev->res_buf, MAX_RES_RAW_LEN, timeout);
+		if (r < 0) {
+			return r;
+		}
+
+		uint32_t want = total - received;
+		if (want > FLASH_HASH_MAP_FRAME * MD5_LEN) {
+			want = FLASH_HASH_MAP_FRAME * MD5_LEN;
+		}
+		if ((uint32_t)r != want) {
+			LOGD("DEBUG: flash_hash_map frame at %u: want %u, got %zd", received, want, r);
+			return -EIO;
+		}
+
+		memcpy(digests + received, dev->res_buf, want);
+		received += want;
+	}
+
+	return 0;
+}
+
+// 发送一个读取请求但不等待应答，供流水线读取使用
+int
+cmd_read_flash_send(cskburn_serial_device_t *dev, uint32_t address, uint32_t size)
+{
+	if (size > FLASH_READ_SIZE) {
+		return -EINVAL;
+	}
+
+	cmd_read_flash_t *cmd = (cmd_read_flash_t *)dev->req_cmd;
+	memset(cmd, 0, sizeof(cmd_read_flash_t));
+	cmd->address = address;
+	cmd->size = size;
+
+	return command_post(
+			dev, CMD_READ_FLASH, sizeof(cmd_read_flash_t), CHECKSUM_NONE, TIMEOUT_FLASH_DATA);
+}
+
+// 发送一个屏障请求。读取应答中不携带地址，丢失一个应答后其余应答会错位；
+// 在一批读取请求之后跟一个应答可区分的请求，收到它的位置不对即说明有应答丢失
+int
+cmd_read_flash_fence(cskburn_serial_device_t *dev)
+{
+	return command_post(dev, CMD_READ_FLASH_ID, 0, CHECKSUM_NONE, TIMEOUT_DEFAULT);
+}
+
+// 接收最早一个在途读取请求或屏障的应答；burner 按收到的顺序逐一应答
+int
+cmd_read_flash_recv(cskburn_serial_device_t *dev, uint32_t size, uint8_t *data,
+		uint32_t *data_len, bool *fence)
+{
+	uint8_t *res_ptr;
+	ssize_t r = command_recv_alt(dev, CMD_READ_FLASH, STATUS_BYTES_LEN + size, CMD_READ_FLASH_ID,
+			&res_ptr, TIMEOUT_FLASH_DATA);
+	if (r < 0) {
+		if (r != -ETIMEDOUT) {
+			LOGD_RET(r, "DEBUG: Failed to read command %02X", CMD_READ_FLASH);
+		}
+		return r;
+	}
+
+	csk_response_t *res = (csk_response_t *)res_ptr;
+	uint8_t *status = res_ptr + sizeof(csk_response_t);
+
+	*fence = res->command == CMD_READ_FLASH_ID;
+	if (*fence) {
+		*data_len = 0;
+		return 0;
+	}
+
+	if (status[0] != 0) {
+		LOGD("DEBUG: Unexpected device response: 0x%02X", status[1]);
+		return status[1];
+	}
+
+	uint32_t len = res->size - STATUS_BYTES_LEN;
+	*data_len = len < size ? len : size;
+	memcpy(data, status + STATUS_BYTES_LEN, *data_len);
 
 	return 0;
 }
 
 int
 cmd_read_flash_stream(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
-		writer_t *writer, uint8_t *md5,
+		cmd_read_stream_t *stream, writer_t *writer, uint8_t *md5,
 		void (*on_progress)(int32_t read_bytes, uint32_t total_bytes))
 {
 	int ret;
 
-	serial_discard_input(dev->serial);
+	slip_discard_input(dev->slip);
 	serial_discard_output(dev->serial);
 
-	// Phase 1: send request
+	// Phase 1: send request, resuming from stream->offset
 	csk_command_t *req = (csk_command_t *)dev->req_hdr;
 	req->direction = DIR_REQ;
 	req->command = CMD_READ_FLASH_STREAM;
 	req->size = sizeof(cmd_read_flash_stream_t);
-	req->checksum = CHECKSUM_NONE;
+	req->checksum = CHECKSUM_NONE | command_seq_next(dev);
+	dev->seq_min = dev->req_seq;
 
 	cmd_read_flash_stream_t *payload = (cmd_read_flash_stream_t *)dev->req_cmd;
-	payload->address = address;
-	payload->size = size;
-	payload->block_size = FLASH_READ_STREAM_BLOCK;
-	payload->max_in_flight = FLASH_READ_STREAM_WINDOW;
+	payload->address = address + stream->offset;
+	payload->size = size - stream->offset;
+	payload->block_size = stream->block_size;
+	payload->max_in_flight = stream->window;
 
 	uint32_t req_len = sizeof(csk_command_t) + sizeof(cmd_read_flash_stream_t);
 
-	LOG_TRACE("> req op=%02X len=%zu", CMD_READ_FLASH_STREAM, sizeof(cmd_read_flash_stream_t));
+	LOG_TRACE("> req op=%02X len=%zu block=%u window=%u", CMD_READ_FLASH_STREAM,
+			sizeof(cmd_read_flash_stream_t), stream->block_size, stream->window);
 
+	uint64_t start = time_monotonic();
 	if ((ret = slip_write(dev->slip, dev->req_buf, req_len, TIMEOUT_DEFAULT)) < 0) {
 		LOGD_RET(ret, "DEBUG: Failed to write read_flash_stream request");
 		return ret;
@@ -691,7 +988,6 @@ cmd_read_flash_stream(cskburn_serial_device_t *dev, uint32_t address, uint32_t s
 	// Phase 1 cont'd: receive ACK frame (csk_response_t + error byte + status byte)
 	bool got_ack = false;
 	uint8_t status_code = 0;
-	uint64_t start = time_monotonic();
 	do {
 		ssize_t r = slip_read(dev->slip, dev->res_buf, MAX_RES_RAW_LEN, TIMEOUT_DEFAULT);
 		if (r == -ETIMEDOUT) {
@@ -703,7 +999,8 @@ cmd_read_flash_stream(cskburn_serial_device_t *dev, uint32_t address, uint32_t s
 			continue;
 		}
 		csk_response_t *res = (csk_response_t *)dev->res_buf;
-		if (res->direction != DIR_RES || res->command != CMD_READ_FLASH_STREAM) {
+		if (res->direction != DIR_RES || res->command != CMD_READ_FLASH_STREAM ||
+				!command_seq_match(dev, r)) {
 			continue;
 		}
 		uint8_t *status = dev->res_buf + sizeof(csk_response_t);
@@ -723,10 +1020,15 @@ cmd_read_flash_stream(cskburn_serial_device_t *dev, uint32_t address, uint32_t s
 		}
 		return -ETIMEDOUT;
 	}
-
-	// Phase 2: stream data with rolling ACK
-	uint32_t received = 0;
-	while (received < size) {
+	stream->rtt = TIME_SINCE_MS(start);
+
+	// Phase 2: stream data with coalesced cumulative ACK. 攒够半个窗口或超过
+	// FLASH_READ_STREAM_ACK_INTERVAL 才确认一次，设备仍有另外半个窗口可发，链路不会因此空闲
+	uint32_t ack_every = stream->window / 2 > 0 ? stream->window / 2 : 1;
+	uint32_t received = 0, unacked = 0;
+	uint64_t acked_at = time_monotonic();
+	stream->acks = 0;
+	while (stream->offset < size) {
 		ssize_t r = slip_read(dev->slip, dev->res_buf, MAX_RES_RAW_LEN, TIMEOUT_FLASH_DATA);
 		if (r < 0) {
 			return r;
@@ -734,24 +1036,40 @@ cmd_read_flash_stream(cskburn_serial_device_t *dev, uint32_t address, uint32_t s
 		if (r == 0) {
 			continue;
 		}
-		if (received + (uint32_t)r > size) {
-			LOGD("DEBUG: read_flash_stream overflow: have %u, want %u, got %zd", received, size, r);
+
+		// 除最后一帧外每帧都是完整的一块，长度不符说明接收溢出丢了数据
+		uint32_t want = size - stream->offset;
+		if (want > stream->block_size) {
+			want = stream->block_size;
+		}
+		if ((uint32_t)r != want) {
+			LOGD("DEBUG: read_flash_stream overrun: at %u, want %u, got %zd", stream->offset,
+					want, r);
 			return -EIO;
 		}
 
-		if (writer->write(writer, dev->res_buf, (uint32_t)r) != (uint32_t)r) {
-			return -CSKBURN_ERR_FILE_WRITE_FAILED;
-		}
+		// 帧已校验即可确认，不必等数据写出，以免写盘拖慢设备的发送窗口
 		received += (uint32_t)r;
 
 		// Cumulative ACK: 4-byte LE byte count, raw SLIP (no csk_command header)
-		uint32_t ack = received;
-		if ((ret = slip_write(dev->slip, (uint8_t *)&ack, sizeof(ack), TIMEOUT_DEFAULT)) < 0) {
-			return ret;
+		if (++unacked >= ack_every || stream->offset + (uint32_t)r == size ||
+				TIME_SINCE_MS(acked_at) >= FLASH_READ_STREAM_ACK_INTERVAL) {
+			uint32_t ack = received;
+			if ((ret = slip_write(dev->slip, (uint8_t *)&ack, sizeof(ack), TIMEOUT_DEFAULT)) < 0) {
+				return ret;
+			}
+			unacked = 0;
+			acked_at = time_monotonic();
+			stream->acks++;
 		}
 
+		if (writer->write(writer, dev->res_buf, (uint32_t)r) != (uint32_t)r) {
+			return -CSKBURN_ERR_FILE_WRITE_FAILED;
+		}
+		stream->offset += (uint32_t)r;
+
 		if (on_progress != NULL) {
-			on_progress(received, size);
+			on_progress(stream->offset, size);
 		}
 	}
 
@@ -773,6 +1091,123 @@ cmd_read_flash_stream(cskburn_serial_device_t *dev, uint32_t address, uint32_t s
 	return 0;
 }
 
+// 开始流式写入，设备边擦除边写入，应答中带有它能接受的窗口（帧数）
+int
+cmd_write_flash_stream_begin(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
+		uint32_t block_size, uint32_t *window)
+{
+	uint8_t ret_buf[STATUS_BYTES_LEN + sizeof(uint32_t)];
+	uint16_t ret_len = 0;
+
+	cmd_write_flash_stream_t *cmd = (cmd_write_flash_stream_t *)dev->req_cmd;
+	cmd->address = address;
+	cmd->size = size;
+	cmd->block_size = block_size;
+	cmd->max_in_flight = *window;
+
+	int ret = command(dev, CMD_WRITE_FLASH_STREAM, sizeof(cmd_write_flash_stream_t), CHECKSUM_NONE,
+			NULL, ret_buf, &ret_len, sizeof(ret_buf), TIMEOUT_DEFAULT);
+	if (ret != 0) {
+		return ret;
+	}
+
+	if (ret_len < STATUS_BYTES_LEN) {
+		LOGD("DEBUG: Interrupted serial read");
+		return -EIO;
+	}
+
+	if (ret_buf[0] != 0) {
+		LOGD("DEBUG: write_flash_stream rejected: 0x%02X", ret_buf[1]);
+		return ret_buf[1];
+	}
+
+	// 未声明窗口的设备按请求的窗口处理
+	if (ret_len >= STATUS_BYTES_LEN + sizeof(uint32_t)) {
+		uint32_t advertised;
+		memcpy(&advertised, ret_buf + STATUS_BYTES_LEN, sizeof(advertised));
+		if (advertised > 0 && advertised < *window) {
+			*window = advertised;
+		}
+	}
+
+	return 0;
+}
+
+// 发出一帧数据：不带命令头的原始 SLIP 帧
+int
+cmd_write_flash_stream_send(cskburn_serial_device_t *dev, const uint8_t *data, uint32_t len)
+{
+	ssize_t r = slip_write(dev->slip, data, len, TIMEOUT_DEFAULT);
+	if (r < 0) {
+		if (r != -ETIMEDOUT) {
+			LOGD_RET(r, "DEBUG: Failed to write stream data");
+		}
+		return (int)r;
+	}
+	return 0;
+}
+
+// 等待下一个累计确认：4 字节 LE 字节数，原始 SLIP 帧；设备写入出错时改为发出带状态的应答
+int
+cmd_write_flash_stream_ack(cskburn_serial_device_t *dev, uint32_t *acked)
+{
+	uint32_t timeout = dev->timeout > 0 ? (uint32_t)dev->timeout : TIMEOUT_FLASH_DATA;
+	bool wait_forever = dev->timeout == -1;
+
+	uint64_t start = time_monotonic();
+	do {
+		ssize_t r = slip_read(dev->slip, dev->res_buf, MAX_RES_RAW_LEN, timeout);
+		if (r == 0) {
+			continue;
+		} else if (r == -ETIMEDOUT) {
+			if (wait_forever) {
+				continue;
+			}
+			break;
+		} else if (r < 0) {
+			return r;
+		}
+
+		if (r == sizeof(uint32_t)) {
+			memcpy(acked, dev->res_buf, sizeof(uint32_t));
+			return 0;
+		}
+
+		if (command_match(dev, CMD_WRITE_FLASH_STREAM, STATUS_BYTES_LEN, r)) {
+			uint8_t *status = dev->res_buf + sizeof(csk_response_t);
+			LOGD("DEBUG: write_flash_stream failed: 0x%02X", status[1]);
+			return status[0] != 0 ? status[1] : -EIO;
+		}
+
+		LOG_TRACE("Dropped unmatched frame of %zd bytes while waiting for stream ack", r);
+	} while (TIME_SINCE_MS(start) < timeout || wait_forever);
+
+	return -ETIMEDOUT;
+}
+
+int
+cmd_set_framing(cskburn_serial_device_t *dev, slip_framing_t framing)
+{
+	int ret;
+
+	cmd_set_framing_t *cmd = (cmd_set_framing_t *)dev->req_cmd;
+	memset(cmd, 0, sizeof(cmd_set_framing_t));
+	cmd->framing = framing;
+	uint32_t raw_len = REQ_RAW_LEN(dev->req_payload_cap);
+	cmd->max_frame_len =
+			framing == SLIP_FRAMING_COBS ? COBS_FRAME_LEN(raw_len) : SLIP_FRAME_LEN(raw_len);
+
+	ret = check_command(
+			dev, CMD_SET_FRAMING, sizeof(cmd_set_framing_t), CHECKSUM_NONE, NULL, TIMEOUT_DEFAULT);
+	if (ret != 0) {
+		return ret;
+	}
+
+	// burner 以原帧格式发出应答后切换，之后的请求与应答均使用新的帧格式
+	slip_set_framing(dev->slip, framing);
+	return 0;
+}
+
 int
 cmd_change_baud(cskburn_serial_device_t *dev, uint32_t baud, uint32_t old_baud)
 {
@@ -789,11 +1224,15 @@ cmd_change_baud(cskburn_serial_device_t *dev, uint32_t baud, uint32_t old_baud)
 		return ret;
 	}
 
+	// 应答已收到，但请求的末尾字节可能仍在主机发送队列中，须发完后再切换
+	serial_drain(dev->serial, 100);
+
 	ret = serial_set_speed(dev->serial, baud);
 	if (ret != 0) {
 		LOGD_RET(ret, "DEBUG: Failed to set baudrate");
 		return ret;
 	}
+	dev->baud = baud;
 
 	return 0;
 }
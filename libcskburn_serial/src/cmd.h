@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "slip.h"
+
 typedef struct {
 	uint8_t direction;
 	uint8_t command;
@@ -26,23 +28,40 @@ typedef enum {
 } cmd_finish_action_t;
 
 #define RAM_BLOCK_SIZE (2 * 1024)
+#define RAM_BLOCK_SIZE_MAX (4 * 1024)
 #define FLASH_BLOCK_SIZE (4 * 1024)
+// burner 声明支持时可协商的最大 flash 块；请求头中的长度为 16 位，块不能达到 64 KB
+#define FLASH_BLOCK_SIZE_MAX (32 * 1024)
 #define FLASH_READ_SIZE (64)
 #define FLASH_READ_STREAM_BLOCK (4 * 1024)
+#define FLASH_READ_STREAM_BLOCK_MIN (1024)
 #define FLASH_READ_STREAM_WINDOW (64)
+#define FLASH_READ_STREAM_WINDOW_MIN (4)
+// 流式读取的累计确认至多攒这么久 (ms) 再发出
+#define FLASH_READ_STREAM_ACK_INTERVAL (2)
+#define FLASH_WRITE_WINDOW_MAX (32)
+#define FLASH_WRITE_STREAM_WINDOW (32)
+// FLASH_HASH_MAP 每帧的摘要数
+#define FLASH_HASH_MAP_FRAME (64)
 
 #define STATUS_BYTES_LEN 2
 
 #define MAX_REQ_COMMAND_LEN (sizeof(csk_command_t) + sizeof(uint32_t) * 4)
-#define MAX_REQ_PAYLOAD_LEN (FLASH_BLOCK_SIZE)
-#define MAX_REQ_RAW_LEN (MAX_REQ_COMMAND_LEN + MAX_REQ_PAYLOAD_LEN)
-#define MAX_REQ_SLIP_LEN (MAX_REQ_RAW_LEN * 2)
+#define MAX_REQ_PAYLOAD_LEN \
+	(FLASH_BLOCK_SIZE > RAM_BLOCK_SIZE_MAX ? FLASH_BLOCK_SIZE : RAM_BLOCK_SIZE_MAX)
+#define REQ_RAW_LEN(payload_len) (MAX_REQ_COMMAND_LEN + (payload_len))
+// 打开设备时按默认块大小分配请求缓冲区，协商出更大的块后再扩大
+#define MAX_REQ_RAW_LEN REQ_RAW_LEN(MAX_REQ_PAYLOAD_LEN)
+#define MAX_REQ_SLIP_LEN SLIP_FRAME_LEN(MAX_REQ_RAW_LEN)
 
 #define MAX_RES_COMMAND_LEN (sizeof(csk_response_t) + STATUS_BYTES_LEN)
 #define MAX_RES_PAYLOAD_LEN \
 	(FLASH_READ_STREAM_BLOCK > FLASH_READ_SIZE ? FLASH_READ_STREAM_BLOCK : FLASH_READ_SIZE)
 #define MAX_RES_RAW_LEN (MAX_RES_COMMAND_LEN + MAX_RES_PAYLOAD_LEN)
-#define MAX_RES_SLIP_LEN (MAX_RES_RAW_LEN * 2)
+#define MAX_RES_SLIP_LEN SLIP_FRAME_LEN(MAX_RES_RAW_LEN)
+
+// 接收缓冲区可容纳流式读取的整个窗口，调用方处理数据时设备发来的帧不会堆积在串口驱动中
+#define RX_RING_LEN (MAX_RES_SLIP_LEN + MAX_RES_RAW_LEN * FLASH_READ_STREAM_WINDOW)
 
 #define MD5_LEN 16
 
@@ -53,13 +72,16 @@ int cmd_sync(cskburn_serial_device_t *dev, uint16_t timeout);
 int cmd_read_reg(cskburn_serial_device_t *dev, uint32_t address, uint32_t *value);
 
 int cmd_read_flash_id(cskburn_serial_device_t *dev, uint32_t *id);
+
 int cmd_read_chip_id(cskburn_serial_device_t *dev, uint8_t *id);
 
 int cmd_nand_init(cskburn_serial_device_t *dev, nand_config_t *config, uint64_t *size);
 
 int cmd_nand_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks,
 		uint32_t block_size, uint32_t offset);
-int cmd_nand_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq);
+int cmd_nand_block_send(
+		cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq);
+int cmd_nand_block_recv(cskburn_serial_device_t *dev, uint32_t timeout);
 int cmd_nand_finish(cskburn_serial_device_t *dev);
 
 int cmd_nand_md5(cskburn_serial_device_t *dev, uint32_t address, uint32_t size, uint8_t *md5);
@@ -67,11 +89,28 @@ int cmd_nand_md5(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
 int cmd_mem_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks, uint32_t block_size,
 		uint32_t offset);
 int cmd_mem_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq);
+// 按当前波特率下的传输时间设置较短的超时，用于试探 ROM 是否接受该块大小
+int cmd_mem_block_probe(
+		cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq);
 int cmd_mem_finish(cskburn_serial_device_t *dev, cmd_finish_action_t action, uint32_t address);
 
+int cmd_mem_defl_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks,
+		uint32_t block_size, uint32_t offset);
+int cmd_mem_defl_block(
+		cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq);
+int cmd_mem_defl_finish(
+		cskburn_serial_device_t *dev, cmd_finish_action_t action, uint32_t address);
+
+// 以 cmd.c 中的超时时间初始化各类指令的 RTT 估计
+void cmd_init_rtt(cskburn_serial_device_t *dev);
+
 int cmd_flash_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t blocks,
 		uint32_t block_size, uint32_t offset);
-int cmd_flash_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq);
+int cmd_flash_block_send(
+		cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq);
+int cmd_flash_lz_block_send(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len,
+		uint32_t raw_len, uint32_t seq);
+int cmd_flash_block_recv(cskburn_serial_device_t *dev, uint32_t timeout);
 int cmd_flash_finish(cskburn_serial_device_t *dev);
 
 int cmd_flash_erase_chip(cskburn_serial_device_t *dev, uint32_t flash_size_mb);
@@ -79,13 +118,34 @@ int cmd_flash_erase_region(cskburn_serial_device_t *dev, uint32_t address, uint3
 
 int cmd_flash_md5sum(cskburn_serial_device_t *dev, uint32_t address, uint32_t size, uint8_t *md5);
 
-int cmd_read_flash(cskburn_serial_device_t *dev, uint32_t address, uint32_t size, uint8_t *data,
-		uint32_t *data_len);
+int cmd_flash_hash_map(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
+		uint32_t chunk_size, uint8_t *digests);
+
+int cmd_read_flash_send(cskburn_serial_device_t *dev, uint32_t address, uint32_t size);
+int cmd_read_flash_fence(cskburn_serial_device_t *dev);
+int cmd_read_flash_recv(cskburn_serial_device_t *dev, uint32_t size, uint8_t *data,
+		uint32_t *data_len, bool *fence);
+
+typedef struct {
+	uint32_t block_size;  // 每帧数据长度
+	uint32_t window;  // 设备可领先确认发出的帧数
+	uint32_t offset;  // 已写出的字节数，从此处开始请求并随接收推进
+	uint32_t rtt;  // 请求到应答的往返时间 (ms)
+	uint32_t acks;  // 本次发出的确认帧数
+} cmd_read_stream_t;
 
 int cmd_read_flash_stream(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
-		writer_t *writer, uint8_t *md5,
+		cmd_read_stream_t *stream, writer_t *writer, uint8_t *md5,
 		void (*on_progress)(int32_t read_bytes, uint32_t total_bytes));
 
+int cmd_write_flash_stream_begin(cskburn_serial_device_t *dev, uint32_t address, uint32_t size,
+		uint32_t block_size, uint32_t *window);
+int cmd_write_flash_stream_send(cskburn_serial_device_t *dev, const uint8_t *data, uint32_t len);
+int cmd_write_flash_stream_ack(cskburn_serial_device_t *dev, uint32_t *acked);
+
+// 请求 burner 切换帧格式，应答之后生效。请求中携带主机可能发出的最长帧，burner 据此分配接收缓冲区
+int cmd_set_framing(cskburn_serial_device_t *dev, slip_framing_t framing);
+
 int cmd_change_baud(cskburn_serial_device_t *dev, uint32_t baud, uint32_t old_baud);
 
 #endif  // __LIB_CSKBURN_SERIAL_CMD__
@@ -9,14 +9,23 @@
 #include "cmd.h"
 #include "cskburn_serial.h"
 #include "log.h"
+#include "lz.h"
 #include "msleep.h"
 #include "serial.h"
 #include "slip.h"
 #include "time_monotonic.h"
+#include "write_queue.h"
 
 #define BAUD_RATE_INIT 115200
 
 #define FLASH_BLOCK_TRIES 3
+#define FLASH_BLOCK_BUSY_TRIES 16
+#define FLASH_BLOCK_BUSY_DELAY 50
+
+#define FLASH_WRITE_WINDOW_DEFAULT 1
+#define FLASH_WRITE_STREAM_TRIES 3
+// 一个 flash 块在链路上的传输时间不超过该值 (ms)，否则块越大，丢块重发的代价越高
+#define FLASH_BLOCK_WIRE_MAX 250
 
 extern const uint8_t burner_serial_castor[];
 extern const uint32_t burner_serial_castor_len;
@@ -30,33 +39,55 @@ extern const uint32_t burner_serial_arcs_len;
 extern const uint8_t burner_serial_venusa[];
 extern const uint32_t burner_serial_venusa_len;
 
+// 构建时开启 CSKBURN_DEFLATE_BURNERS 才会同时嵌入压缩后的 burner
+#if DEFLATE_BURNERS
+extern const uint8_t burner_serial_castor_defl[];
+extern const uint32_t burner_serial_castor_defl_len;
+extern const uint8_t burner_serial_venus_defl[];
+extern const uint32_t burner_serial_venus_defl_len;
+extern const uint8_t burner_serial_arcs_defl[];
+extern const uint32_t burner_serial_arcs_defl_len;
+extern const uint8_t burner_serial_venusa_defl[];
+extern const uint32_t burner_serial_venusa_defl_len;
+
+#define BURNER_DEFL(name) .defl = name##_defl, .defl_len_ptr = &name##_defl_len,
+#else
+#define BURNER_DEFL(name)
+#endif
+
 static const struct {
 	const uint8_t *burner;
 	const uint32_t *len_ptr;
+	const uint8_t *defl;
+	const uint32_t *defl_len_ptr;
 	struct cskburn_serial_burner_info info;
 } burners[] = {
 		[CHIP_CASTOR] =
 				{
 						.burner = burner_serial_castor,
 						.len_ptr = &burner_serial_castor_len,
+						BURNER_DEFL(burner_serial_castor)
 						.info = {.load_addr = 0x0},
 				},
 		[CHIP_VENUS] =
 				{
 						.burner = burner_serial_venus,
 						.len_ptr = &burner_serial_venus_len,
+						BURNER_DEFL(burner_serial_venus)
 						.info = {.load_addr = 0x0},
 				},
 		[CHIP_ARCS] =
 				{
 						.burner = burner_serial_arcs,
 						.len_ptr = &burner_serial_arcs_len,
+						BURNER_DEFL(burner_serial_arcs)
 						.info = {.load_addr = 0x20040000},
 				},
 		[CHIP_VENUSA] =
 				{
 						.burner = burner_serial_venusa,
 						.len_ptr = &burner_serial_venusa_len,
+						BURNER_DEFL(burner_serial_venusa)
 						.info =
 								{
 										.load_addr = 0x20050000,
@@ -67,6 +98,15 @@ static const struct {
 
 #define BURNERS_COUNT (sizeof(burners) / sizeof(burners[0]))
 
+// 各芯片 ROM 接受的 RAM 块大小，首次上传 burner 时探测并在本进程内沿用，0 表示尚未探测
+static uint32_t ram_block_sizes[BURNERS_COUNT];
+
+void
+core_forget_ram_block_sizes(void)
+{
+	memset(ram_block_sizes, 0, sizeof(ram_block_sizes));
+}
+
 static void
 print_time_spent(const char *usage, uint64_t t1, uint64_t t2)
 {
@@ -185,12 +225,17 @@ cskburn_serial_open(cskburn_serial_device_t **dev, const char *path, cskburn_ser
 		goto err_serial;
 	}
 
-	slip_dev_t *slip = slip_init(serial, MAX_REQ_SLIP_LEN, MAX_RES_SLIP_LEN);
+	slip_dev_t *slip = slip_init(serial, MAX_REQ_SLIP_LEN, RX_RING_LEN);
 	if (slip == NULL) {
 		ret = -ENOMEM;
 		goto err_slip;
 	}
 
+	// 由独立线程持续读取串口；不支持时退回在调用方线程中读取
+	if ((ret = slip_start_rx_thread(slip)) != 0) {
+		LOGD_RET(ret, "DEBUG: Serial RX thread not started");
+	}
+
 	(*dev) = (cskburn_serial_device_t *)calloc(1, sizeof(cskburn_serial_device_t));
 	if (*dev == NULL) {
 		ret = -ENOMEM;
@@ -208,15 +253,25 @@ cskburn_serial_open(cskburn_serial_device_t **dev, const char *path, cskburn_ser
 
 	(*dev)->req_hdr = (*dev)->req_buf;
 	(*dev)->req_cmd = (*dev)->req_buf + sizeof(csk_command_t);
+	(*dev)->req_payload_cap = MAX_REQ_PAYLOAD_LEN;
 	(*dev)->chip = chip;
 
 	if (chip < BURNERS_COUNT) {
 		(*dev)->burner_img = burners[chip].burner;
 		(*dev)->burner_len = *burners[chip].len_ptr;
 		(*dev)->burner_info = &burners[chip].info;
+		if (burners[chip].defl != NULL && *burners[chip].defl_len_ptr < (*dev)->burner_len) {
+			(*dev)->burner_defl = burners[chip].defl;
+			(*dev)->burner_defl_len = *burners[chip].defl_len_ptr;
+		}
 	}
 
 	(*dev)->timeout = timeout;
+	(*dev)->write_window = FLASH_WRITE_WINDOW_DEFAULT;
+	(*dev)->read_stream_block = FLASH_READ_STREAM_BLOCK;
+	(*dev)->read_stream_window = FLASH_READ_STREAM_WINDOW;
+	(*dev)->flash_block_limit = FLASH_BLOCK_SIZE;
+	cmd_init_rtt(*dev);
 
 	return 0;
 
@@ -254,13 +309,46 @@ cskburn_serial_close(cskburn_serial_device_t **dev)
 	}
 }
 
+int
+cskburn_serial_set_write_window(cskburn_serial_device_t *dev, uint32_t window)
+{
+	if (window == 0 || window > FLASH_WRITE_WINDOW_MAX) {
+		return -EINVAL;
+	}
+	dev->write_window = window;
+	return 0;
+}
+
+void
+cskburn_serial_set_skip_blank(cskburn_serial_device_t *dev, bool skip)
+{
+	dev->skip_blank = skip;
+}
+
+// 单次同步等待应答的时间；等待设备就绪时以更短的间隔反复同步，设备一旦应答即可继续
+#define SYNC_PROBE_TIMEOUT 100
+#define SYNC_READY_PROBE_TIMEOUT 20
+
+// 切换帧格式未收到应答时，以每种帧格式同步的时长
+#define FRAMING_SYNC_TIMEOUT 300
+
+// burner 启动与切换波特率所需时间的上限
+#define BURNER_BOOT_DEADLINE 500
+#define BAUD_SWITCH_DEADLINE 200
+
+// 在 timeout 内反复同步，每次等待应答最多 probe 毫秒
 static int
-try_sync(cskburn_serial_device_t *dev, int timeout)
+try_sync_probe(cskburn_serial_device_t *dev, int timeout, uint16_t probe)
 {
 	int ret;
+
+	// 复位、切换波特率之后线路上可能有乱码，同步前清空一次；其余命令依靠严格匹配应答，
+	// 不再逐条清空
+	slip_discard_input(dev->slip);
+
 	uint64_t start = time_monotonic();
 	do {
-		ret = cmd_sync(dev, 100);
+		ret = cmd_sync(dev, probe);
 		if (ret == 0) {
 			return 0;
 		} else if (ret != -ETIMEDOUT) {
@@ -270,6 +358,12 @@ try_sync(cskburn_serial_device_t *dev, int timeout)
 	return -ETIMEDOUT;
 }
 
+static int
+try_sync(cskburn_serial_device_t *dev, int timeout)
+{
+	return try_sync_probe(dev, timeout, SYNC_PROBE_TIMEOUT);
+}
+
 int
 cskburn_serial_connect(cskburn_serial_device_t *dev, uint32_t reset_delay, uint32_t probe_timeout,
 		cskburn_reset_strategy_t strategy)
@@ -283,6 +377,9 @@ cskburn_serial_connect(cskburn_serial_device_t *dev, uint32_t reset_delay, uint3
 	}
 
 	serial_set_speed(dev->serial, BAUD_RATE_INIT);
+	dev->baud = BAUD_RATE_INIT;
+	slip_set_framing(dev->slip, SLIP_FRAMING_SLIP);
+	dev->seq_echo = false;
 
 	ret = try_sync(dev, probe_timeout);
 	if (ret == -ETIMEDOUT) {
@@ -291,6 +388,163 @@ cskburn_serial_connect(cskburn_serial_device_t *dev, uint32_t reset_delay, uint3
 	return ret;
 }
 
+// 以 block_size 为块大小上传 burner，loaded 返回已被接受的块数。probe 时第一个数据块
+// 只等待其传输时间，以便尽快发现 ROM 不接受该块大小
+static int
+load_burner(cskburn_serial_device_t *dev, uint8_t *burner, uint32_t len,
+		uint32_t block_size, bool probe, uint32_t *loaded)
+{
+	int ret;
+	uint32_t offset, length;
+	uint32_t blocks = BLOCKS(len, block_size);
+
+	*loaded = 0;
+
+	if ((ret = cmd_mem_begin(dev, len, blocks, block_size, dev->burner_info->load_addr)) != 0) {
+		LOGD_RET(ret, "DEBUG: mem_begin failed while loading burner");
+		return ret;
+	}
+
+	for (uint32_t i = 0; i < blocks; i++) {
+		offset = block_size * i;
+		length = block_size;
+
+		if (offset + length > len) {
+			length = len - offset;
+		}
+
+		if (probe && i == 0) {
+			ret = cmd_mem_block_probe(dev, burner + offset, length, i);
+		} else {
+			ret = cmd_mem_block(dev, burner + offset, length, i);
+		}
+		if (ret != 0) {
+			LOGD_RET(ret, "DEBUG: mem_block %u failed while loading burner", i);
+			return ret;
+		}
+		(*loaded)++;
+	}
+
+	return 0;
+}
+
+// 上传压缩后的 burner 由 ROM 解压，loaded 返回已被接受的块数
+static int
+load_burner_deflated(cskburn_serial_device_t *dev, uint32_t *loaded)
+{
+	int ret;
+	uint32_t offset, length;
+	uint32_t len = dev->burner_defl_len;
+	uint32_t blocks = BLOCKS(len, RAM_BLOCK_SIZE);
+
+	*loaded = 0;
+
+	if ((ret = cmd_mem_defl_begin(dev, dev->burner_len, blocks, RAM_BLOCK_SIZE,
+				 dev->burner_info->load_addr)) != 0) {
+		LOGD_RET(ret, "DEBUG: mem_defl_begin failed while loading burner");
+		return ret;
+	}
+
+	for (uint32_t i = 0; i < blocks; i++) {
+		offset = RAM_BLOCK_SIZE * i;
+		length = RAM_BLOCK_SIZE;
+
+		if (offset + length > len) {
+			length = len - offset;
+		}
+
+		if ((ret = cmd_mem_defl_block(dev, (uint8_t *)dev->burner_defl + offset, length, i)) !=
+				0) {
+			LOGD_RET(ret, "DEBUG: mem_defl_block %u failed while loading burner", i);
+			return ret;
+		}
+		(*loaded)++;
+	}
+
+	return 0;
+}
+
+// burner 支持时改用 COBS 帧格式，其开销固定，不随数据中 0xC0/0xDB 的比例增长
+static int
+select_framing(cskburn_serial_device_t *dev)
+{
+	if (!dev->burner_info->supports_cobs_framing) {
+		return 0;
+	}
+
+	int ret = cmd_set_framing(dev, SLIP_FRAMING_COBS);
+	if (ret == 0) {
+		LOGD("DEBUG: Switched to COBS framing");
+		return 0;
+	} else if (ret > 0) {
+		LOGD_RET(ret, "DEBUG: Burner rejected COBS framing");
+		return 0;
+	}
+
+	// 未收到应答时无法确定 burner 是否已切换，依次以两种帧格式同步
+	if (try_sync(dev, FRAMING_SYNC_TIMEOUT) == 0) {
+		return 0;
+	}
+	slip_set_framing(dev->slip, SLIP_FRAMING_COBS);
+	if (try_sync(dev, FRAMING_SYNC_TIMEOUT) == 0) {
+		LOGD("DEBUG: Switched to COBS framing");
+		return 0;
+	}
+	slip_set_framing(dev->slip, SLIP_FRAMING_SLIP);
+	return -CSKBURN_ERR_BURNER_NO_RESPONSE;
+}
+
+// 扩大请求缓冲区以容纳 payload_len 字节的载荷
+static int
+reserve_req_payload(cskburn_serial_device_t *dev, uint32_t payload_len)
+{
+	if (payload_len <= dev->req_payload_cap) {
+		return 0;
+	}
+
+	uint8_t *req_buf = (uint8_t *)realloc(dev->req_buf, REQ_RAW_LEN(payload_len));
+	if (req_buf == NULL) {
+		return -ENOMEM;
+	}
+	dev->req_buf = req_buf;
+	dev->req_hdr = req_buf;
+	dev->req_cmd = req_buf + sizeof(csk_command_t);
+
+	// COBS 帧不会长于 SLIP 帧，发送缓冲区按 SLIP 的最坏情况分配
+	int ret = slip_set_tx_len(dev->slip, SLIP_FRAME_LEN(REQ_RAW_LEN(payload_len)));
+	if (ret != 0) {
+		return ret;
+	}
+
+	dev->req_payload_cap = payload_len;
+	return 0;
+}
+
+// burner 运行后按其能力准备会话：为可协商的最大 flash 块分配缓冲区，再协商帧格式，
+// 以便切换帧格式时告知 burner 最长的请求帧
+static int
+setup_session(cskburn_serial_device_t *dev)
+{
+	dev->flash_block_limit = dev->burner_info->max_flash_block;
+	if (dev->flash_block_limit < FLASH_BLOCK_SIZE) {
+		dev->flash_block_limit = FLASH_BLOCK_SIZE;
+	} else if (dev->flash_block_limit > FLASH_BLOCK_SIZE_MAX) {
+		dev->flash_block_limit = FLASH_BLOCK_SIZE_MAX;
+	}
+
+	// ROM 不回显序号，burner 运行后才按序号匹配应答
+	dev->seq_echo = dev->burner_info->supports_seq_echo;
+
+	int ret = reserve_req_payload(dev, dev->flash_block_limit);
+	if (ret != 0) {
+		LOGD_RET(ret, "DEBUG: Failed to allocate buffers for %u byte blocks",
+				dev->flash_block_limit);
+		dev->flash_block_limit = FLASH_BLOCK_SIZE;
+	}
+
+	return select_framing(dev);
+}
+
 int
 cskburn_serial_enter(
 		cskburn_serial_device_t *dev, uint32_t baud_rate, uint8_t *burner, uint32_t len)
@@ -325,46 +579,72 @@ cskburn_serial_enter(
 			}
 		}
 
-		uint32_t offset, length;
-		uint32_t blocks = BLOCKS(len, RAM_BLOCK_SIZE);
-
-		if ((ret = cmd_mem_begin(dev, len, blocks, RAM_BLOCK_SIZE, dev->burner_info->load_addr)) !=
-				0) {
-			LOGD_RET(ret, "DEBUG: mem_begin failed while loading burner");
-			return -CSKBURN_ERR_BURNER_LOAD_FAILED;
+		// 嵌入了压缩副本时优先上传压缩数据，ROM 不支持解压时退回上传原始数据
+		uint32_t loaded = 0;
+		bool deflated = false;
+		if (burner == dev->burner_img && dev->burner_defl != NULL) {
+			ret = load_burner_deflated(dev, &loaded);
+			if (ret == 0) {
+				deflated = true;
+			} else if (loaded > 0) {
+				return -CSKBURN_ERR_BURNER_LOAD_FAILED;
+			} else {
+				LOGD("DEBUG: ROM does not accept deflated burner, loading raw image");
+			}
 		}
 
-		for (uint32_t i = 0; i < blocks; i++) {
-			offset = RAM_BLOCK_SIZE * i;
-			length = RAM_BLOCK_SIZE;
-
-			if (offset + length > len) {
-				length = len - offset;
+		// 优先使用较大的块以减少逐块等待应答的次数，ROM 不接受时退回默认块大小。
+		// 探测结果按芯片记录，之后的上传不再为试探付出超时
+		if (!deflated) {
+			uint32_t *known = &ram_block_sizes[dev->chip];
+			if (*known != RAM_BLOCK_SIZE) {
+				ret = load_burner(dev, burner, len, RAM_BLOCK_SIZE_MAX, true, &loaded);
+				if (ret == 0 || loaded > 0) {
+					*known = RAM_BLOCK_SIZE_MAX;
+				} else {
+					LOGD("DEBUG: ROM rejected RAM block size %u", RAM_BLOCK_SIZE_MAX);
+				}
 			}
-
-			if ((ret = cmd_mem_block(dev, burner + offset, length, i)) != 0) {
-				LOGD_RET(ret, "DEBUG: mem_block %u failed while loading burner", i);
-				return -CSKBURN_ERR_BURNER_LOAD_FAILED;
+			if (*known != RAM_BLOCK_SIZE_MAX || (ret != 0 && loaded == 0)) {
+				ret = load_burner(dev, burner, len, RAM_BLOCK_SIZE, false, &loaded);
+				if (ret == 0) {
+					*known = RAM_BLOCK_SIZE;
+				}
 			}
 		}
+		if (ret != 0) {
+			return -CSKBURN_ERR_BURNER_LOAD_FAILED;
+		}
 
-		if ((ret = cmd_mem_finish(dev, OPTION_REBOOT, dev->burner_info->load_addr)) != 0) {
+		if (deflated) {
+			ret = cmd_mem_defl_finish(dev, OPTION_REBOOT, dev->burner_info->load_addr);
+		} else {
+			ret = cmd_mem_finish(dev, OPTION_REBOOT, dev->burner_info->load_addr);
+		}
+		if (ret != 0) {
 			LOGD_RET(ret, "DEBUG: mem_finish failed while loading burner");
 			return -CSKBURN_ERR_BURNER_LOAD_FAILED;
 		}
 
 		// RAM proxy is up with default baud rate
 		if (load_speedup) {
+			serial_drain(dev->serial, 100);
 			serial_set_speed(dev->serial, BAUD_RATE_INIT);
+			dev->baud = BAUD_RATE_INIT;
 		}
 
-		msleep(500);
-
 		uint64_t t2 = time_monotonic();
 		print_time_spent("Writing RAM loader", t1, t2);
+		if (deflated) {
+			// 耗时基本与传输量成正比，据此估算上传原始数据所需的时间
+			LOGD("DEBUG: Sent %u deflated bytes instead of %u, about %u ms saved",
+					dev->burner_defl_len, len,
+					(uint32_t)((t2 - t1) * (len - dev->burner_defl_len) / dev->burner_defl_len));
+		}
 	}
 
-	if ((ret = try_sync(dev, 2000)) != 0) {
+	// burner 启动期间的同步请求会被忽略，以短间隔反复同步，应答即继续
+	if ((ret = try_sync_probe(dev, BURNER_BOOT_DEADLINE + 2000, SYNC_READY_PROBE_TIMEOUT)) != 0) {
 		LOGD_RET(ret, "DEBUG: Burner did not respond");
 		return -CSKBURN_ERR_BURNER_NO_RESPONSE;
 	}
@@ -377,220 +657,1204 @@ cskburn_serial_enter(
 		return -CSKBURN_ERR_BAUD_REJECTED;
 	}
 
-	msleep(200);
-
-	if ((ret = try_sync(dev, 2000)) != 0) {
+	if ((ret = try_sync_probe(dev, BAUD_SWITCH_DEADLINE + 2000, SYNC_READY_PROBE_TIMEOUT)) != 0) {
 		LOGD_RET(ret, "DEBUG: Burner sync lost after baud change");
 		return -CSKBURN_ERR_BAUD_SYNC_LOST;
 	}
 
-	return 0;
+	return setup_session(dev);
 }
 
-static int
-try_flash_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
+// 探测常驻 burner 时在每个波特率下同步的时长，设备不在 burner 中时这是额外开销，故取短
+#define ATTACH_PROBE_TIMEOUT 60
+
+// 在 baud 下查找常驻的 burner；ROM 同样应答同步，但不支持读取 flash ID
+static bool
+find_burner(cskburn_serial_device_t *dev, uint32_t baud)
 {
-	int ret;
-	for (int i = 0; i < FLASH_BLOCK_TRIES; i++) {
-		if (i > 0) {
-			LOGD("DEBUG: Attempts %d writing block %d", i, seq);
+	if (serial_set_speed(dev->serial, baud) != 0) {
+		return false;
+	}
+	dev->baud = baud;
+
+	// 上次会话可能已将 burner 切换为 COBS 帧格式；应答者尚未确认是 burner，不按序号匹配
+	slip_set_framing(dev->slip, SLIP_FRAMING_SLIP);
+	dev->seq_echo = false;
+	if (try_sync_probe(dev, ATTACH_PROBE_TIMEOUT, SYNC_READY_PROBE_TIMEOUT) != 0) {
+		if (!dev->burner_info->supports_cobs_framing) {
+			return false;
 		}
-		ret = cmd_flash_block(dev, data, data_len, seq);
-		if (ret == 0) {
-			return 0;
-		} else if (ret == -ETIMEDOUT) {
-			continue;
-		} else if (ret < 0) {  // In case of hardware error
-			return ret;
+		slip_set_framing(dev->slip, SLIP_FRAMING_COBS);
+		if (try_sync_probe(dev, ATTACH_PROBE_TIMEOUT, SYNC_READY_PROBE_TIMEOUT) != 0) {
+			slip_set_framing(dev->slip, SLIP_FRAMING_SLIP);
+			return false;
 		}
 	}
-	return ret;
-}
 
-static int
-try_nand_block(cskburn_serial_device_t *dev, uint8_t *data, uint32_t data_len, uint32_t seq)
-{
-	int ret;
-	for (int i = 0; i < FLASH_BLOCK_TRIES; i++) {
-		if (i > 0) {
-			LOGD("DEBUG: Attempts %d writing block %d", i, seq);
-		}
-		ret = cmd_nand_block(dev, data, data_len, seq);
-		if (ret == 0) {
-			return 0;
-		} else if (ret < 0) {  // In case of hardware error
-			return ret;
-		}
+	uint32_t flash_id;
+	if (cmd_read_flash_id(dev, &flash_id) != 0) {
+		LOGD("DEBUG: Device answered at %u but is not running the burner", baud);
+		return false;
 	}
-	return ret;
+	return true;
 }
 
 int
-cskburn_serial_write(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
-		reader_t *reader, uint32_t jump,
-		void (*on_progress)(int32_t wrote_bytes, uint32_t total_bytes))
+cskburn_serial_attach(cskburn_serial_device_t *dev, uint32_t baud_rate)
 {
 	int ret;
-	uint32_t offset, length;
-	uint32_t blocks = BLOCKS(reader->size, FLASH_BLOCK_SIZE);
-
-	uint64_t t1 = time_monotonic();
 
-	int err_code;
-	if (target == TARGET_FLASH) {
-		err_code = CSKBURN_ERR_FLASH_WRITE_FAILED;
-		if ((ret = cmd_flash_begin(dev, reader->size, blocks, FLASH_BLOCK_SIZE, addr)) != 0) {
-			LOGD_RET(ret, "DEBUG: flash_begin failed");
-			return ret > 0 ? ret : -err_code;
-		}
-	} else if (target == TARGET_NAND) {
-		err_code = CSKBURN_ERR_NAND_WRITE_FAILED;
-		if ((ret = cmd_nand_begin(dev, reader->size, blocks, FLASH_BLOCK_SIZE, addr)) != 0) {
-			LOGD_RET(ret, "DEBUG: nand_begin failed");
-			return ret > 0 ? ret : -err_code;
-		}
-	} else if (target == TARGET_RAM) {
-		err_code = CSKBURN_ERR_RAM_WRITE_FAILED;
-		if ((ret = cmd_mem_begin(dev, reader->size, blocks, FLASH_BLOCK_SIZE, addr)) != 0) {
-			LOGD_RET(ret, "DEBUG: mem_begin failed");
-			return ret > 0 ? ret : -err_code;
-		}
-	} else {
-		return -EINVAL;
+	if (find_burner(dev, baud_rate)) {
+		LOGD("DEBUG: Found running burner at %u", baud_rate);
+		return setup_session(dev);
 	}
 
-	uint8_t buffer[FLASH_BLOCK_SIZE];
+	if (baud_rate == BAUD_RATE_INIT || !find_burner(dev, BAUD_RATE_INIT)) {
+		serial_set_speed(dev->serial, BAUD_RATE_INIT);
+		dev->baud = BAUD_RATE_INIT;
+		return -ETIMEDOUT;
+	}
 
-	uint32_t i = 0;
-	while (i < blocks) {
-		offset = FLASH_BLOCK_SIZE * i;
-		length = FLASH_BLOCK_SIZE;
+	LOGD("DEBUG: Found running burner at %u", BAUD_RATE_INIT);
 
-		if (offset + length > reader->size) {
-			length = reader->size - offset;
-		}
+	if ((ret = cmd_change_baud(dev, baud_rate, BAUD_RATE_INIT)) != 0) {
+		LOGD_RET(ret, "DEBUG: Burner baud change failed");
+		return ret < 0 ? ret : -CSKBURN_ERR_BAUD_REJECTED;
+	}
 
-		if (reader->read(reader, buffer, length) != length) {
-			return -CSKBURN_ERR_FILE_READ_FAILED;
-		}
+	if ((ret = try_sync_probe(dev, BAUD_SWITCH_DEADLINE + 2000, SYNC_READY_PROBE_TIMEOUT)) != 0) {
+		LOGD_RET(ret, "DEBUG: Burner sync lost after baud change");
+		return -CSKBURN_ERR_BAUD_SYNC_LOST;
+	}
 
-		if (target == TARGET_FLASH) {
-			if ((ret = try_flash_block(dev, buffer, length, i)) != 0) {
-				LOGD_RET(ret, "DEBUG: flash_block %u failed", i);
-				return ret > 0 ? ret : -err_code;
-			}
-		} else if (target == TARGET_NAND) {
-			if ((ret = try_nand_block(dev, buffer, length, i)) != 0) {
-				LOGD_RET(ret, "DEBUG: nand_block %u failed", i);
-				return ret > 0 ? ret : -err_code;
-			}
-		} else if (target == TARGET_RAM) {
-			if ((ret = cmd_mem_block(dev, buffer, length, i)) != 0) {
-				LOGD_RET(ret, "DEBUG: mem_block %u failed", i);
-				return ret > 0 ? ret : -err_code;
-			}
-		}
+	return setup_session(dev);
+}
 
-		i++;
+// 探测波特率时回读的数据量，在初始波特率下约需 1 秒
+#define BAUD_PROBE_SIZE (8 * 1024)
+#define BAUD_PROBE_SYNCS 8
+// 目标不是 flash 时没有可回读的数据，改以更多次同步往返检查链路
+#define BAUD_PROBE_LOOPBACKS 64
+#define BAUD_RESTORE_TRIES 3
 
-		if (on_progress != NULL) {
-			on_progress(offset + length, reader->size);
-		}
-	}
+typedef struct {
+	uint8_t *buf;
+	uint32_t len;
+} probe_sink_t;
 
-	if (target == TARGET_FLASH) {
-		if ((ret = cmd_flash_finish(dev)) != 0) {
-			LOGD_RET(ret, "DEBUG: flash_finish failed");
-			return ret > 0 ? ret : -err_code;
-		}
-	} else if (target == TARGET_NAND) {
-		if ((ret = cmd_nand_finish(dev)) != 0) {
-			LOGD_RET(ret, "DEBUG: nand_finish failed");
-			return ret > 0 ? ret : -err_code;
-		}
-	} else if (target == TARGET_RAM) {
-		if ((ret = cmd_mem_finish(dev, jump ? OPTION_JUMP : OPTION_RUN, jump)) != 0) {
-			LOGD_RET(ret, "DEBUG: mem_finish failed");
-			return ret > 0 ? ret : -err_code;
-		}
+static uint32_t
+probe_sink_write(writer_t *writer, const uint8_t *buf, uint32_t size)
+{
+	probe_sink_t *sink = writer->ctx;
+	if (sink->len + size > BAUD_PROBE_SIZE) {
+		return 0;
 	}
-
-	uint64_t t2 = time_monotonic();
-	print_time_spent_with_speed("Writing", t1, t2, reader->size);
-
-	return 0;
+	memcpy(sink->buf + sink->len, buf, size);
+	sink->len += size;
+	return size;
 }
 
+// 以同步往返检查链路，不依赖目标存储器。返回往返收发的字节速率（字节/秒）
 static int
-cskburn_serial_read_legacy(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
-		uint32_t addr, uint32_t size, writer_t *writer, uint8_t *md5,
-		void (*on_progress)(int32_t read_bytes, uint32_t total_bytes))
+probe_loopback(cskburn_serial_device_t *dev, uint32_t *speed)
 {
 	int ret;
 
 	uint64_t t1 = time_monotonic();
-
-	uint8_t buffer[FLASH_READ_SIZE];
-	uint32_t offset = 0, read_size;
-	while (offset < size) {
-		// 最后一块可能不足 FLASH_READ_SIZE，只请求剩余字节，避免越过请求范围多读多写
-		uint32_t want = size - offset;
-		if (want > FLASH_READ_SIZE) {
-			want = FLASH_READ_SIZE;
-		}
-
-		if ((ret = cmd_read_flash(dev, addr + offset, want, buffer, &read_size)) != 0) {
-			LOGD_RET(ret, "DEBUG: read_flash at 0x%08X failed", addr + offset);
-			return ret > 0 ? ret : -CSKBURN_ERR_FLASH_READ_FAILED;
+	for (int i = 0; i < BAUD_PROBE_LOOPBACKS; i++) {
+		if ((ret = cmd_sync(dev, 100)) != 0) {
+			return ret;
 		}
+	}
+	uint64_t spent = time_monotonic() - t1;
 
-		if (read_size == 0) {
-			return -CSKBURN_ERR_FLASH_READ_FAILED;
-		}
+	// 同步请求带 36 字节载荷，应答只含状态字节
+	uint64_t bytes = (uint64_t)BAUD_PROBE_LOOPBACKS *
+					 (sizeof(csk_command_t) + 36 + sizeof(csk_response_t) + STATUS_BYTES_LEN);
+	*speed = (uint32_t)(bytes * 1000 / (spent > 0 ? spent : 1));
+	return 0;
+}
 
-		uint32_t to_write = read_size < want ? read_size : want;
-		if (writer->write(writer, buffer, to_write) != to_write) {
-			return -CSKBURN_ERR_FILE_WRITE_FAILED;
-		}
+// 在当前波特率下检查链路：连续同步若干次，再回读一段 flash，与 ref 比对（ref 为 NULL 时
+// 仅回读）；目标不是 flash 时只做同步往返。返回回读速率（字节/秒）
+static int
+probe_link(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint8_t *buf,
+		const uint8_t *ref, uint32_t *speed)
+{
+	int ret;
 
-		offset += to_write;
+	if (target != TARGET_FLASH) {
+		return probe_loopback(dev, speed);
+	}
 
-		if (on_progress != NULL) {
-			on_progress(offset, size);
+	for (int i = 0; i < BAUD_PROBE_SYNCS; i++) {
+		if ((ret = cmd_sync(dev, 100)) != 0) {
+			return ret;
 		}
 	}
 
-	uint64_t t2 = time_monotonic();
-	print_time_spent_with_speed("Reading", t1, t2, size);
-
-	if (md5 != NULL) {
-		uint64_t t1 = time_monotonic();
+	probe_sink_t sink = {.buf = buf, .len = 0};
+	writer_t writer = {.write = probe_sink_write, .ctx = &sink};
 
-		if ((ret = cmd_flash_md5sum(dev, addr, size, md5)) != 0) {
-			LOGD_RET(ret, "DEBUG: flash_md5sum 0x%08X+%u failed", addr, size);
-			return ret > 0 ? ret : -CSKBURN_ERR_VERIFY_READ_FAILED;
-		}
+	uint64_t t1 = time_monotonic();
+	if ((ret = cskburn_serial_read(dev, TARGET_FLASH, 0, BAUD_PROBE_SIZE, &writer, NULL, NULL)) !=
+			0) {
+		return ret;
+	}
+	uint64_t spent = time_monotonic() - t1;
 
-		uint64_t t2 = time_monotonic();
-		print_time_spent_with_speed("Verifying", t1, t2, size);
+	if (sink.len != BAUD_PROBE_SIZE || (ref != NULL && memcmp(buf, ref, BAUD_PROBE_SIZE) != 0)) {
+		return -CSKBURN_ERR_FLASH_READ_FAILED;
 	}
 
+	*speed = (uint32_t)((uint64_t)BAUD_PROBE_SIZE * 1000 / (spent > 0 ? spent : 1));
 	return 0;
 }
 
+// 切换到 bad 失败后回到 good。设备可能已切换到 bad，也可能仍停在 good
 static int
-cskburn_serial_read_stream(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
-		uint32_t addr, uint32_t size, writer_t *writer, uint8_t *md5,
-		void (*on_progress)(int32_t read_bytes, uint32_t total_bytes))
+restore_baud(cskburn_serial_device_t *dev, uint32_t good, uint32_t bad)
 {
-	int ret;
+	for (int i = 0; i < BAUD_RESTORE_TRIES; i++) {
+		serial_set_speed(dev->serial, good);
+		dev->baud = good;
+		if (try_sync(dev, 300) == 0) {
+			return 0;
+		}
+
+		serial_set_speed(dev->serial, bad);
+		dev->baud = bad;
+		if (try_sync(dev, 300) == 0 && cmd_change_baud(dev, good, bad) == 0 &&
+				try_sync(dev, 300) == 0) {
+			return 0;
+		}
+	}
+	return -CSKBURN_ERR_BAUD_SYNC_LOST;
+}
+
+int
+cskburn_serial_probe_baud(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
+		const uint32_t *candidates, uint32_t count, uint32_t *baud_rate, uint32_t *speed)
+{
+	int ret;
+
+	uint8_t *ref = malloc(BAUD_PROBE_SIZE);
+	uint8_t *buf = malloc(BAUD_PROBE_SIZE);
+	if (ref == NULL || buf == NULL) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	// 当前波特率下的回读结果作为后续比对的基准；基准都拿不到时无从比较任何候选
+	uint32_t good = dev->baud, good_speed = 0;
+	if ((ret = probe_link(dev, target, ref, NULL, &good_speed)) != 0) {
+		LOGD_RET(ret, "DEBUG: Link check failed at initial baud rate %u", good);
+		ret = -CSKBURN_ERR_BAUD_PROBE_FAILED;
+		goto exit;
+	}
+	LOGD("DEBUG: Baud rate %u: %u B/s", good, good_speed);
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t baud = candidates[i];
+		if (baud <= good) {
+			continue;
+		}
+
+		uint32_t baud_speed = 0;
+		if ((ret = cmd_change_baud(dev, baud, good)) == 0) {
+			if ((ret = try_sync(dev, 500)) != 0) {
+				ret = -CSKBURN_ERR_BAUD_SYNC_LOST;
+			} else {
+				ret = probe_link(dev, target, buf, ref, &baud_speed);
+			}
+		}
+
+		if (ret != 0) {
+			// 更高的波特率通常也不会稳定，到此为止
+			LOGD_RET(ret, "DEBUG: Baud rate %u is not stable", baud);
+			if ((ret = restore_baud(dev, good, baud)) != 0) {
+				LOGD("DEBUG: Failed to restore baud rate %u", good);
+			}
+			goto exit;
+		}
+
+		LOGD("DEBUG: Baud rate %u: %u B/s", baud, baud_speed);
+		good = baud;
+		good_speed = baud_speed;
+	}
+
+exit:
+	if (ret == 0) {
+		*baud_rate = dev->baud;
+		*speed = good_speed;
+	}
+	free(ref);
+	free(buf);
+	return ret;
+}
+
+// 写入出错时逐级降低的波特率
+static const uint32_t downshift_bauds[] = {2000000, 1500000, 921600, 460800, 230400, BAUD_RATE_INIT};
+
+// 降到下一级波特率后继续写入。同步会丢弃在途块的应答，调用方须重发全部在途块
+static int
+downshift_baud(cskburn_serial_device_t *dev, uint32_t errors)
+{
+	int ret;
+	uint32_t from = dev->baud, to = 0;
+
+	for (uint32_t i = 0; i < sizeof(downshift_bauds) / sizeof(downshift_bauds[0]); i++) {
+		if (downshift_bauds[i] < from) {
+			to = downshift_bauds[i];
+			break;
+		}
+	}
+	if (to == 0) {
+		return -ENOTSUP;
+	}
+
+	LOGD("DEBUG: %u errors writing at baud rate %u, switching to %u", errors, from, to);
+
+	// 出错的多是较长的数据帧，短小的同步及切换指令通常仍能通过
+	if ((ret = try_sync(dev, 500)) != 0) {
+		LOGD_RET(ret, "DEBUG: Lost sync at baud rate %u", from);
+		return -CSKBURN_ERR_BAUD_SYNC_LOST;
+	}
+
+	if (cmd_change_baud(dev, to, from) != 0 || try_sync(dev, 500) != 0) {
+		if ((ret = restore_baud(dev, to, from)) != 0) {
+			return ret;
+		}
+	}
+
+	// 波特率降低后每块的传输时间变长，之前学到的往返时间不再适用
+	rtt_init(&dev->rtt_flash_data, dev->rtt_flash_data.name, dev->rtt_flash_data.min,
+			dev->rtt_flash_data.max);
+	dev->baud_downshifts++;
+	LOGD("DEBUG: Continuing at baud rate %u", dev->baud);
+	return 0;
+}
+
+// burner 写入队列已满（erase 阻塞时出现），该块未被接收，需要稍后重发
+#define FLASH_STATUS_QUEUE_FULL 0x0A
+// burner 不认识该指令
+#define FLASH_STATUS_INVALID_COMMAND 0xC3
+
+typedef struct {
+	uint8_t *data;
+	uint32_t len;
+	uint8_t *packed;  // 压缩后的数据，压缩无益时 packed_len 为 0，按原始数据发送
+	uint32_t packed_len;
+	bool sent_packed;
+	uint64_t sent_at;
+	uint8_t sends;
+	uint8_t tries;
+	uint8_t busy;
+	bool acked;
+	bool resend;
+} write_slot_t;
+
+static int
+block_send(cskburn_serial_device_t *dev, cskburn_serial_target_t target, write_slot_t *slot,
+		uint32_t seq)
+{
+	slot->sent_packed = false;
+	if (target == TARGET_NAND) {
+		return cmd_nand_block_send(dev, slot->data, slot->len, seq);
+	} else if (slot->packed_len > 0 && !dev->flash_lz_rejected) {
+		slot->sent_packed = true;
+		return cmd_flash_lz_block_send(dev, slot->packed, slot->packed_len, slot->len, seq);
+	} else {
+		return cmd_flash_block_send(dev, slot->data, slot->len, seq);
+	}
+}
+
+// 压缩一个块；省下不到 1/16 时不值得 burner 解压，按原始数据发送
+static void
+block_pack(cskburn_serial_device_t *dev, cskburn_serial_target_t target, write_slot_t *slot)
+{
+	slot->packed_len = 0;
+	if (target != TARGET_FLASH || !dev->burner_info->supports_flash_lz_data ||
+			dev->flash_lz_rejected) {
+		return;
+	}
+
+	slot->packed_len = lz_compress(slot->data, slot->len, slot->packed, slot->len - slot->len / 16);
+	dev->lz_raw_bytes += slot->len;
+	dev->lz_wire_bytes += slot->packed_len > 0 ? slot->packed_len : slot->len;
+	if (slot->packed_len > 0) {
+		dev->lz_blocks++;
+	}
+}
+
+static int
+block_recv(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t timeout)
+{
+	if (target == TARGET_NAND) {
+		return cmd_nand_block_recv(dev, timeout);
+	} else {
+		return cmd_flash_block_recv(dev, timeout);
+	}
+}
+
+// 超时后以一次同步清空管线：burner 按顺序应答，首次发送迟到的应答都在同步应答之前到达并被丢弃，
+// 不会与重发块的应答错位
+static int
+write_barrier(cskburn_serial_device_t *dev)
+{
+	int ret;
+	if ((ret = try_sync(dev, 2000)) != 0) {
+		LOGD_RET(ret, "DEBUG: Lost sync while writing flash");
+		return -CSKBURN_ERR_FLASH_WRITE_FAILED;
+	}
+	return 0;
+}
+
+// 最近 LINK_ERROR_WINDOW 个应答期间出错达到 LINK_ERROR_LIMIT 次，或某块重试用尽时降低波特率
+#define LINK_ERROR_WINDOW 64
+#define LINK_ERROR_LIMIT 8
+
+// 降低波特率后尚未确认的块重新计算重试次数
+static void
+reset_tries(write_slot_t *slots, uint32_t window, uint32_t base, uint32_t next)
+{
+	for (uint32_t s = base; s < next; s++) {
+		slots[s % window].tries = 0;
+	}
+}
+
+// 滑动窗口写入：最多保持 write_window 个数据块在途，burner 按收到的顺序逐一应答，
+// 因此按发送顺序对应应答。出错的块单独重发；写入队列满 (0x0A) 视为背压，
+// 收缩窗口，待在途块排空后再继续发送。
+static int
+write_blocks(cskburn_serial_device_t *dev, cskburn_serial_target_t target, reader_t *reader,
+		uint32_t block_size, uint32_t blocks, uint32_t done, uint32_t total,
+		void (*on_progress)(int32_t wrote_bytes, uint32_t total_bytes))
+{
+	int ret = 0;
+
+	if (blocks == 0) {
+		return 0;
+	}
+
+	uint32_t window = dev->write_window;
+	if (window > blocks) {
+		window = blocks;
+	}
+
+	uint32_t base = 0;  // 最早一个未确认的块
+	uint32_t next = 0;  // 下一个要从 reader 读入的块
+	uint32_t cwnd = window;  // 当前允许的在途块数
+	uint32_t fifo_head = 0, in_flight = 0;
+	bool backoff = false;  // 收到写入队列满，排空在途块后稍作等待
+	uint32_t errors = 0, acks = 0;  // 最近 LINK_ERROR_WINDOW 个应答期间的出错次数
+
+	write_slot_t *slots = (write_slot_t *)calloc(window, sizeof(write_slot_t));
+	uint8_t *buffer = (uint8_t *)malloc(window * block_size * 2);
+	uint32_t *fifo = (uint32_t *)calloc(window, sizeof(uint32_t));
+	if (slots == NULL || buffer == NULL || fifo == NULL) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < window; i++) {
+		slots[i].data = buffer + block_size * i;
+		slots[i].packed = buffer + block_size * (window + i);
+	}
+
+	while (base < blocks) {
+		while (in_flight < cwnd) {
+			if (backoff) {
+				if (in_flight > 0) {
+					break;
+				}
+				msleep(FLASH_BLOCK_BUSY_DELAY);
+				backoff = false;
+			}
+
+			// 先按 seq 从小到大重发出错的块，再发送新块
+			uint32_t seq = next;
+			for (uint32_t s = base; s < next; s++) {
+				if (slots[s % window].resend) {
+					seq = s;
+					break;
+				}
+			}
+
+			write_slot_t *slot = &slots[seq % window];
+			if (seq == next) {
+				if (next >= blocks || next - base >= window) {
+					break;
+				}
+
+				uint32_t offset = block_size * next;
+				uint32_t length = block_size;
+				if (offset + length > reader->size) {
+					length = reader->size - offset;
+				}
+
+				if (reader->read(reader, slot->data, length) != length) {
+					ret = -CSKBURN_ERR_FILE_READ_FAILED;
+					goto exit;
+				}
+
+				slot->len = length;
+				block_pack(dev, target, slot);
+				slot->sends = 0;
+				slot->tries = 0;
+				slot->busy = 0;
+				slot->acked = false;
+				next++;
+			} else {
+				LOGD("DEBUG: Attempts %d writing block %d", slot->tries + slot->busy, seq);
+			}
+
+			if ((ret = block_send(dev, target, slot, seq)) != 0) {
+				goto exit;
+			}
+
+			slot->sent_at = time_monotonic();
+			if (slot->sends < UINT8_MAX) {
+				slot->sends++;
+			}
+			slot->resend = false;
+			fifo[(fifo_head + in_flight) % window] = seq;
+			in_flight++;
+		}
+
+		// 超时从最早在途块发出时算起，而非从开始等待时算起
+		uint32_t rto = rtt_timeout(&dev->rtt_flash_data);
+		uint32_t waited = TIME_SINCE_MS(slots[fifo[fifo_head] % window].sent_at);
+		ret = block_recv(dev, target, waited < rto ? rto - waited : 1);
+		if (ret == -ETIMEDOUT) {
+			// 应答丢失后已无法按顺序对应，以同步清空残余应答后重发所有在途块
+			write_slot_t *slot = &slots[fifo[fifo_head] % window];
+			LOGD("DEBUG: Timed out writing block %u with %u blocks in flight", fifo[fifo_head],
+					in_flight);
+			rtt_expired(&dev->rtt_flash_data);
+			dev->write_errors++;
+			bool exhausted = ++slot->tries >= FLASH_BLOCK_TRIES;
+			if ((exhausted || ++errors >= LINK_ERROR_LIMIT) && downshift_baud(dev, errors) == 0) {
+				reset_tries(slots, window, base, next);
+				errors = 0;
+			} else if (exhausted) {
+				goto exit;
+			} else if ((ret = write_barrier(dev)) != 0) {
+				goto exit;
+			}
+			for (uint32_t i = 0; i < in_flight; i++) {
+				slots[fifo[(fifo_head + i) % window] % window].resend = true;
+			}
+			fifo_head = 0;
+			in_flight = 0;
+			cwnd = 1;
+			continue;
+		} else if (ret < 0) {  // In case of hardware error
+			goto exit;
+		}
+
+		uint32_t seq = fifo[fifo_head];
+		write_slot_t *slot = &slots[seq % window];
+		fifo_head = (fifo_head + 1) % window;
+		in_flight--;
+
+		// 仅用只发送过一次的块采样，重发块的应答无法确定对应哪一次发送
+		if (slot->sends == 1) {
+			rtt_sample(&dev->rtt_flash_data, TIME_SINCE_MS(slot->sent_at));
+		}
+
+		if (ret == 0) {
+			slot->acked = true;
+			if (cwnd < window) {
+				cwnd++;
+			}
+			if (++acks % LINK_ERROR_WINDOW == 0) {
+				errors = 0;
+			}
+		} else if (ret == FLASH_STATUS_QUEUE_FULL) {
+			slot->resend = true;
+			if (++slot->busy >= FLASH_BLOCK_BUSY_TRIES) {
+				goto exit;
+			}
+			cwnd = cwnd > 1 ? cwnd / 2 : 1;
+			backoff = true;
+		} else if (ret == FLASH_STATUS_INVALID_COMMAND && slot->sent_packed) {
+			// burner 不支持压缩块，之后全部按原始数据发送
+			if (!dev->flash_lz_rejected) {
+				LOGD("DEBUG: Compressed flash blocks not supported, sending raw");
+				dev->flash_lz_rejected = true;
+			}
+			slot->resend = true;
+		} else {
+			slot->resend = true;
+			dev->write_errors++;
+			bool exhausted = ++slot->tries >= FLASH_BLOCK_TRIES;
+			if ((exhausted || ++errors >= LINK_ERROR_LIMIT) && downshift_baud(dev, errors) == 0) {
+				// 同步已丢弃其余在途块的应答，全部重发
+				for (uint32_t i = 0; i < in_flight; i++) {
+					slots[fifo[(fifo_head + i) % window] % window].resend = true;
+				}
+				reset_tries(slots, window, base, next);
+				fifo_head = 0;
+				in_flight = 0;
+				cwnd = 1;
+				errors = 0;
+			} else if (exhausted) {
+				goto exit;
+			}
+		}
+
+		while (base < next && slots[base % window].acked) {
+			slots[base % window].acked = false;
+			base++;
+			if (on_progress != NULL) {
+				uint32_t wrote = block_size * base;
+				on_progress(done + (wrote < reader->size ? wrote : reader->size), total);
+			}
+		}
+	}
+
+	ret = 0;
+
+exit:
+	if (ret != 0) {
+		LOGD_RET(ret, "DEBUG: Writing block %u failed", base);
+	}
+	free(fifo);
+	free(buffer);
+	free(slots);
+	return ret;
+}
+
+// 流式写入：在设备声明的窗口内连续发出数据帧，设备以累计字节数确认。窗口内未确认的数据
+// 留在环形缓冲区中，确认超时后以同步清空管线，从已确认的位置重新开始流式写入
+static int
+write_stream(cskburn_serial_device_t *dev, uint32_t addr, reader_t *reader, uint32_t done,
+		uint32_t total, void (*on_progress)(int32_t wrote_bytes, uint32_t total_bytes))
+{
+	int ret;
+	uint32_t size = reader->size;
+	uint32_t window = FLASH_WRITE_STREAM_WINDOW;
+
+	// 设备拒绝时尚未从 reader 读取数据，返回 -ENOTSUP 由调用方退回逐块写入
+	if ((ret = cmd_write_flash_stream_begin(dev, addr, size, FLASH_BLOCK_SIZE, &window)) != 0) {
+		LOGD_RET(ret, "DEBUG: write_flash_stream not accepted");
+		return ret > 0 ? -ENOTSUP : ret;
+	}
+
+	// 重新开始时设备可能声明更小的窗口，缓冲区仍按最初的槽数索引，已读入的数据不会错位
+	uint32_t slots = window;
+	uint8_t *buffer = (uint8_t *)malloc(slots * FLASH_BLOCK_SIZE);
+	if (buffer == NULL) {
+		return -ENOMEM;
+	}
+
+	uint32_t base = 0;  // 本次流式写入的起点，设备的确认相对于此
+	uint32_t acked = 0, sent = 0, loaded = 0;
+	uint32_t tries = 0;
+	while (acked < size) {
+		while (sent < size && sent - acked < window * FLASH_BLOCK_SIZE) {
+			uint32_t length = size - sent < FLASH_BLOCK_SIZE ? size - sent : FLASH_BLOCK_SIZE;
+			uint8_t *data = buffer + (sent / FLASH_BLOCK_SIZE % slots) * FLASH_BLOCK_SIZE;
+			if (sent == loaded) {
+				if (reader->read(reader, data, length) != length) {
+					ret = -CSKBURN_ERR_FILE_READ_FAILED;
+					goto exit;
+				}
+				loaded += length;
+			}
+			if ((ret = cmd_write_flash_stream_send(dev, data, length)) != 0) {
+				goto exit;
+			}
+			sent += length;
+		}
+
+		uint32_t ack;
+		ret = cmd_write_flash_stream_ack(dev, &ack);
+		if (ret == 0) {
+			if (base + ack <= acked) {
+				continue;
+			} else if (base + ack > sent) {
+				LOGD("DEBUG: write_flash_stream acked %u beyond %u", base + ack, sent);
+				ret = -EIO;
+				goto exit;
+			}
+			acked = base + ack;
+			tries = 0;
+			if (on_progress != NULL) {
+				on_progress(done + acked, total);
+			}
+			continue;
+		} else if (ret != -ETIMEDOUT || ++tries >= FLASH_WRITE_STREAM_TRIES) {
+			goto exit;
+		}
+
+		LOGD("DEBUG: Timed out writing stream at 0x%08X with %u bytes in flight", addr + acked,
+				sent - acked);
+		if ((ret = try_sync(dev, 2000)) != 0) {
+			goto exit;
+		}
+		uint32_t granted = window;
+		if ((ret = cmd_write_flash_stream_begin(
+					 dev, addr + acked, size - acked, FLASH_BLOCK_SIZE, &granted)) != 0) {
+			goto exit;
+		}
+		window = granted > 0 && granted < window ? granted : window;
+		base = acked;
+		sent = acked;
+	}
+
+	ret = 0;
+
+exit:
+	if (ret != 0) {
+		LOGD_RET(ret, "DEBUG: Writing stream at 0x%08X failed", addr + acked);
+	}
+	free(buffer);
+	return ret;
+}
+
+// 一次完整的 begin / data / finish 写入流程，进度以 done 为起点、total 为总量汇报
+// 按当前波特率选取不超过 flash_block_limit 的最大块
+static uint32_t
+flash_block_size(cskburn_serial_device_t *dev)
+{
+	uint32_t block = dev->flash_block_limit;
+	while (block > FLASH_BLOCK_SIZE && dev->baud > 0 &&
+			(uint64_t)block * 10 * 1000 / dev->baud > FLASH_BLOCK_WIRE_MAX) {
+		block /= 2;
+	}
+	return block < FLASH_BLOCK_SIZE ? FLASH_BLOCK_SIZE : block;
+}
+
+// 以协商的块大小开始写入 flash。burner 拒绝较大的块时减半重试，本次会话之后不再尝试
+static int
+flash_begin(cskburn_serial_device_t *dev, uint32_t size, uint32_t addr, uint32_t *block_size)
+{
+	int ret;
+
+	while (true) {
+		uint32_t block = flash_block_size(dev);
+		ret = cmd_flash_begin(dev, size, BLOCKS(size, block), block, addr);
+		if (ret == 0) {
+			*block_size = block;
+			return 0;
+		} else if (ret < 0 || block <= FLASH_BLOCK_SIZE) {
+			return ret;
+		}
+
+		LOGD_RET(ret, "DEBUG: Burner rejected %u byte flash blocks", block);
+		dev->flash_block_limit = block / 2;
+	}
+}
+
+static int
+write_region(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
+		reader_t *reader, uint32_t jump, uint32_t done, uint32_t total,
+		void (*on_progress)(int32_t wrote_bytes, uint32_t total_bytes))
+{
+	int ret;
+	uint32_t offset, length;
+	uint32_t block_size = FLASH_BLOCK_SIZE;
+	uint32_t blocks = BLOCKS(reader->size, FLASH_BLOCK_SIZE);
+
+	if (target == TARGET_FLASH && dev->burner_info->supports_write_flash_stream &&
+			!dev->write_stream_rejected) {
+		ret = write_stream(dev, addr, reader, done, total, on_progress);
+		if (ret == 0) {
+			return 0;
+		} else if (ret != -ENOTSUP) {
+			return ret > 0 ? ret : -CSKBURN_ERR_FLASH_WRITE_FAILED;
+		}
+		// 设备拒绝流式写入，本次及之后的写入均退回逐块写入
+		dev->write_stream_rejected = true;
+	}
+
+	int err_code;
+	if (target == TARGET_FLASH) {
+		err_code = CSKBURN_ERR_FLASH_WRITE_FAILED;
+		if ((ret = flash_begin(dev, reader->size, addr, &block_size)) != 0) {
+			LOGD_RET(ret, "DEBUG: flash_begin failed");
+			return ret > 0 ? ret : -err_code;
+		}
+		blocks = BLOCKS(reader->size, block_size);
+		dev->flash_block = block_size;
+	} else if (target == TARGET_NAND) {
+		err_code = CSKBURN_ERR_NAND_WRITE_FAILED;
+		if ((ret = cmd_nand_begin(dev, reader->size, blocks, FLASH_BLOCK_SIZE, addr)) != 0) {
+			LOGD_RET(ret, "DEBUG: nand_begin failed");
+			return ret > 0 ? ret : -err_code;
+		}
+	} else if (target == TARGET_RAM) {
+		err_code = CSKBURN_ERR_RAM_WRITE_FAILED;
+		if ((ret = cmd_mem_begin(dev, reader->size, blocks, FLASH_BLOCK_SIZE, addr)) != 0) {
+			LOGD_RET(ret, "DEBUG: mem_begin failed");
+			return ret > 0 ? ret : -err_code;
+		}
+	} else {
+		return -EINVAL;
+	}
+
+	if (target == TARGET_FLASH || target == TARGET_NAND) {
+		ret = write_blocks(dev, target, reader, block_size, blocks, done, total, on_progress);
+		if (ret != 0) {
+			return ret > 0 ? ret : -err_code;
+		}
+	} else if (target == TARGET_RAM) {
+		uint8_t buffer[FLASH_BLOCK_SIZE];
+
+		for (uint32_t i = 0; i < blocks; i++) {
+			offset = FLASH_BLOCK_SIZE * i;
+			length = FLASH_BLOCK_SIZE;
+
+			if (offset + length > reader->size) {
+				length = reader->size - offset;
+			}
+
+			if (reader->read(reader, buffer, length) != length) {
+				return -CSKBURN_ERR_FILE_READ_FAILED;
+			}
+
+			if ((ret = cmd_mem_block(dev, buffer, length, i)) != 0) {
+				LOGD_RET(ret, "DEBUG: mem_block %u failed", i);
+				return ret > 0 ? ret : -err_code;
+			}
+
+			if (on_progress != NULL) {
+				on_progress(done + offset + length, total);
+			}
+		}
+	}
+
+	if (target == TARGET_FLASH) {
+		if ((ret = cmd_flash_finish(dev)) != 0) {
+			LOGD_RET(ret, "DEBUG: flash_finish failed");
+			return ret > 0 ? ret : -err_code;
+		}
+	} else if (target == TARGET_NAND) {
+		if ((ret = cmd_nand_finish(dev)) != 0) {
+			LOGD_RET(ret, "DEBUG: nand_finish failed");
+			return ret > 0 ? ret : -err_code;
+		}
+	} else if (target == TARGET_RAM) {
+		if ((ret = cmd_mem_finish(dev, jump ? OPTION_JUMP : OPTION_RUN, jump)) != 0) {
+			LOGD_RET(ret, "DEBUG: mem_finish failed");
+			return ret > 0 ? ret : -err_code;
+		}
+	}
+
+	return 0;
+}
+
+static bool
+is_blank(const uint8_t *data, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++) {
+		if (data[i] != 0xFF) {
+			return false;
+		}
+	}
+	return true;
+}
+
+typedef struct {
+	reader_t *source;
+	uint32_t offset;  // 本段在 source 中的起点
+	uint32_t pos;
+} range_ctx_t;
+
+// 以 source 的 read_at 读取其中一段，数据已在扫描时经过 source 的 hook
+static uint32_t
+range_read(reader_t *reader, uint8_t *buf, uint32_t size)
+{
+	range_ctx_t *ctx = (range_ctx_t *)reader->ctx;
+	if (size > reader->size - ctx->pos) {
+		size = reader->size - ctx->pos;
+	}
+	uint32_t bytes = ctx->source->read_at(ctx->source, ctx->offset + ctx->pos, buf, size);
+	ctx->pos += bytes;
+	return bytes;
+}
+
+typedef struct {
+	uint32_t offset;
+	uint32_t size;
+} sparse_run_t;
+
+// 目标区域已擦除时，全 0xFF 的块无需经过串口：先扫描一遍找出非空白的连续段，只在空白块处断开，
+// 再逐段 begin 并直接从 reader 中读取该段写入。reader 不支持 read_at 时整体写入
+static int
+write_sparse(cskburn_serial_device_t *dev, uint32_t addr, reader_t *reader,
+		void (*on_progress)(int32_t wrote_bytes, uint32_t total_bytes))
+{
+	int ret = 0;
+	uint32_t size = reader->size, skipped = 0, count = 0;
+	uint8_t block[FLASH_BLOCK_SIZE];
+
+	if (reader->read_at == NULL) {
+		return write_region(dev, TARGET_FLASH, addr, reader, 0, 0, size, on_progress);
+	}
+
+	// 相邻的非空白块合并为一段，段数不超过块数的一半
+	sparse_run_t *runs =
+			(sparse_run_t *)malloc(sizeof(sparse_run_t) * (BLOCKS(size, FLASH_BLOCK_SIZE) / 2 + 1));
+	if (runs == NULL) {
+		return -ENOMEM;
+	}
+
+	for (uint32_t offset = 0; offset < size; offset += FLASH_BLOCK_SIZE) {
+		uint32_t length = size - offset < FLASH_BLOCK_SIZE ? size - offset : FLASH_BLOCK_SIZE;
+
+		// 空白块同样要经过 reader，以保证 hook 计算出的 md5 覆盖整个分区
+		if (reader->read(reader, block, length) != length) {
+			ret = -CSKBURN_ERR_FILE_READ_FAILED;
+			goto exit;
+		}
+
+		if (is_blank(block, length)) {
+			skipped += length;
+		} else if (count > 0 && runs[count - 1].offset + runs[count - 1].size == offset) {
+			runs[count - 1].size += length;
+		} else {
+			runs[count].offset = offset;
+			runs[count].size = length;
+			count++;
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (on_progress != NULL && runs[i].offset > 0) {
+			on_progress(runs[i].offset, size);
+		}
+
+		range_ctx_t ctx = {.source = reader, .offset = runs[i].offset, .pos = 0};
+		reader_t run = {.read = range_read, .size = runs[i].size, .ctx = &ctx};
+		if ((ret = write_region(dev, TARGET_FLASH, addr + runs[i].offset, &run, 0, runs[i].offset,
+					 size, on_progress)) != 0) {
+			goto exit;
+		}
+	}
+
+	if (on_progress != NULL && (count == 0 || runs[count - 1].offset + runs[count - 1].size < size)) {
+		on_progress(size, size);
+	}
+
+	LOGD("DEBUG: Skipped %u blank bytes, wrote %u runs", skipped, count);
+
+exit:
+	free(runs);
+	return ret;
+}
+
+int
+cskburn_serial_write(cskburn_serial_device_t *dev, cskburn_serial_target_t target, uint32_t addr,
+		reader_t *reader, uint32_t jump,
+		void (*on_progress)(int32_t wrote_bytes, uint32_t total_bytes))
+{
+	int ret;
+
+	uint64_t t1 = time_monotonic();
+
+	dev->lz_blocks = 0;
+	dev->lz_raw_bytes = 0;
+	dev->lz_wire_bytes = 0;
+	dev->flash_block = 0;
+	dev->write_errors = 0;
+	dev->baud_downshifts = 0;
+	uint32_t baud = dev->baud;
+
+	if (target == TARGET_FLASH && dev->skip_blank) {
+		ret = write_sparse(dev, addr, reader, on_progress);
+	} else {
+		ret = write_region(dev, target, addr, reader, jump, 0, reader->size, on_progress);
+	}
+
+	if (dev->write_errors > 0) {
+		LOGD("DEBUG: %u write errors, %u baud rate downshifts (%u -> %u)", dev->write_errors,
+				dev->baud_downshifts, baud, dev->baud);
+	}
+	if (ret != 0) {
+		return ret;
+	}
+
+	uint64_t t2 = time_monotonic();
+	print_time_spent_with_speed("Writing", t1, t2, reader->size);
+	rtt_dump(&dev->rtt_flash_data);
+
+	// 流式写入及全部为空白块时不经过 FLASH_BEGIN
+	if (dev->flash_block > 0 && t2 > t1) {
+		LOGD("DEBUG: Wrote with %u byte blocks at %.2f KB/s", dev->flash_block,
+				(float)reader->size / 1024.0f / ((float)(t2 - t1) / 1000.0f));
+	}
+
+	if (dev->lz_raw_bytes > 0) {
+		LOGD("DEBUG: Compressed %u blocks, sent %u of %u bytes (%.1f%%)", dev->lz_blocks,
+				dev->lz_wire_bytes, dev->lz_raw_bytes,
+				(float)dev->lz_wire_bytes * 100.0f / (float)dev->lz_raw_bytes);
+	}
+
+	return 0;
+}
+
+// 流水线读取：在途请求数（含屏障）上限，以及每批读取请求数，每批之后跟一个屏障
+#define FLASH_READ_WINDOW 40
+#define FLASH_READ_BATCH 16
+#define FLASH_READ_TRIES 3
+
+#define READ_CHUNK(offset, size) \
+	((size) - (offset) < FLASH_READ_SIZE ? (size) - (offset) : FLASH_READ_SIZE)
+
+// 出错后以一次同步清空管线：burner 按顺序应答，同步应答之前迟到的应答都会因不匹配而被丢弃
+static int
+read_barrier(cskburn_serial_device_t *dev)
+{
+	int ret;
+	if ((ret = try_sync(dev, 2000)) != 0) {
+		LOGD_RET(ret, "DEBUG: Lost sync while reading flash");
+		return -CSKBURN_ERR_FLASH_READ_FAILED;
+	}
+	return 0;
+}
+
+typedef struct {
+	uint32_t end;  // 本批读取的数据末尾
+	uint32_t requests;  // 本批请求数，含屏障
+} read_batch_t;
+
+static int
+cskburn_serial_read_legacy(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
+		uint32_t addr, uint32_t size, writer_t *writer, uint8_t *md5,
+		void (*on_progress)(int32_t read_bytes, uint32_t total_bytes))
+{
+	int ret;
 
 	uint64_t t1 = time_monotonic();
 
-	ret = cmd_read_flash_stream(dev, addr, size, writer, md5, on_progress);
+	// READ_FLASH 的应答不携带地址，只能按发送顺序对应。读取请求按批发出，每批之后跟一个屏障，
+	// 收到屏障的位置与预期一致才确认本批数据并写出；否则说明有应答丢失，从本批开头重新读取
+	uint8_t *batch = (uint8_t *)malloc(FLASH_READ_BATCH * FLASH_READ_SIZE);
+	read_batch_t batches[FLASH_READ_WINDOW];
+	if (batch == NULL) {
+		return -ENOMEM;
+	}
+
+	uint32_t committed = 0;  // 已确认并写出的数据
+	uint32_t received = 0;  // 最早一批中已收到的数据末尾
+	uint32_t sent = 0;  // 已发出请求的数据末尾
+	uint32_t head = 0, count = 0, in_flight = 0;
+	uint32_t window = FLASH_READ_WINDOW;
+	uint32_t cwnd = window;
+	uint32_t tries = 0;
+	uint32_t read_size;
+	bool fence, restart = false;
+
+	while (committed < size) {
+		while (sent < size && count < FLASH_READ_WINDOW) {
+			uint32_t reads = cwnd / 2 > FLASH_READ_BATCH ? FLASH_READ_BATCH : cwnd / 2;
+			if (reads == 0) {
+				reads = 1;
+			}
+			uint32_t end = sent + reads * FLASH_READ_SIZE;
+			if (end > size) {
+				end = size;
+			}
+			reads = BLOCKS(end - sent, FLASH_READ_SIZE);
+			if (in_flight > 0 && in_flight + reads + 1 > cwnd) {
+				break;
+			}
+
+			for (uint32_t offset = sent; offset < end; offset += FLASH_READ_SIZE) {
+				// 最后一块可能不足 FLASH_READ_SIZE，只请求剩余字节，避免越过请求范围多读多写
+				if ((ret = cmd_read_flash_send(dev, addr + offset, READ_CHUNK(offset, size))) !=
+						0) {
+					LOGD_RET(ret, "DEBUG: read_flash at 0x%08X failed", addr + offset);
+					ret = -CSKBURN_ERR_FLASH_READ_FAILED;
+					goto exit;
+				}
+			}
+			if ((ret = cmd_read_flash_fence(dev)) != 0) {
+				ret = -CSKBURN_ERR_FLASH_READ_FAILED;
+				goto exit;
+			}
+
+			batches[(head + count) % FLASH_READ_WINDOW] = (read_batch_t){end, reads + 1};
+			count++;
+			in_flight += reads + 1;
+			sent = end;
+		}
+
+		read_batch_t *oldest = &batches[head];
+		uint32_t want = received < oldest->end ? READ_CHUNK(received, size) : 0;
+		ret = cmd_read_flash_recv(dev, want, batch + (received - committed), &read_size, &fence);
+		if (ret > 0) {
+			LOGD_RET(ret, "DEBUG: read_flash at 0x%08X failed", addr + received);
+			goto exit;
+		} else if (ret == 0 && !fence && want > 0 && read_size > 0) {
+			bool last = received + want == oldest->end;
+			received += read_size;
+			if (read_size == want) {
+				continue;
+			} else if (last) {
+				// 本批最后一块读到的数据不足，确认本批后须从实际读到的位置重新请求
+				oldest->end = received;
+				restart = true;
+				continue;
+			}
+			ret = -EIO;
+		} else if (ret == 0 && fence && want == 0) {
+			if (writer->write(writer, batch, received - committed) != received - committed) {
+				ret = -CSKBURN_ERR_FILE_WRITE_FAILED;
+				goto exit;
+			}
+			committed = received;
+			in_flight -= oldest->requests;
+			head = (head + 1) % FLASH_READ_WINDOW;
+			count--;
+			tries = 0;
+			// 出错后窗口先快速恢复到上次出错时的一半，再逐批缓慢放大
+			if (cwnd < window) {
+				cwnd = cwnd * 2 < window ? cwnd * 2 : window;
+			} else if (window < FLASH_READ_WINDOW) {
+				cwnd = ++window;
+			}
+
+			if (on_progress != NULL) {
+				on_progress(committed, size);
+			}
+
+			if (!restart) {
+				continue;
+			}
+			restart = false;
+		} else if (ret == 0) {
+			ret = -EIO;
+		}
+
+		if (ret != 0) {
+			// 超时或应答错位，缩小窗口，丢弃未确认的数据，从最早未确认的位置重新开始
+			LOGD_RET(ret, "DEBUG: Reading 0x%08X failed with %u requests in flight",
+					addr + committed, in_flight);
+			if (++tries >= FLASH_READ_TRIES) {
+				ret = -CSKBURN_ERR_FLASH_READ_FAILED;
+				goto exit;
+			}
+			window = cwnd / 2 > 2 ? cwnd / 2 : 2;
+			cwnd = 2;
+		}
+
+		if ((ret = read_barrier(dev)) != 0) {
+			goto exit;
+		}
+		received = committed;
+		sent = committed;
+		head = 0;
+		count = 0;
+		in_flight = 0;
+	}
+
+	ret = 0;
+
+exit:
+	free(batch);
 	if (ret != 0) {
-		LOGD_RET(ret, "DEBUG: read_flash_stream at 0x%08X (%u bytes) failed", addr, size);
-		return ret > 0 ? ret : -CSKBURN_ERR_FLASH_READ_FAILED;
+		return ret;
+	}
+
+	uint64_t t2 = time_monotonic();
+	print_time_spent_with_speed("Reading", t1, t2, size);
+
+	if (md5 != NULL) {
+		uint64_t t1 = time_monotonic();
+
+		if ((ret = cmd_flash_md5sum(dev, addr, size, md5)) != 0) {
+			LOGD_RET(ret, "DEBUG: flash_md5sum 0x%08X+%u failed", addr, size);
+			return ret > 0 ? ret : -CSKBURN_ERR_VERIFY_READ_FAILED;
+		}
+
+		uint64_t t2 = time_monotonic();
+		print_time_spent_with_speed("Verifying", t1, t2, size);
+	}
+
+	return 0;
+}
+
+#define FLASH_READ_STREAM_TRIES 3
+
+// 读取时交给写线程的队列深度，以 MAX_RES_PAYLOAD_LEN 为一格，可缓冲 1 MB
+#define READ_QUEUE_SLOTS 256
+
+// 覆盖链路往返与确认间隔所需的最少窗口：确认每半个窗口发出一次，故取带宽时延积的两倍
+static uint32_t
+read_stream_min_window(cskburn_serial_device_t *dev, uint32_t block_size, uint32_t rtt)
+{
+	uint32_t window = FLASH_READ_STREAM_WINDOW_MIN;
+	if (dev->baud != 0) {
+		uint64_t bdp = (uint64_t)dev->baud / 10 * (rtt + FLASH_READ_STREAM_ACK_INTERVAL) / 1000;
+		uint32_t need = (uint32_t)BLOCKS(bdp, block_size) * 2;
+		if (need > window) {
+			window = need;
+		}
+	}
+	return window < FLASH_READ_STREAM_WINDOW ? window : FLASH_READ_STREAM_WINDOW;
+}
+
+static int
+cskburn_serial_read_stream(cskburn_serial_device_t *dev, cskburn_serial_target_t target,
+		uint32_t addr, uint32_t size, writer_t *writer, uint8_t *md5,
+		void (*on_progress)(int32_t read_bytes, uint32_t total_bytes))
+{
+	int ret;
+
+	uint64_t t1 = time_monotonic();
+
+	// 块大小与窗口沿用上次协商和调整的结果
+	cmd_read_stream_t stream = {
+			.block_size = dev->read_stream_block,
+			.window = dev->read_stream_window,
+	};
+	uint32_t tries = 0;
+	while (true) {
+		ret = cmd_read_flash_stream(dev, addr, size, &stream, writer, md5, on_progress);
+		if (ret == 0) {
+			break;
+		}
+
+		if (ret > 0 && stream.block_size > FLASH_READ_STREAM_BLOCK_MIN) {
+			// 设备拒绝了请求的参数，依次退回更小的块和窗口
+			stream.block_size /= 2;
+		} else if (ret > 0 && stream.window > FLASH_READ_STREAM_WINDOW_MIN) {
+			stream.window /= 2;
+		} else if ((ret == -EIO || ret == -ETIMEDOUT) && ++tries < FLASH_READ_STREAM_TRIES) {
+			// 接收溢出或超时：缩小窗口，但不低于链路往返所需，从已写出的位置续读
+			uint32_t floor = read_stream_min_window(dev, stream.block_size, stream.rtt);
+			stream.window = stream.window / 2 > floor ? stream.window / 2 : floor;
+			if ((ret = read_barrier(dev)) != 0) {
+				return ret;
+			}
+		} else {
+			LOGD_RET(ret, "DEBUG: read_flash_stream at 0x%08X (%u bytes) failed", addr, size);
+			return ret > 0 ? ret : -CSKBURN_ERR_FLASH_READ_FAILED;
+		}
+		LOGD("DEBUG: Retrying read_flash_stream from 0x%08X with %u x %u bytes window",
+				addr + stream.offset, stream.window, stream.block_size);
+	}
+
+	LOGD("DEBUG: read_flash_stream used %u x %u bytes window, rtt %u ms, %u acks",
+			stream.window, stream.block_size, stream.rtt, stream.acks);
+
+	// 成功后窗口逐步放大回上限，以便链路好转时恢复吞吐
+	dev->read_stream_block = stream.block_size;
+	dev->read_stream_window = stream.window * 2;
+	if (dev->read_stream_window > FLASH_READ_STREAM_WINDOW) {
+		dev->read_stream_window = FLASH_READ_STREAM_WINDOW;
+	}
+
+	// 续读时设备只计算了最后一段的 MD5，整段须另行计算
+	if (tries > 0 && md5 != NULL) {
+		if ((ret = cmd_flash_md5sum(dev, addr, size, md5)) != 0) {
+			LOGD_RET(ret, "DEBUG: flash_md5sum 0x%08X+%u failed", addr, size);
+			return ret > 0 ? ret : -CSKBURN_ERR_FLASH_READ_FAILED;
+		}
 	}
 
 	uint64_t t2 = time_monotonic();
@@ -604,11 +1868,31 @@ cskburn_serial_read(cskburn_serial_device_t *dev, cskburn_serial_target_t target
 		uint32_t size, writer_t *writer, uint8_t *md5,
 		void (*on_progress)(int32_t read_bytes, uint32_t total_bytes))
 {
+	int ret;
+
+	// 写盘及 writer 上挂的 MD5 等处理交给独立线程，与串口收发重叠；不支持时直接写出
+	write_queue_t *queue = NULL;
+	writer_t *out = writer;
+	if ((ret = write_queue_start(&queue, writer, READ_QUEUE_SLOTS, MAX_RES_PAYLOAD_LEN)) == 0) {
+		out = write_queue_writer(queue);
+	} else if (ret != -ENOTSUP) {
+		return ret;
+	}
+
 	if (dev->burner_info->supports_read_flash_stream) {
-		return cskburn_serial_read_stream(dev, target, addr, size, writer, md5, on_progress);
+		ret = cskburn_serial_read_stream(dev, target, addr, size, out, md5, on_progress);
 	} else {
-		return cskburn_serial_read_legacy(dev, target, addr, size, writer, md5, on_progress);
+		ret = cskburn_serial_read_legacy(dev, target, addr, size, out, md5, on_progress);
 	}
+
+	if (queue != NULL) {
+		int finish = write_queue_finish(&queue);
+		if (ret == 0) {
+			ret = finish;
+		}
+	}
+
+	return ret;
 }
 
 int
@@ -700,6 +1984,53 @@ cskburn_serial_verify(cskburn_serial_device_t *dev, cskburn_serial_target_t targ
 	return -EINVAL;
 }
 
+// 逐块计算的 MD5 每 MB 所需时间的上限，与 TIMEOUT_FLASH_MD5SUM_PER_MB 一致
+#define HASH_MAP_SYNC_PER_MB 1000
+
+int
+cskburn_serial_hash_map(cskburn_serial_device_t *dev, uint32_t addr, uint32_t size,
+		uint32_t chunk_size, uint8_t *digests)
+{
+	int ret;
+
+	if (chunk_size == 0 || size == 0) {
+		return -EINVAL;
+	}
+
+	uint64_t t1 = time_monotonic();
+	uint32_t chunks = (uint32_t)(((uint64_t)size + chunk_size - 1) / chunk_size);
+
+	if (dev->burner_info->supports_flash_hash_map && !dev->hash_map_rejected) {
+		ret = cmd_flash_hash_map(dev, addr, size, chunk_size, digests);
+		if (ret == 0) {
+			goto done;
+		} else if (ret > 0) {
+			LOGD_RET(ret, "DEBUG: Burner rejected flash_hash_map, hashing chunk by chunk");
+			dev->hash_map_rejected = true;
+		} else {
+			// 余下的摘要帧仍在路上，burner 算完之后才会应答同步
+			LOGD_RET(ret, "DEBUG: flash_hash_map 0x%08X+%u failed, hashing chunk by chunk", addr,
+					size);
+			if (try_sync(dev, 2000 + size / (1024 * 1024) * HASH_MAP_SYNC_PER_MB) != 0) {
+				return -CSKBURN_ERR_VERIFY_READ_FAILED;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < chunks; i++) {
+		uint32_t offset = chunk_size * i;
+		uint32_t length = size - offset < chunk_size ? size - offset : chunk_size;
+		if ((ret = cmd_flash_md5sum(dev, addr + offset, length, digests + MD5_LEN * i)) != 0) {
+			LOGD_RET(ret, "DEBUG: flash_md5sum 0x%08X+%u failed", addr + offset, length);
+			return ret > 0 ? ret : -CSKBURN_ERR_VERIFY_READ_FAILED;
+		}
+	}
+
+done:
+	print_time_spent_with_speed("Hashing", t1, time_monotonic(), size);
+	return 0;
+}
+
 int
 cskburn_serial_read_chip_id(cskburn_serial_device_t *dev, uint8_t *chip_id)
 {
@@ -759,6 +2090,9 @@ cskburn_serial_read_logs(cskburn_serial_device_t *dev, uint32_t baud)
 	uint8_t buffer[1024];
 	int32_t r;
 
+	// 日志直接从串口读取，不再经过 SLIP，接收线程不能同时读取
+	slip_stop_rx_thread(dev->slip);
+
 	serial_discard_output(dev->serial);
 	serial_set_speed(dev->serial, baud);
 
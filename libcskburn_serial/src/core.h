@@ -3,12 +3,20 @@
 
 #include <cskburn_serial.h>
 
+#include "rtt.h"
 #include "serial.h"
 #include "slip.h"
 
 struct cskburn_serial_burner_info {
 	uint32_t load_addr;
+	uint32_t max_flash_block;  // 支持的最大 flash 块，0 表示仅支持 FLASH_BLOCK_SIZE
 	bool supports_read_flash_stream;
+	bool supports_write_flash_stream;
+	bool supports_flash_lz_data;
+	bool supports_cobs_framing;
+	bool supports_flash_hash_map;
+	// 请求头校验字的高 24 位为序号，burner 校验时只取低 8 位，并在每个应答的载荷之后回显该序号
+	bool supports_seq_echo;
 };
 
 struct _cskburn_serial_device_t {
@@ -17,12 +25,37 @@ struct _cskburn_serial_device_t {
 	void *req_hdr;
 	void *req_cmd;
 	uint8_t *req_buf;
+	uint32_t req_payload_cap;
 	uint8_t *res_buf;
 	cskburn_serial_chip_t chip;
 	const uint8_t *burner_img;
 	uint32_t burner_len;
+	const uint8_t *burner_defl;
+	uint32_t burner_defl_len;
 	const struct cskburn_serial_burner_info *burner_info;
 	int32_t timeout;
+	uint32_t write_window;
+	uint32_t read_stream_block;
+	uint32_t read_stream_window;
+	uint32_t flash_block_limit;  // 本次会话可用的最大 flash 块
+	uint32_t flash_block;  // 最近一次写入 flash 使用的块大小
+	bool skip_blank;
+	bool write_stream_rejected;
+	bool flash_lz_rejected;
+	bool hash_map_rejected;
+	uint32_t lz_blocks;
+	uint32_t lz_raw_bytes;
+	uint32_t lz_wire_bytes;
+	uint32_t write_errors;  // 本次写入中出错或超时的数据块次数
+	uint32_t baud_downshifts;
+	uint32_t req_seq;
+	bool seq_echo;  // 已确认 burner 回显序号，应答按序号匹配
+	uint32_t seq_min;  // 最近一条同步命令的序号，更早请求的应答一律视作过期
+	uint32_t baud;
+	rtt_estimator_t rtt_flash_data;
 };
 
+// 忘记各芯片已探测出的 RAM 块大小，下次上传 burner 时重新探测
+void core_forget_ram_block_sizes(void);
+
 #endif  // __LIB_CSKBURN_SERIAL_CORE__
@@ -0,0 +1,123 @@
+#include "lz.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define MIN_MATCH 4
+#define HASH_BITS 12
+// LZ4 块格式要求最后 5 字节为字面量，最后一个匹配须在块末 12 字节之前开始
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+
+static uint32_t
+read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t
+hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// token 中的 4 位已写满 15，余下的长度以若干 255 加一个余数字节表示
+static uint8_t *
+put_length(uint8_t *op, uint32_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+// 写出一个序列所需的最大字节数：token、字面量长度扩展、字面量、偏移及匹配长度扩展
+static bool
+fits(const uint8_t *op, const uint8_t *oend, uint32_t literals, uint32_t match)
+{
+	uint32_t need = 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+	return (uint32_t)(oend - op) >= need;
+}
+
+uint32_t
+lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+	if (len > LZ_MAX_INPUT) {
+		return 0;
+	}
+
+	uint16_t table[1 << HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *end = src + len;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + cap;
+
+	if (len > MF_LIMIT) {
+		const uint8_t *mflimit = end - MF_LIMIT;
+		const uint8_t *matchlimit = end - LAST_LITERALS;
+
+		while (ip < mflimit) {
+			uint32_t h = hash(read32(ip));
+			const uint8_t *ref = src + table[h];
+			table[h] = (uint16_t)(ip - src);
+			if (ref >= ip || read32(ref) != read32(ip)) {
+				ip++;
+				continue;
+			}
+
+			const uint8_t *mp = ip + MIN_MATCH;
+			const uint8_t *rp = ref + MIN_MATCH;
+			while (mp < matchlimit && *mp == *rp) {
+				mp++;
+				rp++;
+			}
+
+			uint32_t literals = (uint32_t)(ip - anchor);
+			uint32_t match = (uint32_t)(mp - ip) - MIN_MATCH;
+			if (!fits(op, oend, literals, match)) {
+				return 0;
+			}
+
+			uint8_t *token = op++;
+			*token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+			if (literals >= 15) {
+				op = put_length(op, literals - 15);
+			}
+			memcpy(op, anchor, literals);
+			op += literals;
+
+			uint16_t offset = (uint16_t)(ip - ref);
+			*op++ = (uint8_t)(offset & 0xFF);
+			*op++ = (uint8_t)(offset >> 8);
+
+			*token |= (uint8_t)(match >= 15 ? 15 : match);
+			if (match >= 15) {
+				op = put_length(op, match - 15);
+			}
+
+			ip = mp;
+			anchor = ip;
+		}
+	}
+
+	// 末尾的字面量单独成为最后一个序列，不带匹配
+	uint32_t literals = (uint32_t)(end - anchor);
+	if (!fits(op, oend, literals, 0)) {
+		return 0;
+	}
+	*op++ = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+	if (literals >= 15) {
+		op = put_length(op, literals - 15);
+	}
+	memcpy(op, anchor, literals);
+	op += literals;
+
+	return (uint32_t)(op - dst);
+}
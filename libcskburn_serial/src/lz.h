@@ -0,0 +1,17 @@
+#ifndef __LIB_CSKBURN_SERIAL_LZ__
+#define __LIB_CSKBURN_SERIAL_LZ__
+
+#include <stdint.h>
+
+// 压缩输入的长度上限，匹配距离以 16 位表示
+#define LZ_MAX_INPUT 0xFFFF
+
+/**
+ * @brief Compress a block into the LZ4 block format with a single greedy pass
+ *
+ * @return Compressed length, or 0 if the input is too long or the output would
+ * not fit in `cap` bytes, in which case the block should be sent raw
+ */
+uint32_t lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap);
+
+#endif  // __LIB_CSKBURN_SERIAL_LZ__
@@ -0,0 +1,77 @@
+#include "rtt.h"
+
+#include "log.h"
+
+// 时钟粒度 (ms)
+#define RTT_GRANULARITY 1
+#define RTT_BACKOFF_MAX 6
+
+void
+rtt_init(rtt_estimator_t *rtt, const char *name, uint32_t min, uint32_t max)
+{
+	rtt->name = name;
+	rtt->min = min;
+	rtt->max = max;
+	rtt->srtt8 = 0;
+	rtt->rttvar4 = 0;
+	rtt->samples = 0;
+	rtt->backoff = 0;
+}
+
+void
+rtt_sample(rtt_estimator_t *rtt, uint32_t ms)
+{
+	if (rtt->samples == 0) {
+		rtt->srtt8 = ms << 3;
+		rtt->rttvar4 = ms << 1;
+	} else {
+		// SRTT = 7/8 SRTT + 1/8 R，RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+		int32_t err = (int32_t)ms - (int32_t)(rtt->srtt8 >> 3);
+		rtt->srtt8 += err;
+		if (err < 0) {
+			err = -err;
+		}
+		rtt->rttvar4 = rtt->rttvar4 - (rtt->rttvar4 >> 2) + (uint32_t)err;
+	}
+
+	rtt->samples++;
+	rtt->backoff = 0;
+}
+
+void
+rtt_expired(rtt_estimator_t *rtt)
+{
+	if (rtt->backoff < RTT_BACKOFF_MAX) {
+		rtt->backoff++;
+	}
+}
+
+uint32_t
+rtt_timeout(const rtt_estimator_t *rtt)
+{
+	if (rtt->samples == 0) {
+		return rtt->max;
+	}
+
+	// RTO = SRTT + max(G, 4 * RTTVAR)
+	uint32_t var = rtt->rttvar4 > RTT_GRANULARITY ? rtt->rttvar4 : RTT_GRANULARITY;
+	uint64_t timeout = (uint64_t)((rtt->srtt8 >> 3) + var) << rtt->backoff;
+
+	if (timeout < rtt->min) {
+		return rtt->min;
+	} else if (timeout > rtt->max) {
+		return rtt->max;
+	}
+	return (uint32_t)timeout;
+}
+
+void
+rtt_dump(const rtt_estimator_t *rtt)
+{
+	if (rtt->samples == 0) {
+		return;
+	}
+
+	LOGD("DEBUG: %s RTT: srtt %.1f ms, rttvar %.1f ms, timeout %u ms (%u samples)", rtt->name,
+			rtt->srtt8 / 8.0f, rtt->rttvar4 / 4.0f, rtt_timeout(rtt), rtt->samples);
+}
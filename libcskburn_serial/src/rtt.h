@@ -0,0 +1,36 @@
+#ifndef __LIB_CSKBURN_SERIAL_RTT__
+#define __LIB_CSKBURN_SERIAL_RTT__
+
+#include <stdint.h>
+
+// 按 RFC 6298 估计某类指令的往返时间，由此得出重试前的等待时间
+typedef struct {
+	const char *name;
+	uint32_t min;  // 超时时间下限 (ms)
+	uint32_t max;  // 超时时间上限 (ms)，即原先固定的超时时间
+	uint32_t srtt8;  // 平滑 RTT，单位 1/8 ms
+	uint32_t rttvar4;  // RTT 偏差，单位 1/4 ms
+	uint32_t samples;
+	uint8_t backoff;  // 连续超时次数，每次超时后等待时间加倍
+} rtt_estimator_t;
+
+void rtt_init(rtt_estimator_t *rtt, const char *name, uint32_t min, uint32_t max);
+
+/**
+ * @brief Feed the round trip time of a request that was answered on its first transmission
+ */
+void rtt_sample(rtt_estimator_t *rtt, uint32_t ms);
+
+/**
+ * @brief Record a timeout, the next timeouts are doubled until a new sample arrives
+ */
+void rtt_expired(rtt_estimator_t *rtt);
+
+/**
+ * @brief Get the current retry timeout, max if nothing has been learned yet
+ */
+uint32_t rtt_timeout(const rtt_estimator_t *rtt);
+
+void rtt_dump(const rtt_estimator_t *rtt);
+
+#endif  // __LIB_CSKBURN_SERIAL_RTT__
@@ -0,0 +1,202 @@
+#include "write_queue.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#define WRITE_QUEUE_THREAD 1
+#include <pthread.h>
+#endif
+
+#include "cskburn_errors.h"
+
+#if WRITE_QUEUE_THREAD
+typedef struct {
+	uint32_t len;
+	uint8_t *data;
+} queue_slot_t;
+
+struct _write_queue_t {
+	// 必须位于首位，write() 由此取回队列
+	writer_t writer;
+	writer_t *downstream;
+
+	// 槽位按 head、tail 单调递增，取模 slots_count 后得到实际下标
+	queue_slot_t *slots;
+	uint32_t slots_count;
+	uint32_t slot_size;
+	uint32_t head;  // 下一个待写出的槽位，由写线程推进
+	uint32_t tail;  // 下一个空闲槽位，由调用方推进
+	bool closing;
+	bool failed;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void *
+write_thread_main(void *arg)
+{
+	write_queue_t *queue = (write_queue_t *)arg;
+
+	pthread_mutex_lock(&queue->lock);
+	while (true) {
+		while (queue->head == queue->tail && !queue->closing) {
+			pthread_cond_wait(&queue->cond, &queue->lock);
+		}
+		if (queue->head == queue->tail) {
+			break;
+		}
+
+		// 写出期间不持锁，调用方可继续填充其余槽位
+		queue_slot_t *slot = &queue->slots[queue->head % queue->slots_count];
+		bool failed = queue->failed;
+		pthread_mutex_unlock(&queue->lock);
+
+		if (!failed) {
+			failed = queue->downstream->write(queue->downstream, slot->data, slot->len) != slot->len;
+		}
+
+		pthread_mutex_lock(&queue->lock);
+		queue->failed = failed;
+		queue->head++;
+		pthread_cond_broadcast(&queue->cond);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+static uint32_t
+write_queue_write(writer_t *writer, const uint8_t *buf, uint32_t size)
+{
+	write_queue_t *queue = (write_queue_t *)writer;
+	uint32_t written = 0;
+
+	pthread_mutex_lock(&queue->lock);
+	while (written < size && !queue->failed) {
+		if (queue->tail - queue->head == queue->slots_count) {
+			pthread_cond_wait(&queue->cond, &queue->lock);
+			continue;
+		}
+
+		queue_slot_t *slot = &queue->slots[queue->tail % queue->slots_count];
+		slot->len = size - written < queue->slot_size ? size - written : queue->slot_size;
+		memcpy(slot->data, buf + written, slot->len);
+		written += slot->len;
+		queue->tail++;
+		pthread_cond_broadcast(&queue->cond);
+	}
+	bool failed = queue->failed;
+	pthread_mutex_unlock(&queue->lock);
+
+	return failed ? 0 : size;
+}
+
+static void
+free_queue(write_queue_t *queue)
+{
+	if (queue->slots != NULL) {
+		for (uint32_t i = 0; i < queue->slots_count; i++) {
+			free(queue->slots[i].data);
+		}
+		free(queue->slots);
+	}
+	free(queue);
+}
+#endif
+
+int
+write_queue_start(
+		write_queue_t **queue, writer_t *downstream, uint32_t slots, uint32_t slot_size)
+{
+#if WRITE_QUEUE_THREAD
+	write_queue_t *q = (write_queue_t *)calloc(1, sizeof(write_queue_t));
+	if (q == NULL) {
+		return -ENOMEM;
+	}
+
+	q->writer.write = write_queue_write;
+	q->downstream = downstream;
+	q->slots_count = slots;
+	q->slot_size = slot_size;
+	q->slots = (queue_slot_t *)calloc(slots, sizeof(queue_slot_t));
+	if (q->slots == NULL) {
+		free_queue(q);
+		return -ENOMEM;
+	}
+	for (uint32_t i = 0; i < slots; i++) {
+		if ((q->slots[i].data = (uint8_t *)malloc(slot_size)) == NULL) {
+			free_queue(q);
+			return -ENOMEM;
+		}
+	}
+
+	if (pthread_mutex_init(&q->lock, NULL) != 0) {
+		free_queue(q);
+		return -ENOMEM;
+	}
+	if (pthread_cond_init(&q->cond, NULL) != 0) {
+		pthread_mutex_destroy(&q->lock);
+		free_queue(q);
+		return -ENOMEM;
+	}
+
+	int ret = pthread_create(&q->thread, NULL, write_thread_main, q);
+	if (ret != 0) {
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->lock);
+		free_queue(q);
+		return -ret;
+	}
+
+	*queue = q;
+	return 0;
+#else
+	(void)queue;
+	(void)downstream;
+	(void)slots;
+	(void)slot_size;
+	return -ENOTSUP;
+#endif
+}
+
+writer_t *
+write_queue_writer(write_queue_t *queue)
+{
+#if WRITE_QUEUE_THREAD
+	return &queue->writer;
+#else
+	(void)queue;
+	return NULL;
+#endif
+}
+
+int
+write_queue_finish(write_queue_t **queue)
+{
+#if WRITE_QUEUE_THREAD
+	write_queue_t *q = *queue;
+
+	pthread_mutex_lock(&q->lock);
+	q->closing = true;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+
+	pthread_join(q->thread, NULL);
+
+	bool failed = q->failed;
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->lock);
+	free_queue(q);
+	*queue = NULL;
+
+	return failed ? -CSKBURN_ERR_FILE_WRITE_FAILED : 0;
+#else
+	(void)queue;
+	return -ENOTSUP;
+#endif
+}
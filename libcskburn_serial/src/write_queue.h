@@ -0,0 +1,34 @@
+#ifndef __LIB_CSKBURN_SERIAL_WRITE_QUEUE__
+#define __LIB_CSKBURN_SERIAL_WRITE_QUEUE__
+
+#include <stdint.h>
+
+#include "io.h"
+
+// 由独立线程把数据交给下游 writer（及其 hook，如 MD5），调用方只需拷贝进有界队列
+typedef struct _write_queue_t write_queue_t;
+
+/**
+ * @brief Start a consumer thread writing to the given writer through a queue of
+ * `slots` buffers, each holding up to `slot_size` bytes
+ *
+ * @return 0 on success, -ENOTSUP if threads are not available on this platform,
+ * in which case the caller should write to the downstream writer directly
+ */
+int write_queue_start(write_queue_t **queue, writer_t *downstream, uint32_t slots,
+		uint32_t slot_size);
+
+/**
+ * @brief Get the writer that enqueues into the queue. Its write() blocks only when
+ * the queue is full, and returns 0 once a downstream write has failed
+ */
+writer_t *write_queue_writer(write_queue_t *queue);
+
+/**
+ * @brief Wait for all queued data to be written, stop the thread and free the queue
+ *
+ * @return 0 if everything was written, -CSKBURN_ERR_FILE_WRITE_FAILED otherwise
+ */
+int write_queue_finish(write_queue_t **queue);
+
+#endif  // __LIB_CSKBURN_SERIAL_WRITE_QUEUE__
@@ -1,10 +1,18 @@
 find_package(Python3 REQUIRED)
 
+option(CSKBURN_DEFLATE_BURNERS "Also embed deflated burners for ROMs that can inflate them" OFF)
+
 function(target_embed_binary TARGET VAR_NAME FILE)
     set(gen_c ${CMAKE_CURRENT_BINARY_DIR}/${VAR_NAME}_img.c)
 
     target_sources(${TARGET} PRIVATE ${gen_c})
 
+    set(extra_args)
+    if(CSKBURN_DEFLATE_BURNERS)
+        set(extra_args --deflate)
+        target_compile_definitions(${TARGET} PRIVATE DEFLATE_BURNERS=1)
+    endif()
+
     add_custom_command(
         OUTPUT  ${gen_c}
         COMMAND Python3::Interpreter
@@ -12,7 +20,8 @@ function(target_embed_binary TARGET VAR_NAME FILE)
                 ${FILE}
                 ${gen_c}
                 ${VAR_NAME}
-        DEPENDS ${FILE}
+                ${extra_args}
+        DEPENDS ${FILE} ${CMAKE_SOURCE_DIR}/bin2c.py
         COMMENT "Embedding binary file ${FILE} as ${VAR_NAME}"
     )
 endfunction()
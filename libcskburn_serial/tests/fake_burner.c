@@ -0,0 +1,1188 @@
+#define _GNU_SOURCE
+
+#include "fake_burner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mbedtls/md5.h"
+
+#if FAKE_BURNER_INFLATE
+#include <zlib.h>
+#endif
+
+#define END 0300
+#define ESC 0333
+#define ESC_END 0334
+#define ESC_ESC 0335
+
+#define DIR_RES 0x01
+
+#define CMD_FLASH_BEGIN 0x02
+#define CMD_FLASH_DATA 0x03
+#define CMD_FLASH_END 0x04
+#define CMD_MEM_BEGIN 0x05
+#define CMD_MEM_END 0x06
+#define CMD_MEM_DATA 0x07
+#define CMD_SYNC 0x08
+#define CMD_READ_FLASH 0x0e
+#define CMD_CHANGE_BAUDRATE 0x0f
+#define CMD_SPI_FLASH_MD5 0x13
+#define CMD_MEM_DEFL_BEGIN 0x15
+#define CMD_MEM_DEFL_DATA 0x16
+#define CMD_MEM_DEFL_END 0x17
+#define CMD_FLASH_ERASE_CHIP 0xD0
+#define CMD_FLASH_ERASE_REGION 0xD1
+#define CMD_READ_FLASH_STREAM 0xD2
+#define CMD_WRITE_FLASH_STREAM 0xD3
+#define CMD_FLASH_LZ_DATA 0xD4
+#define CMD_SET_FRAMING 0xD5
+#define CMD_FLASH_HASH_MAP 0xD6
+#define CMD_READ_FLASH_ID 0xF3
+#define CMD_READ_CHIP_ID 0xF4
+
+#define STATUS_BAD_CHECKSUM 0xC1
+
+// late_block 的应答推迟的时间，超过主机的重试超时
+#define LATE_RESPONSE_MS 500
+#define STATUS_INVALID_COMMAND 0xC3
+#define STATUS_INFLATE_ERROR 0xC7
+#define STATUS_LZ_ERROR 0xC8
+#define STATUS_QUEUE_FULL 0x0A
+
+#define FLASH_ID 0x164020  // capacity byte 0x16 = 4 MB
+#define LATE_FLASH_ID 0x154020  // 与 FLASH_ID 不同的 2 MB flash
+
+#define MAX_FRAME_LEN (64 * 1024)
+#define MAX_PENDING 256
+
+#pragma pack(1)
+typedef struct {
+	uint8_t direction;
+	uint8_t command;
+	uint16_t size;
+	uint32_t checksum;
+} req_hdr_t;
+
+typedef struct {
+	uint8_t direction;
+	uint8_t command;
+	uint16_t size;
+	uint32_t value;
+} res_hdr_t;
+#pragma pack()
+
+typedef struct {
+	uint64_t due;
+	uint32_t len;
+	uint8_t *frame;
+} pending_t;
+
+struct _fake_burner_t {
+	fake_burner_config_t config;
+
+	int master;
+	int slave;
+	char path[128];
+
+	pthread_t thread;
+	volatile bool running;
+
+	uint8_t *flash;
+	uint32_t begin_offset;
+	uint32_t begin_block_size;
+
+	// MEM_BEGIN 声明的 RAM 镜像，以及已写入（解压）的长度
+	uint8_t *ram;
+	uint32_t ram_size;
+	uint32_t ram_block_size;
+	uint32_t ram_len;
+#if FAKE_BURNER_INFLATE
+	z_stream inflater;
+	bool inflating;
+#endif
+
+	// 已切换为 COBS 帧格式；COBS 帧先原样收下，收完整帧后再解码
+	bool cobs;
+	uint8_t *rx_frame;
+	uint32_t rx_len;
+	uint32_t rx_wire_len;  // 当前帧在链路上的字节数，不含分隔符
+	bool rx_in_frame;
+	bool rx_esc;
+
+	pending_t pending[MAX_PENDING];
+	uint32_t pending_head;
+	uint32_t pending_count;
+
+	bool queue_full_injected;
+	bool drop_injected;
+	bool late_injected;
+	uint32_t flash_id_reads;
+	uint32_t extra_delay_us;  // 下一个应答额外延迟的时间
+	uint32_t req_seq;  // 当前请求携带的序号，回显在其应答中
+
+	// 当前波特率与模拟链路的线速（字节/秒），以及上一帧在链路上发送完毕的时间
+	uint32_t baud;
+	uint32_t link_bytes_per_sec;
+	uint64_t link_free;
+	// 按同样的线速，主机发来的上一帧在链路上接收完毕的时间；应答不早于请求到达后发出
+	uint64_t rx_link_free;
+
+	// 模拟 burner 启动完成的时间，以及 burner 是否已由 ROM 加载
+	uint64_t boot_until;
+	bool burner_loaded;
+
+	// READ_FLASH_STREAM 状态
+	bool stream_active;
+	uint32_t stream_addr;
+	uint32_t stream_size;
+	uint32_t stream_block;
+	uint32_t stream_window;
+	uint32_t stream_sent;
+	uint32_t stream_acked;
+
+	// WRITE_FLASH_STREAM 状态
+	bool write_stream_active;
+	uint32_t write_stream_addr;
+	uint32_t write_stream_size;
+	uint32_t write_stream_block;
+	uint32_t write_stream_received;
+	uint32_t write_stream_begins;
+
+	fake_burner_stats_t stats;
+};
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t r = write(fd, buf, len);
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+			return;
+		}
+		buf += r;
+		len -= r;
+	}
+}
+
+// 以 COBS 编码一帧，含首尾的分隔符
+static uint32_t
+cobs_stuff(const uint8_t *raw, uint32_t raw_len, uint8_t *frame)
+{
+	uint32_t len = 0;
+	frame[len++] = 0x00;
+
+	uint32_t code_at = len++;
+	uint8_t code = 1;
+	for (uint32_t i = 0; i < raw_len; i++) {
+		if (raw[i] != 0x00) {
+			frame[len++] = raw[i];
+			code++;
+		}
+		if (raw[i] == 0x00 || code == 0xFF) {
+			frame[code_at] = code;
+			code_at = len++;
+			code = 1;
+		}
+	}
+	frame[code_at] = code;
+
+	return len;
+}
+
+// 原地解码 COBS 帧体，失败返回 -1
+static int32_t
+cobs_unstuff(uint8_t *buf, uint32_t len)
+{
+	uint32_t in = 0, out = 0;
+	while (in < len) {
+		uint8_t code = buf[in++];
+		if (code == 0 || in + code - 1 > len) {
+			return -1;
+		}
+		for (uint8_t i = 1; i < code; i++) {
+			buf[out++] = buf[in++];
+		}
+		if (code != 0xFF && in < len) {
+			buf[out++] = 0x00;
+		}
+	}
+	return (int32_t)out;
+}
+
+static void
+queue_raw(fake_burner_t *fake, const uint8_t *raw, uint32_t raw_len)
+{
+	// 超过 max_baud 时短帧仍能通过，但较长的数据帧中会有一个字节出错
+	bool corrupt = fake->config.max_baud > 0 && fake->baud > fake->config.max_baud && raw_len >= 64;
+
+	uint8_t *frame = malloc(raw_len * 2 + 2);
+	uint32_t len = 0;
+	if (fake->cobs) {
+		len = cobs_stuff(raw, raw_len, frame);
+		if (corrupt) {
+			frame[len / 2] ^= 0x01;
+		}
+		frame[len++] = 0x00;
+	} else {
+		frame[len++] = END;
+		for (uint32_t i = 0; i < raw_len; i++) {
+			uint8_t b = raw[i];
+			if (corrupt && i == raw_len / 2) {
+				b ^= 0x01;
+			}
+			if (b == END) {
+				frame[len++] = ESC;
+				frame[len++] = ESC_END;
+			} else if (b == ESC) {
+				frame[len++] = ESC;
+				frame[len++] = ESC_ESC;
+			} else {
+				frame[len++] = b;
+			}
+		}
+		frame[len++] = END;
+	}
+
+	if (fake->pending_count == MAX_PENDING) {
+		free(frame);
+		return;
+	}
+
+	pending_t *p = &fake->pending[(fake->pending_head + fake->pending_count) % MAX_PENDING];
+	uint64_t now = now_us();
+	p->due = (fake->rx_link_free > now ? fake->rx_link_free : now) + fake->config.latency_us +
+			 fake->extra_delay_us;
+	fake->extra_delay_us = 0;
+	if (fake->link_bytes_per_sec > 0) {
+		// 帧在链路上排队发送，按线速计算发送完毕的时间
+		if (p->due < fake->link_free) {
+			p->due = fake->link_free;
+		}
+		p->due += (uint64_t)len * 1000000 / fake->link_bytes_per_sec;
+		fake->link_free = p->due;
+	}
+	p->frame = frame;
+	p->len = len;
+	fake->pending_count++;
+
+	if (fake->pending_count > fake->stats.max_in_flight) {
+		fake->stats.max_in_flight = fake->pending_count;
+	}
+}
+
+// ROM 不回显序号
+static bool
+seq_echo(fake_burner_t *fake)
+{
+	return fake->config.seq_echo && (!fake->config.rom || fake->burner_loaded);
+}
+
+static void
+queue_response(fake_burner_t *fake, uint8_t op, uint32_t value, const uint8_t *status,
+		const uint8_t *data, uint32_t data_len)
+{
+	uint8_t raw[sizeof(res_hdr_t) + 2 + MAX_FRAME_LEN / 2 + sizeof(uint32_t)];
+	res_hdr_t *hdr = (res_hdr_t *)raw;
+	hdr->direction = DIR_RES;
+	hdr->command = op;
+	hdr->size = 2 + data_len;
+	hdr->value = value;
+	memcpy(raw + sizeof(res_hdr_t), status, 2);
+	if (data_len > 0) {
+		memcpy(raw + sizeof(res_hdr_t) + 2, data, data_len);
+	}
+	uint32_t len = sizeof(res_hdr_t) + 2 + data_len;
+	if (seq_echo(fake)) {
+		memcpy(raw + len, &fake->req_seq, sizeof(uint32_t));
+		len += sizeof(uint32_t);
+	}
+	queue_raw(fake, raw, len);
+}
+
+// 模拟此前超时命令迟到的应答：一帧 op 不同的应答，以及一帧声明长度超过实际长度的残帧
+static void
+queue_stale(fake_burner_t *fake, uint8_t op)
+{
+	uint8_t raw[sizeof(res_hdr_t) + 2] = {0};
+	res_hdr_t *hdr = (res_hdr_t *)raw;
+	hdr->direction = DIR_RES;
+	hdr->command = CMD_READ_FLASH_ID;
+	hdr->size = 2;
+	queue_raw(fake, raw, sizeof(raw));
+
+	hdr->command = op;
+	hdr->size = 2 + 16;
+	queue_raw(fake, raw, sizeof(raw));
+}
+
+static void
+respond(fake_burner_t *fake, uint8_t op, uint8_t error, uint8_t code)
+{
+	uint8_t status[2] = {error, code};
+	queue_response(fake, op, 0, status, NULL, 0);
+}
+
+static void
+flush_responses(fake_burner_t *fake)
+{
+	uint64_t now = now_us();
+	while (fake->pending_count > 0) {
+		pending_t *p = &fake->pending[fake->pending_head];
+		if (p->due > now) {
+			break;
+		}
+		write_all(fake->master, p->frame, p->len);
+		free(p->frame);
+		fake->pending_head = (fake->pending_head + 1) % MAX_PENDING;
+		fake->pending_count--;
+	}
+}
+
+static uint32_t
+checksum(const uint8_t *buf, uint32_t len)
+{
+	uint32_t state = 0xEF;
+	for (uint32_t i = 0; i < len; i++) {
+		state ^= buf[i];
+	}
+	return state;
+}
+
+static bool
+in_flash(fake_burner_t *fake, uint32_t addr, uint32_t size)
+{
+	return (uint64_t)addr + size <= fake->config.flash_size;
+}
+
+// 超过 max_baud 时主机发来的数据帧同样会有字节出错，表现为校验失败
+static bool
+rx_corrupt(fake_burner_t *fake)
+{
+	return fake->config.max_baud > 0 && fake->baud > fake->config.max_baud;
+}
+
+static void
+handle_flash_data(fake_burner_t *fake, const req_hdr_t *hdr, const uint8_t *payload)
+{
+	const uint32_t *args = (const uint32_t *)payload;
+	uint32_t size = args[0];
+	uint32_t seq = args[1];
+	const uint8_t *data = payload + 16;
+
+	if (hdr->size < 16 || size > hdr->size - 16u || checksum(data, size) != hdr->checksum ||
+			rx_corrupt(fake)) {
+		respond(fake, CMD_FLASH_DATA, 1, STATUS_BAD_CHECKSUM);
+		return;
+	}
+
+	// 应答按顺序发出，迟到的应答之后的应答同样推迟
+	if (fake->config.late_block == seq + 1 && !fake->late_injected) {
+		fake->late_injected = true;
+		fake->extra_delay_us = LATE_RESPONSE_MS * 1000;
+		respond(fake, CMD_FLASH_DATA, 1, STATUS_BAD_CHECKSUM);
+		return;
+	}
+
+	if (fake->config.queue_full_seq == (int32_t)seq && !fake->queue_full_injected) {
+		fake->queue_full_injected = true;
+		respond(fake, CMD_FLASH_DATA, 1, STATUS_QUEUE_FULL);
+		return;
+	}
+
+	uint32_t addr = fake->begin_offset + seq * fake->begin_block_size;
+	if (!in_flash(fake, addr, size)) {
+		respond(fake, CMD_FLASH_DATA, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+	memcpy(fake->flash + addr, data, size);
+	fake->stats.flash_blocks++;
+
+	if (fake->config.drop_seq == (int32_t)seq && !fake->drop_injected) {
+		fake->drop_injected = true;
+		return;
+	}
+
+	respond(fake, CMD_FLASH_DATA, 0, 0);
+}
+
+// 解码 LZ4 块格式，输出须恰好为 dst_len 字节
+static bool
+lz_decode(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + src_len;
+	uint32_t out = 0;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+
+		uint32_t literals = token >> 4;
+		if (literals == 15) {
+			uint8_t b;
+			do {
+				if (ip >= iend) {
+					return false;
+				}
+				b = *ip++;
+				literals += b;
+			} while (b == 255);
+		}
+		if (literals > (uint32_t)(iend - ip) || literals > dst_len - out) {
+			return false;
+		}
+		memcpy(dst + out, ip, literals);
+		ip += literals;
+		out += literals;
+
+		// 最后一个序列只有字面量
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return false;
+		}
+		uint32_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > out) {
+			return false;
+		}
+
+		uint32_t match = (token & 0x0F) + 4;
+		if ((token & 0x0F) == 15) {
+			uint8_t b;
+			do {
+				if (ip >= iend) {
+					return false;
+				}
+				b = *ip++;
+				match += b;
+			} while (b == 255);
+		}
+		if (match > dst_len - out) {
+			return false;
+		}
+		// 匹配可与输出重叠，须逐字节复制
+		for (uint32_t i = 0; i < match; i++, out++) {
+			dst[out] = dst[out - offset];
+		}
+	}
+
+	return out == dst_len;
+}
+
+// 参数与 FLASH_DATA 相同，第 3 个参数为解压后的长度
+static void
+handle_flash_lz_data(fake_burner_t *fake, const req_hdr_t *hdr, const uint8_t *payload)
+{
+	const uint32_t *args = (const uint32_t *)payload;
+	uint32_t size = args[0];
+	uint32_t seq = args[1];
+	uint32_t raw_size = args[2];
+	const uint8_t *data = payload + 16;
+
+	if (!fake->config.flash_lz) {
+		respond(fake, CMD_FLASH_LZ_DATA, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+
+	if (hdr->size < 16 || size > hdr->size - 16u || checksum(data, size) != hdr->checksum ||
+			rx_corrupt(fake)) {
+		respond(fake, CMD_FLASH_LZ_DATA, 1, STATUS_BAD_CHECKSUM);
+		return;
+	}
+
+	uint32_t addr = fake->begin_offset + seq * fake->begin_block_size;
+	if (raw_size > fake->begin_block_size || !in_flash(fake, addr, raw_size)) {
+		respond(fake, CMD_FLASH_LZ_DATA, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+	if (!lz_decode(data, size, fake->flash + addr, raw_size)) {
+		respond(fake, CMD_FLASH_LZ_DATA, 1, STATUS_LZ_ERROR);
+		return;
+	}
+	fake->stats.flash_blocks++;
+	fake->stats.lz_blocks++;
+
+	respond(fake, CMD_FLASH_LZ_DATA, 0, 0);
+}
+
+// 在窗口允许的范围内发出数据帧，全部确认后发出 MD5 帧
+static void
+stream_pump(fake_burner_t *fake)
+{
+	while (fake->stream_sent < fake->stream_size &&
+			fake->stream_sent - fake->stream_acked < fake->stream_window * fake->stream_block) {
+		uint32_t len = fake->stream_size - fake->stream_sent;
+		if (len > fake->stream_block) {
+			len = fake->stream_block;
+		}
+		fake->stats.stream_blocks++;
+		bool overrun = fake->stats.stream_blocks == fake->config.stream_overrun_block;
+		queue_raw(fake, fake->flash + fake->stream_addr + fake->stream_sent,
+				overrun ? len / 2 : len);
+		fake->stream_sent += len;
+	}
+
+	if (fake->stream_acked >= fake->stream_size) {
+		uint8_t md5[16];
+		mbedtls_md5(fake->flash + fake->stream_addr, fake->stream_size, md5);
+		queue_raw(fake, md5, sizeof(md5));
+		fake->stream_active = false;
+	}
+}
+
+static void
+handle_read_flash_stream(fake_burner_t *fake, const req_hdr_t *hdr, const uint32_t *args)
+{
+	if (hdr->size < 16 || !in_flash(fake, args[0], args[1]) || args[2] == 0 ||
+			args[2] > MAX_FRAME_LEN / 2 || args[3] == 0 ||
+			(fake->config.stream_max_block != 0 && args[2] > fake->config.stream_max_block)) {
+		respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+
+	respond(fake, hdr->command, 0, 0);
+
+	fake->stream_active = true;
+	fake->stream_addr = args[0];
+	fake->stream_size = args[1];
+	fake->stream_block = args[2];
+	fake->stream_window = args[3];
+	fake->stream_sent = 0;
+	fake->stream_acked = 0;
+	stream_pump(fake);
+}
+
+static void
+handle_write_flash_stream(fake_burner_t *fake, const req_hdr_t *hdr, const uint32_t *args)
+{
+	if (fake->config.write_stream_window == 0 || hdr->size < 16 ||
+			!in_flash(fake, args[0], args[1]) || args[2] == 0 || args[2] > MAX_FRAME_LEN / 2 ||
+			args[3] == 0) {
+		respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+
+	uint8_t status[2] = {0, 0};
+	uint32_t window = fake->config.write_stream_window;
+	if (fake->write_stream_begins++ > 0 && fake->config.write_stream_resume_window != 0) {
+		window = fake->config.write_stream_resume_window;
+	}
+	queue_response(fake, hdr->command, 0, status, (const uint8_t *)&window, sizeof(window));
+
+	fake->write_stream_active = true;
+	fake->write_stream_addr = args[0];
+	fake->write_stream_size = args[1];
+	fake->write_stream_block = args[2];
+	fake->write_stream_received = 0;
+}
+
+// 流式写入的数据帧须为完整的一块（最后一帧除外），否则中止流式写入，按普通指令处理该帧
+static bool
+handle_write_stream_data(fake_burner_t *fake, const uint8_t *frame, uint32_t len)
+{
+	uint32_t want = fake->write_stream_size - fake->write_stream_received;
+	if (want > fake->write_stream_block) {
+		want = fake->write_stream_block;
+	}
+
+	fake->stats.write_stream_frames++;
+	if (len != want ||
+			fake->stats.write_stream_frames == fake->config.write_stream_bad_frame) {
+		fake->write_stream_active = false;
+		return len == want;
+	}
+
+	memcpy(fake->flash + fake->write_stream_addr + fake->write_stream_received, frame, len);
+	fake->write_stream_received += len;
+	if (fake->write_stream_received == fake->write_stream_size) {
+		fake->write_stream_active = false;
+	}
+
+	uint32_t acked = fake->write_stream_received;
+	queue_raw(fake, (const uint8_t *)&acked, sizeof(acked));
+	return true;
+}
+
+// 先应答，再以每帧 HASH_MAP_FRAME 个摘要依次发出各块的 MD5
+#define HASH_MAP_FRAME 64
+
+static void
+handle_flash_hash_map(fake_burner_t *fake, const req_hdr_t *hdr, const uint32_t *args)
+{
+	uint32_t addr = args[0];
+	uint32_t size = args[1];
+	uint32_t chunk_size = args[2];
+
+	if (!fake->config.hash_map || chunk_size == 0 || !in_flash(fake, addr, size)) {
+		respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+	respond(fake, hdr->command, 0, 0);
+	fake->stats.hash_maps++;
+
+	uint8_t frame[HASH_MAP_FRAME * 16];
+	uint32_t len = 0, frames = 0;
+	for (uint32_t offset = 0; offset < size; offset += chunk_size) {
+		uint32_t length = size - offset < chunk_size ? size - offset : chunk_size;
+		mbedtls_md5(fake->flash + addr + offset, length, frame + len);
+		len += 16;
+
+		if (len == sizeof(frame) || offset + length >= size) {
+			// 模拟丢失一帧
+			if (++frames != fake->config.hash_map_drop_frame) {
+				queue_raw(fake, frame, len);
+			}
+			len = 0;
+		}
+	}
+}
+
+// ROM 在 burner 加载前只支持的指令
+static bool
+rom_supports(fake_burner_t *fake, uint8_t command)
+{
+	switch (command) {
+		case CMD_SYNC:
+		case CMD_MEM_BEGIN:
+		case CMD_MEM_DATA:
+		case CMD_MEM_END:
+		case CMD_CHANGE_BAUDRATE:
+			return true;
+		case CMD_MEM_DEFL_BEGIN:
+		case CMD_MEM_DEFL_DATA:
+		case CMD_MEM_DEFL_END:
+			return fake->config.rom_inflate;
+		default:
+			return false;
+	}
+}
+
+static void
+mem_begin(fake_burner_t *fake, const uint32_t *args)
+{
+	free(fake->ram);
+	fake->ram_size = args[0] < fake->config.flash_size ? args[0] : fake->config.flash_size;
+	fake->ram = calloc(1, fake->ram_size);
+	fake->ram_block_size = args[2];
+	fake->ram_len = 0;
+}
+
+static void
+handle_mem_data(fake_burner_t *fake, const req_hdr_t *hdr, const uint8_t *payload)
+{
+	const uint32_t *args = (const uint32_t *)payload;
+	uint32_t size = args[0];
+	uint64_t offset = (uint64_t)args[1] * fake->ram_block_size;
+
+	if (hdr->size < 16 || size > hdr->size - 16u || checksum(payload + 16, size) != hdr->checksum) {
+		respond(fake, hdr->command, 1, STATUS_BAD_CHECKSUM);
+		return;
+	}
+
+	if (fake->ram == NULL || offset + size > fake->ram_size) {
+		respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+
+	memcpy(fake->ram + offset, payload + 16, size);
+	if (offset + size > fake->ram_len) {
+		fake->ram_len = offset + size;
+	}
+	fake->stats.mem_bytes += size;
+	respond(fake, hdr->command, 0, 0);
+}
+
+#if FAKE_BURNER_INFLATE
+static void
+handle_mem_defl(fake_burner_t *fake, const req_hdr_t *hdr, const uint8_t *payload)
+{
+	const uint32_t *args = (const uint32_t *)payload;
+
+	switch (hdr->command) {
+		case CMD_MEM_DEFL_BEGIN:
+			mem_begin(fake, args);
+			if (fake->inflating) {
+				inflateEnd(&fake->inflater);
+			}
+			memset(&fake->inflater, 0, sizeof(fake->inflater));
+			fake->inflating = inflateInit(&fake->inflater) == Z_OK;
+			respond(fake, hdr->command, fake->inflating ? 0 : 1,
+					fake->inflating ? 0 : STATUS_INFLATE_ERROR);
+			break;
+
+		case CMD_MEM_DEFL_DATA: {
+			uint32_t size = args[0];
+			if (hdr->size < 16 || size > hdr->size - 16u ||
+					checksum(payload + 16, size) != hdr->checksum) {
+				respond(fake, hdr->command, 1, STATUS_BAD_CHECKSUM);
+				break;
+			}
+			if (!fake->inflating || fake->ram == NULL) {
+				respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				break;
+			}
+			fake->inflater.next_in = (Bytef *)payload + 16;
+			fake->inflater.avail_in = size;
+			fake->inflater.next_out = fake->ram + fake->ram_len;
+			fake->inflater.avail_out = fake->ram_size - fake->ram_len;
+			int r = inflate(&fake->inflater, Z_NO_FLUSH);
+			fake->ram_len = fake->ram_size - fake->inflater.avail_out;
+			fake->stats.mem_bytes += size;
+			if ((r != Z_OK && r != Z_STREAM_END) || fake->inflater.avail_in != 0) {
+				respond(fake, hdr->command, 1, STATUS_INFLATE_ERROR);
+				break;
+			}
+			respond(fake, hdr->command, 0, 0);
+			break;
+		}
+
+		case CMD_MEM_DEFL_END:
+			if (fake->inflating) {
+				inflateEnd(&fake->inflater);
+				fake->inflating = false;
+			}
+			if (fake->ram_len != fake->ram_size) {
+				respond(fake, hdr->command, 1, STATUS_INFLATE_ERROR);
+				break;
+			}
+			respond(fake, hdr->command, 0, 0);
+			fake->boot_until = now_us() + (uint64_t)fake->config.boot_ms * 1000;
+			fake->burner_loaded = true;
+			break;
+	}
+}
+#endif
+
+static void
+handle_frame(fake_burner_t *fake, const uint8_t *frame, uint32_t len, uint32_t wire_len)
+{
+	fake->stats.rx_bytes += wire_len + 2;
+	if (fake->link_bytes_per_sec > 0) {
+		uint64_t now = now_us();
+		if (fake->rx_link_free < now) {
+			fake->rx_link_free = now;
+		}
+		fake->rx_link_free += (uint64_t)(wire_len + 2) * 1000000 / fake->link_bytes_per_sec;
+	}
+
+	// 流式读取期间，主机以不带命令头的 4 字节帧确认累计收到的字节数
+	if (fake->stream_active && len == sizeof(uint32_t)) {
+		uint32_t acked;
+		memcpy(&acked, frame, sizeof(acked));
+		if (acked > fake->stream_acked && acked <= fake->stream_sent) {
+			fake->stream_acked = acked;
+		}
+		fake->stats.stream_acks++;
+		stream_pump(fake);
+		return;
+	}
+
+	if (fake->write_stream_active && handle_write_stream_data(fake, frame, len)) {
+		return;
+	}
+
+	if (len < sizeof(req_hdr_t) || now_us() < fake->boot_until) {
+		return;
+	}
+
+	const req_hdr_t *hdr = (const req_hdr_t *)frame;
+	const uint8_t *payload = frame + sizeof(req_hdr_t);
+	const uint32_t *args = (const uint32_t *)payload;
+	if (hdr->size > len - sizeof(req_hdr_t)) {
+		return;
+	}
+
+	// 回显序号时校验和只占校验字的低 8 位
+	req_hdr_t stripped;
+	if (seq_echo(fake)) {
+		stripped = *hdr;
+		fake->req_seq = stripped.checksum >> 8;
+		stripped.checksum &= 0xFF;
+		hdr = &stripped;
+	}
+
+	fake->stats.frames++;
+
+	if (fake->config.rom && !fake->burner_loaded && !rom_supports(fake, hdr->command)) {
+		respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+		return;
+	}
+
+	switch (hdr->command) {
+		case CMD_MEM_BEGIN:
+		case CMD_MEM_DATA:
+			// MEM_BEGIN 的第 3 个参数与 MEM_DATA 的第 1 个参数为块大小
+			if (fake->config.rom_max_block != 0 &&
+					args[hdr->command == CMD_MEM_BEGIN ? 2 : 0] > fake->config.rom_max_block) {
+				if (fake->config.rom_drop_large && hdr->command == CMD_MEM_BEGIN) {
+					mem_begin(fake, args);
+					respond(fake, hdr->command, 0, 0);
+				} else if (!fake->config.rom_drop_large) {
+					respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				}
+				break;
+			}
+			if (hdr->command == CMD_MEM_BEGIN) {
+				mem_begin(fake, args);
+				fake->stats.mem_block_size = args[2];
+				respond(fake, hdr->command, 0, 0);
+			} else {
+				handle_mem_data(fake, hdr, payload);
+			}
+			break;
+
+#if FAKE_BURNER_INFLATE
+		case CMD_MEM_DEFL_BEGIN:
+		case CMD_MEM_DEFL_DATA:
+		case CMD_MEM_DEFL_END:
+			if (!fake->config.rom_inflate) {
+				respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				break;
+			}
+			handle_mem_defl(fake, hdr, payload);
+			break;
+#endif
+
+		case CMD_SYNC:
+		case CMD_FLASH_END:
+			respond(fake, hdr->command, 0, 0);
+			break;
+
+		case CMD_MEM_END:
+			respond(fake, hdr->command, 0, 0);
+			fake->boot_until = now_us() + (uint64_t)fake->config.boot_ms * 1000;
+			fake->burner_loaded = true;
+			break;
+
+		case CMD_SET_FRAMING:
+			if (!fake->config.cobs || args[0] > 1 || args[1] > MAX_FRAME_LEN * 2) {
+				respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				break;
+			}
+			// 应答以原帧格式发出，之后再切换；尚未收完的帧一并丢弃
+			respond(fake, hdr->command, 0, 0);
+			fake->cobs = args[0] == 1;
+			fake->rx_in_frame = false;
+			break;
+
+		case CMD_CHANGE_BAUDRATE:
+			// 应答以原波特率发出，之后再切换
+			respond(fake, hdr->command, 0, 0);
+			fake->baud = args[0];
+			fake->stats.baud = fake->baud;
+			if (fake->config.pace_baud) {
+				fake->link_bytes_per_sec = fake->baud / 10;
+			}
+			break;
+
+		case CMD_FLASH_BEGIN:
+			if (args[2] == 0 || args[2] > fake->config.max_flash_block) {
+				respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				break;
+			}
+			fake->begin_offset = args[3];
+			fake->begin_block_size = args[2];
+			fake->stats.flash_block_size = args[2];
+			fake->stats.flash_begins++;
+			respond(fake, hdr->command, 0, 0);
+			break;
+
+		case CMD_FLASH_DATA:
+			handle_flash_data(fake, hdr, payload);
+			break;
+
+		case CMD_FLASH_LZ_DATA:
+			handle_flash_lz_data(fake, hdr, payload);
+			break;
+
+		case CMD_WRITE_FLASH_STREAM:
+			handle_write_flash_stream(fake, hdr, args);
+			break;
+
+		case CMD_FLASH_ERASE_CHIP:
+			memset(fake->flash, 0xFF, fake->config.flash_size);
+			respond(fake, hdr->command, 0, 0);
+			break;
+
+		case CMD_FLASH_ERASE_REGION:
+			if (!in_flash(fake, args[0], args[1])) {
+				respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				break;
+			}
+			memset(fake->flash + args[0], 0xFF, args[1]);
+			respond(fake, hdr->command, 0, 0);
+			break;
+
+		case CMD_SPI_FLASH_MD5: {
+			uint8_t md5[16];
+			uint8_t status[2] = {0, 0};
+			fake->stats.md5_requests++;
+			if (!in_flash(fake, args[0], args[1])) {
+				respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				break;
+			}
+			mbedtls_md5(fake->flash + args[0], args[1], md5);
+			if (fake->config.stale_frames) {
+				queue_stale(fake, hdr->command);
+			}
+			queue_response(fake, hdr->command, 0, status, md5, sizeof(md5));
+			break;
+		}
+
+		case CMD_FLASH_HASH_MAP:
+			handle_flash_hash_map(fake, hdr, args);
+			break;
+
+		case CMD_READ_FLASH: {
+			uint8_t status[2] = {0, 0};
+			if (!in_flash(fake, args[0], args[1]) || args[1] > 64) {
+				respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+				break;
+			}
+			if (++fake->stats.reads == fake->config.drop_read) {
+				break;
+			}
+			queue_response(fake, hdr->command, 0, status, fake->flash + args[0], args[1]);
+			break;
+		}
+
+		case CMD_READ_FLASH_STREAM:
+			handle_read_flash_stream(fake, hdr, args);
+			break;
+
+		case CMD_READ_FLASH_ID: {
+			uint8_t status[2] = {0, 0};
+			if (++fake->flash_id_reads == fake->config.late_flash_id) {
+				fake->extra_delay_us = LATE_RESPONSE_MS * 1000;
+				queue_response(fake, hdr->command, LATE_FLASH_ID, status, NULL, 0);
+				break;
+			}
+			queue_response(fake, hdr->command, FLASH_ID, status, NULL, 0);
+			break;
+		}
+
+		case CMD_READ_CHIP_ID: {
+			uint8_t status[2] = {0, 0};
+			const uint8_t id[8] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF};
+			queue_response(fake, hdr->command, 0, status, id, sizeof(id));
+			break;
+		}
+
+		default:
+			respond(fake, hdr->command, 1, STATUS_INVALID_COMMAND);
+			break;
+	}
+}
+
+static void
+feed_cobs(fake_burner_t *fake, uint8_t b)
+{
+	if (b == 0x00) {
+		if (fake->rx_in_frame && fake->rx_len > 0) {
+			int32_t len = cobs_unstuff(fake->rx_frame, fake->rx_len);
+			if (len > 0) {
+				handle_frame(fake, fake->rx_frame, len, fake->rx_wire_len);
+			}
+		}
+		fake->rx_in_frame = true;
+		fake->rx_len = 0;
+		fake->rx_wire_len = 0;
+	} else if (fake->rx_in_frame && fake->rx_len < MAX_FRAME_LEN) {
+		fake->rx_frame[fake->rx_len++] = b;
+		fake->rx_wire_len++;
+	}
+}
+
+static void
+feed(fake_burner_t *fake, const uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uint8_t b = buf[i];
+		if (fake->cobs) {
+			feed_cobs(fake, b);
+			continue;
+		}
+
+		if (b == END) {
+			if (fake->rx_in_frame && fake->rx_len > 0) {
+				handle_frame(fake, fake->rx_frame, fake->rx_len, fake->rx_wire_len);
+			}
+			fake->rx_in_frame = true;
+			fake->rx_len = 0;
+			fake->rx_wire_len = 0;
+			fake->rx_esc = false;
+			continue;
+		} else if (!fake->rx_in_frame) {
+			continue;
+		}
+
+		fake->rx_wire_len++;
+		if (fake->rx_esc) {
+			fake->rx_esc = false;
+			b = b == ESC_END ? END : b == ESC_ESC ? ESC : b;
+			if (fake->rx_len < MAX_FRAME_LEN) {
+				fake->rx_frame[fake->rx_len++] = b;
+			}
+		} else if (b == ESC) {
+			fake->rx_esc = true;
+		} else if (fake->rx_len < MAX_FRAME_LEN) {
+			fake->rx_frame[fake->rx_len++] = b;
+		}
+	}
+}
+
+static void *
+serve(void *arg)
+{
+	fake_burner_t *fake = (fake_burner_t *)arg;
+	uint8_t buf[4096];
+
+	while (fake->running) {
+		int timeout = 10;
+		if (fake->pending_count > 0) {
+			uint64_t due = fake->pending[fake->pending_head].due;
+			uint64_t now = now_us();
+			timeout = due > now ? (int)((due - now + 999) / 1000) : 0;
+		}
+
+		struct pollfd pfd = {.fd = fake->master, .events = POLLIN};
+		if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+			ssize_t r = read(fake->master, buf, sizeof(buf));
+			if (r > 0) {
+				feed(fake, buf, r);
+			}
+		}
+
+		flush_responses(fake);
+	}
+
+	return NULL;
+}
+
+fake_burner_t *
+fake_burner_start(const fake_burner_config_t *config)
+{
+	fake_burner_t *fake = calloc(1, sizeof(fake_burner_t));
+	fake->config = *config;
+	if (fake->config.max_flash_block == 0) {
+		fake->config.max_flash_block = 4096;
+	}
+	fake->baud = 115200;
+	fake->stats.baud = fake->baud;
+	fake->link_bytes_per_sec =
+			config->pace_baud ? fake->baud / 10 : config->link_bytes_per_sec;
+	fake->master = -1;
+	fake->slave = -1;
+
+	fake->flash = malloc(config->flash_size);
+	fake->rx_frame = malloc(MAX_FRAME_LEN);
+	if (fake->flash == NULL || fake->rx_frame == NULL) {
+		goto err;
+	}
+	memset(fake->flash, 0xFF, config->flash_size);
+
+	fake->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fake->master < 0 || grantpt(fake->master) != 0 || unlockpt(fake->master) != 0 ||
+			ptsname_r(fake->master, fake->path, sizeof(fake->path)) != 0) {
+		goto err;
+	}
+
+	// 保持一个 slave 端句柄，避免主机打开前 master 端持续返回 POLLHUP
+	fake->slave = open(fake->path, O_RDWR | O_NOCTTY);
+	if (fake->slave < 0) {
+		goto err;
+	}
+
+	fake->running = true;
+	if (pthread_create(&fake->thread, NULL, serve, fake) != 0) {
+		goto err;
+	}
+
+	return fake;
+
+err:
+	fake->running = false;
+	fake_burner_free(&fake);
+	return NULL;
+}
+
+void
+fake_burner_stop(fake_burner_t *fake)
+{
+	if (fake->running) {
+		fake->running = false;
+		pthread_join(fake->thread, NULL);
+	}
+}
+
+void
+fake_burner_free(fake_burner_t **fake)
+{
+	fake_burner_stop(*fake);
+	while ((*fake)->pending_count > 0) {
+		free((*fake)->pending[(*fake)->pending_head].frame);
+		(*fake)->pending_head = ((*fake)->pending_head + 1) % MAX_PENDING;
+		(*fake)->pending_count--;
+	}
+	if ((*fake)->slave >= 0) {
+		close((*fake)->slave);
+	}
+	if ((*fake)->master >= 0) {
+		close((*fake)->master);
+	}
+#if FAKE_BURNER_INFLATE
+	if ((*fake)->inflating) {
+		inflateEnd(&(*fake)->inflater);
+	}
+#endif
+	free((*fake)->rx_frame);
+	free((*fake)->ram);
+	free((*fake)->flash);
+	free(*fake);
+	*fake = NULL;
+}
+
+const char *
+fake_burner_path(fake_burner_t *fake)
+{
+	return fake->path;
+}
+
+uint8_t *
+fake_burner_flash(fake_burner_t *fake)
+{
+	return fake->flash;
+}
+
+const uint8_t *
+fake_burner_ram(fake_burner_t *fake, uint32_t *len)
+{
+	*len = fake->ram_len;
+	return fake->ram;
+}
+
+void
+fake_burner_stats(fake_burner_t *fake, fake_burner_stats_t *stats)
+{
+	*stats = fake->stats;
+}
@@ -0,0 +1,111 @@
+#ifndef __LIB_CSKBURN_SERIAL_FAKE_BURNER__
+#define __LIB_CSKBURN_SERIAL_FAKE_BURNER__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A burner model served on the master side of a pseudo terminal. The host opens
+ * fake_burner_path() with cskburn_serial_open() as if it was a real serial port
+ * with the burner already running.
+ */
+typedef struct _fake_burner_t fake_burner_t;
+
+typedef struct {
+	uint32_t flash_size;
+	// 每个应答在收到请求后延迟发出的时间，用于模拟链路往返
+	uint32_t latency_us;
+	// 对该 seq 的第一次写入返回 0x0A（写入队列满），-1 表示不注入
+	int32_t queue_full_seq;
+	// 丢弃该 seq 第一次写入的应答，-1 表示不注入
+	int32_t drop_seq;
+	// 第 n 个数据块（seq + 1）第一次写入时校验失败，且应答在主机超时重发之后才发出，0 表示不注入
+	uint32_t late_block;
+	// 在每个 MD5 应答之前插入无关的应答帧
+	bool stale_frames;
+	// 第 n 个 READ_FLASH_ID（从 1 开始计数）的应答在主机超时之后才发出，且携带另一个 flash ID，
+	// 0 表示不注入
+	uint32_t late_flash_id;
+	// burner 运行后在每个应答的载荷之后回显请求校验字高 24 位的序号
+	bool seq_echo;
+	// 模拟链路的线速（字节/秒），应答按此速率依次发出，0 表示不限速
+	uint32_t link_bytes_per_sec;
+	// 线速随 CHANGE_BAUDRATE 设置的波特率变化（8N1），覆盖 link_bytes_per_sec
+	bool pace_baud;
+	// 超过该波特率后链路不可靠：同步仍能成功，但数据帧会出错，0 表示不限制
+	uint32_t max_baud;
+	// 应答 MEM_END 后模拟 burner 启动的时间 (ms)，期间丢弃收到的所有请求
+	uint32_t boot_ms;
+	// 模拟 ROM：收到 MEM_END 之前只应答 ROM 支持的指令
+	bool rom;
+	// ROM 接受的最大 RAM 块，0 表示不限制
+	uint32_t rom_max_block;
+	// 超过 rom_max_block 的 MEM_BEGIN 照常应答，其后的数据块直接丢弃而不应答
+	bool rom_drop_large;
+	// ROM 支持解压上传的 burner，仅在以 FAKE_BURNER_INFLATE 构建时有效
+	bool rom_inflate;
+	// 丢弃第 n 个 READ_FLASH 请求（从 1 开始计数）的应答，0 表示不注入
+	uint32_t drop_read;
+	// 流式读取接受的最大块，0 表示不限制
+	uint32_t stream_max_block;
+	// 流式读取的第 n 块（从 1 开始计数）只发出一半，模拟接收溢出，0 表示不注入
+	uint32_t stream_overrun_block;
+	// 支持流式写入并在应答中声明该窗口（帧数），0 表示不支持流式写入
+	uint32_t write_stream_window;
+	// 流式写入的第 n 帧（从 1 开始计数）视作残帧，中止本次流式写入，0 表示不注入
+	uint32_t write_stream_bad_frame;
+	// 重新开始的流式写入声明的窗口（帧数），0 表示与 write_stream_window 相同
+	uint32_t write_stream_resume_window;
+	// 支持 FLASH_LZ_DATA 压缩块
+	bool flash_lz;
+	// 支持切换为 COBS 帧格式
+	bool cobs;
+	// FLASH_BEGIN 接受的最大块，0 表示 4 KB
+	uint32_t max_flash_block;
+	// 支持 FLASH_HASH_MAP
+	bool hash_map;
+	// 丢弃 FLASH_HASH_MAP 应答的第 n 个摘要帧（从 1 开始计数），0 表示不注入
+	uint32_t hash_map_drop_frame;
+} fake_burner_config_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t flash_blocks;
+	uint32_t flash_begins;
+	uint32_t max_in_flight;
+	uint32_t stream_blocks;
+	uint32_t stream_acks;
+	uint32_t write_stream_frames;
+	uint32_t lz_blocks;
+	uint32_t flash_block_size;  // 最近一次 FLASH_BEGIN 的块大小
+	uint32_t md5_requests;
+	uint32_t hash_maps;
+	uint32_t rx_bytes;  // 收到的帧在链路上的总字节数，含转义与分隔符
+	uint32_t mem_bytes;  // MEM_DATA 及 MEM_DEFL_DATA 载荷的总字节数
+	uint32_t mem_block_size;  // 最近一次被接受的 MEM_BEGIN 的块大小
+	uint32_t reads;
+	uint32_t baud;  // 当前的波特率
+} fake_burner_stats_t;
+
+fake_burner_t *fake_burner_start(const fake_burner_config_t *config);
+
+/**
+ * @brief Stop serving and wait for the device thread to exit, the flash content
+ * stays available until fake_burner_free()
+ */
+void fake_burner_stop(fake_burner_t *fake);
+
+void fake_burner_free(fake_burner_t **fake);
+
+const char *fake_burner_path(fake_burner_t *fake);
+
+uint8_t *fake_burner_flash(fake_burner_t *fake);
+
+/**
+ * @brief Get the RAM content loaded through MEM_BEGIN / MEM_DATA, inflated if uploaded deflated
+ */
+const uint8_t *fake_burner_ram(fake_burner_t *fake, uint32_t *len);
+
+void fake_burner_stats(fake_burner_t *fake, fake_burner_stats_t *stats);
+
+#endif  // __LIB_CSKBURN_SERIAL_FAKE_BURNER__
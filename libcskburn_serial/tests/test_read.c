@@ -0,0 +1,606 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core.h"
+#include "cskburn_serial.h"
+#include "fake_burner.h"
+#include "io.h"
+#include "log.h"
+#include "mbedtls/md5.h"
+#include "time_monotonic.h"
+
+#define CHECK(expr)                                                                             \
+	do {                                                                                        \
+		if (!(expr)) {                                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr);          \
+			return false;                                                                       \
+		}                                                                                       \
+	} while (0)
+
+#define FLASH_SIZE (4 * 1024 * 1024)
+#define READ_ADDR 0x20000
+
+// 写入内存的 writer，每写入 stall_every 次停顿 stall_ms，模拟写盘时的延迟
+typedef struct {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t len;
+	uint32_t writes;
+	uint32_t stall_every;
+	uint32_t stall_ms;
+	bool stall_once;  // 只在第 stall_every 次写入时停顿一次
+} sink_t;
+
+static uint32_t
+sink_write(writer_t *writer, const uint8_t *buf, uint32_t size)
+{
+	sink_t *sink = writer->ctx;
+	if (sink->len + size > sink->size) {
+		return 0;
+	}
+	memcpy(sink->buf + sink->len, buf, size);
+	sink->len += size;
+
+	if (sink->stall_every > 0 && ++sink->writes % sink->stall_every == 0 &&
+			(!sink->stall_once || sink->writes == sink->stall_every)) {
+		usleep(sink->stall_ms * 1000);
+	}
+	return size;
+}
+
+static bool
+test_read_stream(void)
+{
+	const uint32_t size = 256 * 1024 + 100;
+	cskburn_serial_device_t *dev = NULL;
+	fake_burner_stats_t stats;
+	uint8_t md5[16], expected_md5[16];
+
+	// 3 Mbaud，8N1
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 200,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	CHECK(fake != NULL);
+
+	uint8_t *flash = fake_burner_flash(fake);
+	uint32_t state = 0x87654321;
+	for (uint32_t i = 0; i < size; i++) {
+		state = state * 1103515245 + 12345;
+		flash[READ_ADDR + i] = (i % 61 == 0) ? 0xC0 : (uint8_t)(state >> 16);
+	}
+	mbedtls_md5(flash + READ_ADDR, size, expected_md5);
+
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 1000) == 0);
+
+	sink_t sink = {
+			.buf = malloc(size),
+			.size = size,
+			.stall_every = 16,
+			.stall_ms = 20,
+	};
+	writer_t writer = {.write = sink_write, .ctx = &sink};
+
+	uint64_t t1 = time_monotonic();
+	int ret = cskburn_serial_read(dev, TARGET_FLASH, READ_ADDR, size, &writer, md5, NULL);
+	uint64_t elapsed = time_monotonic() - t1;
+
+	cskburn_serial_close(&dev);
+	fake_burner_stop(fake);
+	fake_burner_stats(fake, &stats);
+
+	bool same = ret == 0 && sink.len == size && memcmp(sink.buf, flash + READ_ADDR, size) == 0;
+	free(sink.buf);
+	fake_burner_free(&fake);
+
+	printf("stream read at 3 Mbaud with stalling writer: %llu ms (%.0f KB/s)\n",
+			(unsigned long long)elapsed, size / 1024.0 / elapsed * 1000);
+
+	CHECK(ret == 0);
+	CHECK(same);
+	CHECK(memcmp(md5, expected_md5, sizeof(md5)) == 0);
+	CHECK(stats.stream_blocks == (size + 4095) / 4096);
+	// 写盘由独立线程完成，停顿不会让帧积压；确认帧不多于数据帧
+	CHECK(stats.stream_acks <= stats.stream_blocks);
+	return true;
+}
+
+// 按 CHIP_VENUSA 流式读取，返回耗时（毫秒），失败返回 -1
+static int64_t
+read_stream(const fake_burner_config_t *config, uint32_t size, uint32_t stall_at,
+		uint32_t stall_ms, fake_burner_stats_t *stats)
+{
+	int64_t elapsed = -1;
+	cskburn_serial_device_t *dev = NULL;
+	uint8_t md5[16], expected_md5[16];
+
+	fake_burner_t *fake = fake_burner_start(config);
+	if (fake == NULL) {
+		return -1;
+	}
+
+	uint8_t *flash = fake_burner_flash(fake);
+	for (uint32_t i = 0; i < size; i++) {
+		flash[READ_ADDR + i] = (i % 67 == 0) ? 0xC0 : (uint8_t)(i * 13 + (i >> 9));
+	}
+	mbedtls_md5(flash + READ_ADDR, size, expected_md5);
+
+	sink_t sink = {
+			.buf = malloc(size),
+			.size = size,
+			.stall_every = stall_at,
+			.stall_ms = stall_ms,
+			.stall_once = true,
+	};
+	writer_t writer = {.write = sink_write, .ctx = &sink};
+
+	if (cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 1000) == 0) {
+		uint64_t t1 = time_monotonic();
+		int ret = cskburn_serial_read(dev, TARGET_FLASH, READ_ADDR, size, &writer, md5, NULL);
+		uint64_t t2 = time_monotonic();
+		if (ret == 0 && sink.len == size && memcmp(sink.buf, flash + READ_ADDR, size) == 0 &&
+				memcmp(md5, expected_md5, sizeof(md5)) == 0) {
+			elapsed = (int64_t)(t2 - t1);
+		} else {
+			fprintf(stderr, "stream read failed: %d, %u bytes\n", ret, sink.len);
+		}
+		cskburn_serial_close(&dev);
+	}
+
+	fake_burner_stop(fake);
+	fake_burner_stats(fake, stats);
+	free(sink.buf);
+	fake_burner_free(&fake);
+	return elapsed;
+}
+
+static bool
+test_read_stream_tuning(void)
+{
+	const uint32_t bauds[] = {115200, 921600, 1500000, 3000000};
+	fake_burner_stats_t stats;
+
+	// 各常用波特率下均应接近线速（8N1，每字节 10 位）
+	for (uint32_t i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++) {
+		uint32_t line = bauds[i] / 10;
+		uint32_t size = line / 4 > 16 * 1024 ? line / 4 : 16 * 1024;
+		fake_burner_config_t config = {
+				.flash_size = FLASH_SIZE,
+				.latency_us = 200,
+				.queue_full_seq = -1,
+				.drop_seq = -1,
+				.link_bytes_per_sec = line,
+		};
+		int64_t elapsed = read_stream(&config, size, 0, 0, &stats);
+		CHECK(elapsed > 0);
+		double ratio = (double)size * 1000 / elapsed / line;
+		printf("stream read at %u baud: %.0f KB/s (%.0f%% of line rate), %u acks for %u blocks\n",
+				bauds[i], size / 1024.0 / elapsed * 1000, ratio * 100, stats.stream_acks,
+				stats.stream_blocks);
+		CHECK(ratio > 0.8);
+	}
+
+	// 设备不接受 4K 块时退回更小的块；接收溢出后缩小窗口从已写出的位置续读
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 200,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+			.stream_max_block = 1024,
+			.stream_overrun_block = 20,
+	};
+	const uint32_t size = 64 * 1024 + 5;
+	CHECK(read_stream(&config, size, 0, 0, &stats) > 0);
+	CHECK(stats.stream_blocks > (size + 1023) / 1024);
+	return true;
+}
+
+static bool
+test_read_stream_slow_writer(void)
+{
+	const uint32_t size = 256 * 1024;
+	const uint32_t line = 3000000 / 10;
+	fake_burner_stats_t stats;
+
+	// 以 1K 块读取时设备窗口只够 200ms 左右，写盘停顿 600ms 期间仍须继续确认，
+	// 不让设备停发，总耗时应接近线速
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 200,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = line,
+			.stream_max_block = 1024,
+	};
+	int64_t elapsed = read_stream(&config, size, 20, 600, &stats);
+	CHECK(elapsed > 0);
+	printf("stream read at 3 Mbaud with a 600 ms writer stall: %lld ms\n", (long long)elapsed);
+	CHECK(elapsed < (int64_t)size * 1000 / line + 200);
+	return true;
+}
+
+// 按 CHIP_VENUS 以 READ_FLASH 逐块读取，返回耗时（毫秒），失败返回 -1
+static int64_t
+read_legacy(uint32_t size, uint32_t drop_read, fake_burner_stats_t *stats)
+{
+	int64_t elapsed = -1;
+	cskburn_serial_device_t *dev = NULL;
+	uint8_t md5[16], expected_md5[16];
+
+	// 3 Mbaud，每个应答延迟 1ms
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 1000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+			.drop_read = drop_read,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	if (fake == NULL) {
+		return -1;
+	}
+
+	uint8_t *flash = fake_burner_flash(fake);
+	for (uint32_t i = 0; i < size; i++) {
+		flash[READ_ADDR + i] = (i % 53 == 0) ? 0xDB : (uint8_t)(i * 7 + (i >> 8));
+	}
+	mbedtls_md5(flash + READ_ADDR, size, expected_md5);
+
+	sink_t sink = {.buf = malloc(size), .size = size};
+	writer_t writer = {.write = sink_write, .ctx = &sink};
+
+	if (cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUS, 0) == 0) {
+		uint64_t t1 = time_monotonic();
+		int ret = cskburn_serial_read(dev, TARGET_FLASH, READ_ADDR, size, &writer, md5, NULL);
+		uint64_t t2 = time_monotonic();
+		if (ret == 0 && sink.len == size && memcmp(sink.buf, flash + READ_ADDR, size) == 0 &&
+				memcmp(md5, expected_md5, sizeof(md5)) == 0) {
+			elapsed = (int64_t)(t2 - t1);
+		} else {
+			fprintf(stderr, "legacy read failed: %d, %u bytes\n", ret, sink.len);
+		}
+		cskburn_serial_close(&dev);
+	}
+
+	fake_burner_stop(fake);
+	fake_burner_stats(fake, stats);
+	free(sink.buf);
+	fake_burner_free(&fake);
+	return elapsed;
+}
+
+static bool
+test_read_legacy(void)
+{
+	const uint32_t size = 128 * 1024 + 37;
+	fake_burner_stats_t stats;
+
+	// 应答延迟 1ms 时逐个请求约 50 KB/s，保持多个请求在途应接近 3 Mbaud 的线速
+	int64_t elapsed = read_legacy(size, 0, &stats);
+	CHECK(elapsed > 0);
+	printf("legacy read at 3 Mbaud: %lld ms (%.0f KB/s)\n", (long long)elapsed,
+			size / 1024.0 / elapsed * 1000);
+	CHECK(size / 1024.0 / elapsed * 1000 > 150);
+
+	// 应答丢失后从最早未完成的请求重新读取，数据仍须完整有序
+	elapsed = read_legacy(size, 100, &stats);
+	CHECK(elapsed > 0);
+	CHECK(stats.reads > (size + 63) / 64);
+	return true;
+}
+
+// 在 target 上探测波特率，返回 cskburn_serial_probe_baud() 的结果
+static int
+probe_baud(cskburn_serial_target_t target, uint32_t flash_size, uint32_t max_baud,
+		uint32_t *baud, uint32_t *speed)
+{
+	const uint32_t candidates[] = {921600, 1500000, 2000000, 3000000};
+	cskburn_serial_device_t *dev = NULL;
+
+	fake_burner_config_t config = {
+			.flash_size = flash_size,
+			.latency_us = 100,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.pace_baud = true,
+			.max_baud = max_baud,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	if (fake == NULL) {
+		return -ENOMEM;
+	}
+	if (cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 1000) != 0 ||
+			cskburn_serial_connect(dev, 0, 1000, CSKBURN_RESET_RTS_BOOT) != 0) {
+		cskburn_serial_close(&dev);
+		fake_burner_free(&fake);
+		return -EIO;
+	}
+
+	int ret = cskburn_serial_probe_baud(
+			dev, target, candidates, sizeof(candidates) / sizeof(candidates[0]), baud, speed);
+
+	// 探测结束后设备仍可正常通信
+	uint8_t id[8];
+	if (cskburn_serial_read_chip_id(dev, id) != 0) {
+		ret = -CSKBURN_ERR_BAUD_SYNC_LOST;
+	}
+
+	cskburn_serial_close(&dev);
+	fake_burner_free(&fake);
+	return ret;
+}
+
+static bool
+test_probe_baud(void)
+{
+	uint32_t baud = 0, speed = 0;
+
+	CHECK(probe_baud(TARGET_FLASH, FLASH_SIZE, 0, &baud, &speed) == 0);
+	CHECK(baud == 3000000);
+	printf("probed baud %u, %u KB/s\n", baud, speed / 1024);
+	CHECK(speed > 3000000 / 10 / 2);
+
+	// 2 Mbaud 以上数据出错，应回落到 2 Mbaud
+	CHECK(probe_baud(TARGET_FLASH, FLASH_SIZE, 2000000, &baud, &speed) == 0);
+	CHECK(baud == 2000000);
+	printf("probed baud %u with unstable link above 2M, %u KB/s\n", baud, speed / 1024);
+
+	// 任何候选都不稳定时保持初始波特率
+	CHECK(probe_baud(TARGET_FLASH, FLASH_SIZE, 115200, &baud, &speed) == 0);
+	CHECK(baud == 115200);
+
+	// NAND 等目标无从回读 flash，以同步往返检查链路
+	CHECK(probe_baud(TARGET_NAND, FLASH_SIZE, 0, &baud, &speed) == 0);
+	CHECK(baud == 3000000);
+	printf("probed baud %u by loopback, %u KB/s\n", baud, speed / 1024);
+
+	// 初始波特率下回读不到基准时一个候选都无法检查，须报错而不是停在初始波特率
+	CHECK(probe_baud(TARGET_FLASH, 4 * 1024, 0, &baud, &speed) == -CSKBURN_ERR_BAUD_PROBE_FAILED);
+	return true;
+}
+
+static bool
+test_enter(void)
+{
+	cskburn_serial_device_t *dev = NULL;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 100,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.boot_ms = 50,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	CHECK(fake != NULL);
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 0) == 0);
+	CHECK(cskburn_serial_connect(dev, 0, 1000, CSKBURN_RESET_RTS_BOOT) == 0);
+
+	uint64_t t1 = time_monotonic();
+	int ret = cskburn_serial_enter(dev, 921600, NULL, 0);
+	uint64_t t2 = time_monotonic();
+
+	cskburn_serial_close(&dev);
+	fake_burner_free(&fake);
+
+	printf("entered burner with 50 ms boot time in %llu ms\n", (unsigned long long)(t2 - t1));
+
+	// burner 一应答即继续，不再固定等待 700ms
+	CHECK(ret == 0);
+	CHECK(t2 - t1 < 500);
+	return true;
+}
+
+// 返回上传 burner 的耗时（毫秒），失败返回 -1。block_size 返回 ROM 最终接受的块大小。
+// baud 非 0 时覆盖主机记录的波特率：pty 不受波特率影响，只改变主机估算的传输时间
+static int64_t
+upload_burner(uint32_t rom_max_block, bool rom_drop_large, uint32_t baud, uint32_t *block_size)
+{
+	int64_t elapsed = -1;
+	cskburn_serial_device_t *dev = NULL;
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 10000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.rom = true,
+			.rom_max_block = rom_max_block,
+			.rom_drop_large = rom_drop_large,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	if (fake == NULL) {
+		return -1;
+	}
+
+	if (cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 0) == 0 &&
+			cskburn_serial_connect(dev, 0, 1000, CSKBURN_RESET_RTS_BOOT) == 0) {
+		if (baud != 0) {
+			dev->baud = baud;
+		}
+		uint64_t t1 = time_monotonic();
+		if (cskburn_serial_enter(dev, 115200, NULL, 0) == 0) {
+			elapsed = (int64_t)(time_monotonic() - t1);
+		}
+	}
+
+	if (dev != NULL) {
+		cskburn_serial_close(&dev);
+	}
+	fake_burner_stop(fake);
+	fake_burner_stats(fake, &stats);
+	fake_burner_free(&fake);
+	*block_size = stats.mem_block_size;
+	return elapsed;
+}
+
+static bool
+test_burner_block_size(void)
+{
+	uint32_t block_size;
+
+	// 每个应答耗时 10ms 的 ROM 上，较大的 RAM 块应明显减少上传耗时
+	core_forget_ram_block_sizes();
+	int64_t large_ms = upload_burner(0, false, 0, &block_size);
+	CHECK(large_ms > 0 && block_size == 4096);
+
+	// ROM 在 MEM_BEGIN 即拒绝较大的块时退回默认块大小，此后同一芯片直接使用默认块大小
+	core_forget_ram_block_sizes();
+	CHECK(upload_burner(2048, false, 0, &block_size) > 0 && block_size == 2048);
+	int64_t small_ms = upload_burner(0, false, 0, &block_size);
+	CHECK(small_ms > 0 && block_size == 2048);
+
+	printf("burner upload with 2K blocks: %lld ms, with 4K blocks: %lld ms\n",
+			(long long)small_ms, (long long)large_ms);
+	CHECK(large_ms * 4 < small_ms * 3);
+
+	// ROM 直接丢弃较大的块而不应答时，只多等待该块在 921600 下的传输时间加少许余量，
+	// 远少于 TIMEOUT_MEM_DATA；之后的上传不再试探
+	core_forget_ram_block_sizes();
+	int64_t probe_ms = upload_burner(2048, true, 921600, &block_size);
+	CHECK(probe_ms > 0 && block_size == 2048);
+	int64_t cached_ms = upload_burner(2048, true, 921600, &block_size);
+	CHECK(cached_ms > 0 && block_size == 2048);
+
+	printf("burner upload on a ROM dropping 4K blocks: %lld ms, then %lld ms\n",
+			(long long)probe_ms, (long long)cached_ms);
+	CHECK(probe_ms - cached_ms < 400);
+	CHECK(cached_ms * 4 < probe_ms * 3);
+	return true;
+}
+
+extern const uint8_t burner_serial_venusa[];
+extern const uint32_t burner_serial_venusa_len;
+
+// 上传 burner 后检查 ROM 收到的 RAM 内容，mem_bytes 返回实际传输的载荷字节数
+static bool
+load_burner_ram(bool rom_inflate, uint32_t *mem_bytes)
+{
+	cskburn_serial_device_t *dev = NULL;
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 100,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.rom = true,
+			.rom_inflate = rom_inflate,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	CHECK(fake != NULL);
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 0) == 0);
+	CHECK(cskburn_serial_connect(dev, 0, 1000, CSKBURN_RESET_RTS_BOOT) == 0);
+	int ret = cskburn_serial_enter(dev, 115200, NULL, 0);
+	cskburn_serial_close(&dev);
+
+	fake_burner_stop(fake);
+	fake_burner_stats(fake, &stats);
+	uint32_t ram_len;
+	const uint8_t *ram = fake_burner_ram(fake, &ram_len);
+	bool same = ram_len == burner_serial_venusa_len &&
+				memcmp(ram, burner_serial_venusa, ram_len) == 0;
+	fake_burner_free(&fake);
+
+	CHECK(ret == 0);
+	CHECK(same);
+	*mem_bytes = stats.mem_bytes;
+	return true;
+}
+
+static bool
+test_burner_ram(void)
+{
+	uint32_t mem_bytes;
+
+	CHECK(load_burner_ram(false, &mem_bytes));
+	CHECK(mem_bytes == burner_serial_venusa_len);
+
+#if FAKE_BURNER_INFLATE
+	// 嵌入了压缩副本且 ROM 支持解压时，只传输压缩后的数据
+	CHECK(load_burner_ram(true, &mem_bytes));
+	printf("burner uploaded as %u deflated bytes instead of %u\n", mem_bytes,
+			burner_serial_venusa_len);
+	CHECK(mem_bytes < burner_serial_venusa_len);
+#endif
+	return true;
+}
+
+static bool
+test_attach(void)
+{
+	cskburn_serial_device_t *dev = NULL;
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 100,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.rom = true,
+	};
+
+	// 设备仍在 ROM 中时不得误认为 burner 已常驻
+	fake_burner_t *fake = fake_burner_start(&config);
+	CHECK(fake != NULL);
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 0) == 0);
+	CHECK(cskburn_serial_attach(dev, 921600) != 0);
+	CHECK(cskburn_serial_connect(dev, 0, 1000, CSKBURN_RESET_RTS_BOOT) == 0);
+	CHECK(cskburn_serial_enter(dev, 921600, NULL, 0) == 0);
+	cskburn_serial_close(&dev);
+
+	// 再次连接时直接复用常驻的 burner，不再上传
+	fake_burner_stats(fake, &stats);
+	uint32_t frames = stats.frames;
+
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 0) == 0);
+	uint64_t t1 = time_monotonic();
+	int ret = cskburn_serial_attach(dev, 921600);
+	uint64_t t2 = time_monotonic();
+
+	uint8_t id[8];
+	bool alive = cskburn_serial_read_chip_id(dev, id) == 0;
+
+	cskburn_serial_close(&dev);
+	fake_burner_stats(fake, &stats);
+	fake_burner_free(&fake);
+
+	printf("attached to running burner in %llu ms\n", (unsigned long long)(t2 - t1));
+
+	CHECK(ret == 0);
+	CHECK(alive);
+	CHECK(stats.frames - frames < 10);
+	return true;
+}
+
+int
+main(void)
+{
+	set_log_level(LOGLEVEL_ERROR);
+
+	if (!test_read_stream() || !test_read_stream_tuning() || !test_read_stream_slow_writer() ||
+			!test_read_legacy() || !test_probe_baud() || !test_enter() || !test_attach() ||
+			!test_burner_block_size() || !test_burner_ram()) {
+		return 1;
+	}
+	puts("serial read tests passed");
+	return 0;
+}
@@ -0,0 +1,744 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "cskburn_serial.h"
+#include "fake_burner.h"
+#include "log.h"
+#include "mbedtls/md5.h"
+#include "memio.h"
+#include "time_monotonic.h"
+
+#define CHECK(expr)                                                                             \
+	do {                                                                                        \
+		if (!(expr)) {                                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr);          \
+			return false;                                                                       \
+		}                                                                                       \
+	} while (0)
+
+#define FLASH_SIZE (4 * 1024 * 1024)
+#define WRITE_ADDR 0x10000
+
+static uint8_t *
+make_image(uint32_t size)
+{
+	uint8_t *image = malloc(size);
+	uint32_t state = 0x12345678;
+	for (uint32_t i = 0; i < size; i++) {
+		state = state * 1103515245 + 12345;
+		image[i] = state >> 16;
+	}
+	// 混入 SLIP 特殊字节，覆盖转义路径
+	for (uint32_t i = 0; i < size; i += 97) {
+		image[i] = (i & 1) ? 0xC0 : 0xDB;
+	}
+	return image;
+}
+
+// 随附的 burner 均不支持以下指令，测试时替换设备的 burner_info
+static const struct cskburn_serial_burner_info write_stream_burner = {
+		.load_addr = 0x20050000,
+		.supports_read_flash_stream = true,
+		.supports_write_flash_stream = true,
+};
+
+static const struct cskburn_serial_burner_info flash_lz_burner = {
+		.load_addr = 0x20050000,
+		.supports_read_flash_stream = true,
+		.supports_flash_lz_data = true,
+};
+
+static const struct cskburn_serial_burner_info cobs_burner = {
+		.load_addr = 0x20050000,
+		.supports_read_flash_stream = true,
+		.supports_cobs_framing = true,
+};
+
+static const struct cskburn_serial_burner_info block_16k_burner = {
+		.load_addr = 0x20050000,
+		.max_flash_block = 16 * 1024,
+		.supports_read_flash_stream = true,
+};
+
+static const struct cskburn_serial_burner_info block_32k_burner = {
+		.load_addr = 0x20050000,
+		.max_flash_block = 32 * 1024,
+		.supports_read_flash_stream = true,
+};
+
+static const struct cskburn_serial_burner_info hash_map_burner = {
+		.load_addr = 0x20050000,
+		.supports_read_flash_stream = true,
+		.supports_flash_hash_map = true,
+};
+
+static const struct cskburn_serial_burner_info seq_echo_burner = {
+		.load_addr = 0x20050000,
+		.supports_read_flash_stream = true,
+		.supports_seq_echo = true,
+};
+
+// 按给定窗口写入 image，burner 非 NULL 时替换设备的 burner_info，返回耗时（毫秒），失败返回 -1
+static int64_t
+burn(const fake_burner_config_t *config, uint32_t window, bool skip_blank,
+		const struct cskburn_serial_burner_info *burner, int32_t timeout, const uint8_t *image, uint32_t size, fake_burner_stats_t *stats)
+{
+	int64_t elapsed = -1;
+	cskburn_serial_device_t *dev = NULL;
+	reader_t *reader = NULL;
+
+	fake_burner_t *fake = fake_burner_start(config);
+	if (fake == NULL) {
+		fprintf(stderr, "failed to start fake burner\n");
+		return -1;
+	}
+
+	if (cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, timeout) != 0) {
+		fprintf(stderr, "failed to open %s\n", fake_burner_path(fake));
+		goto exit;
+	}
+
+	if (cskburn_serial_set_write_window(dev, window) != 0) {
+		goto exit;
+	}
+	cskburn_serial_set_skip_blank(dev, skip_blank);
+	// 替换 burner_info 后重新接入 burner，按其能力协商帧格式
+	if (burner != NULL) {
+		dev->burner_info = burner;
+		if (cskburn_serial_attach(dev, 3000000) != 0) {
+			fprintf(stderr, "failed to attach to %s\n", fake_burner_path(fake));
+			goto exit;
+		}
+	}
+
+	reader = memreader_alloc(size);
+	memreader_feed(reader, image, size);
+
+	uint64_t t1 = time_monotonic();
+	int ret = cskburn_serial_write(dev, TARGET_FLASH, WRITE_ADDR, reader, 0, NULL);
+	uint64_t t2 = time_monotonic();
+	if (ret != 0) {
+		fprintf(stderr, "write with window %u failed: %d\n", window, ret);
+		goto exit;
+	}
+
+	fake_burner_stop(fake);
+	if (memcmp(fake_burner_flash(fake) + WRITE_ADDR, image, size) != 0) {
+		fprintf(stderr, "flash content mismatch with window %u\n", window);
+		goto exit;
+	}
+
+	fake_burner_stats(fake, stats);
+	elapsed = (int64_t)(t2 - t1);
+
+exit:
+	if (reader != NULL) {
+		reader->close(&reader);
+	}
+	if (dev != NULL) {
+		cskburn_serial_close(&dev);
+	}
+	fake_burner_free(&fake);
+	return elapsed;
+}
+
+static bool
+test_write_window(void)
+{
+	const uint32_t size = 512 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 2000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+	};
+
+	int64_t serial_ms = burn(&config, 1, false, NULL, 1000, image, size, &stats);
+	CHECK(serial_ms > 0);
+	CHECK(stats.max_in_flight == 1);
+
+	int64_t window_ms = burn(&config, 8, false, NULL, 1000, image, size, &stats);
+	CHECK(window_ms > 0);
+	CHECK(stats.max_in_flight > 1);
+
+	printf("window 1: %lld ms (%.0f KB/s), window 8: %lld ms (%.0f KB/s)\n",
+			(long long)serial_ms, size / 1024.0 / serial_ms * 1000, (long long)window_ms,
+			size / 1024.0 / window_ms * 1000);
+
+	free(image);
+
+	CHECK(window_ms * 2 < serial_ms);
+	return true;
+}
+
+static bool
+test_write_retransmit(void)
+{
+	const uint32_t size = 256 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 500,
+			.queue_full_seq = 5,
+			.drop_seq = 40,
+	};
+
+	int64_t elapsed = burn(&config, 8, false, NULL, 200, image, size, &stats);
+	CHECK(elapsed > 0);
+	CHECK(stats.flash_blocks > size / 4096);
+
+	// 迟到的出错应答须在重发之前被清除，不能算作重发块的应答而引起多余的重发
+	config.queue_full_seq = -1;
+	config.drop_seq = -1;
+	config.late_block = 20;
+	CHECK(burn(&config, 1, false, NULL, 200, image, size, &stats) > 0);
+	CHECK(stats.flash_blocks == size / 4096);
+
+	free(image);
+	return true;
+}
+
+static bool
+test_write_adaptive_timeout(void)
+{
+	const uint32_t size = 256 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 500,
+			.queue_full_seq = -1,
+			.drop_seq = 40,
+	};
+
+	// 未指定超时时，丢失的应答应在数倍往返时间后即被重发，而非等满固定的 1 秒
+	int64_t elapsed = burn(&config, 8, false, NULL, 0, image, size, &stats);
+	free(image);
+
+	CHECK(elapsed > 0);
+	CHECK(stats.flash_blocks > size / 4096);
+	CHECK(elapsed < 600);
+	return true;
+}
+
+static bool
+test_write_skip_blank(void)
+{
+	const uint32_t size = 300 * 1024 + 100;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	// 块 0、3-10、70 以及末尾不足一块的部分为空白
+	const uint32_t blank[] = {0, 3, 4, 5, 6, 7, 8, 9, 10, 70, 75};
+	for (uint32_t i = 0; i < sizeof(blank) / sizeof(blank[0]); i++) {
+		uint32_t offset = blank[i] * 4096;
+		memset(image + offset, 0xFF, size - offset < 4096 ? size - offset : 4096);
+	}
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 200,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+	};
+
+	int64_t elapsed = burn(&config, 4, true, NULL, 1000, image, size, &stats);
+	CHECK(elapsed >= 0);
+	CHECK(stats.flash_blocks == 76 - sizeof(blank) / sizeof(blank[0]));
+	// 只在空白块处断开：块 1-2、11-69、71-74 各写一段
+	CHECK(stats.flash_begins == 3);
+	free(image);
+
+	// 没有空白块的镜像一次写完，不因长度分段
+	image = make_image(size);
+	CHECK(burn(&config, 4, true, NULL, 1000, image, size, &stats) >= 0);
+	CHECK(stats.flash_blocks == 76);
+	CHECK(stats.flash_begins == 1);
+	free(image);
+	return true;
+}
+
+static bool
+test_write_stream(void)
+{
+	const uint32_t size = 512 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	// 3 Mbaud，往返延迟 4ms，接近常见 USB 串口的轮询间隔
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 4000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+			.write_stream_window = 8,
+	};
+
+	int64_t block_ms = burn(&config, 1, false, NULL, 1000, image, size, &stats);
+	CHECK(block_ms > 0);
+
+	int64_t stream_ms = burn(&config, 1, false, &write_stream_burner, 1000, image, size, &stats);
+	CHECK(stream_ms > 0);
+	CHECK(stats.flash_blocks == 0);
+	CHECK(stats.write_stream_frames == size / 4096);
+
+	printf("FLASH_DATA: %lld ms (%.0f KB/s), write stream: %lld ms (%.0f KB/s)\n",
+			(long long)block_ms, size / 1024.0 / block_ms * 1000, (long long)stream_ms,
+			size / 1024.0 / stream_ms * 1000);
+	CHECK(stream_ms * 5 < block_ms * 4);
+
+	// 残帧中止流式写入后，从已确认的位置重新开始
+	config.write_stream_bad_frame = 50;
+	CHECK(burn(&config, 1, false, &write_stream_burner, 200, image, size, &stats) > 0);
+	CHECK(stats.write_stream_frames > size / 4096);
+
+	// 重新开始时设备声明更小的窗口，已读入但未确认的块仍须按原位置重发
+	config.write_stream_resume_window = 3;
+	CHECK(burn(&config, 1, false, &write_stream_burner, 200, image, size, &stats) > 0);
+	CHECK(stats.write_stream_frames > size / 4096);
+	config.write_stream_bad_frame = 0;
+	config.write_stream_resume_window = 0;
+
+	// 设备不支持流式写入时退回逐块写入
+	config.write_stream_window = 0;
+	CHECK(burn(&config, 1, false, &write_stream_burner, 1000, image, size, &stats) > 0);
+	CHECK(stats.flash_blocks == size / 4096);
+
+	free(image);
+	return true;
+}
+
+// 一半为重复的表格数据（可压缩），一半为随机数据（不可压缩）
+static uint8_t *
+make_mixed_image(uint32_t size)
+{
+	uint8_t *image = make_image(size);
+	for (uint32_t block = 0; block < size; block += 4096 * 2) {
+		for (uint32_t i = 0; i < 4096; i++) {
+			image[block + i] = (uint8_t)((i % 64) < 48 ? i / 64 : 0xFF);
+		}
+	}
+	return image;
+}
+
+static bool
+test_write_compressed(void)
+{
+	const uint32_t size = 512 * 1024;
+	uint8_t *image = make_mixed_image(size);
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 4000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+			.flash_lz = true,
+	};
+
+	int64_t raw_ms = burn(&config, 8, false, NULL, 1000, image, size, &stats);
+	CHECK(raw_ms > 0);
+	CHECK(stats.lz_blocks == 0);
+
+	int64_t lz_ms = burn(&config, 8, false, &flash_lz_burner, 1000, image, size, &stats);
+	CHECK(lz_ms > 0);
+	// 随机数据的块压缩无益，按原始数据发送
+	CHECK(stats.lz_blocks == size / 4096 / 2);
+	CHECK(stats.flash_blocks == size / 4096);
+
+	printf("FLASH_DATA: %lld ms (%.0f KB/s), FLASH_LZ_DATA: %lld ms (%.0f KB/s)\n",
+			(long long)raw_ms, size / 1024.0 / raw_ms * 1000, (long long)lz_ms,
+			size / 1024.0 / lz_ms * 1000);
+	CHECK(lz_ms * 5 < raw_ms * 4);
+
+	// 设备不支持压缩块时退回原始数据
+	config.flash_lz = false;
+	CHECK(burn(&config, 8, false, &flash_lz_burner, 1000, image, size, &stats) > 0);
+	CHECK(stats.lz_blocks == 0);
+	CHECK(stats.flash_blocks == size / 4096);
+
+	free(image);
+	return true;
+}
+
+static bool
+test_write_cobs(void)
+{
+	const uint32_t size = 256 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	// 查找表之类的数据中 0xC0/0xDB 密集，SLIP 转义后接近翻倍
+	for (uint32_t i = 0; i < size / 2; i++) {
+		image[i] = (i & 1) ? 0xC0 : 0xDB;
+	}
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 4000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+			.cobs = true,
+	};
+
+	int64_t slip_ms = burn(&config, 8, false, NULL, 1000, image, size, &stats);
+	CHECK(slip_ms > 0);
+	uint32_t slip_bytes = stats.rx_bytes;
+
+	int64_t cobs_ms = burn(&config, 8, false, &cobs_burner, 1000, image, size, &stats);
+	CHECK(cobs_ms > 0);
+	uint32_t cobs_bytes = stats.rx_bytes;
+
+	printf("SLIP: %lld ms, %u bytes; COBS: %lld ms, %u bytes\n", (long long)slip_ms,
+			slip_bytes, (long long)cobs_ms, cobs_bytes);
+	// COBS 每 254 字节至多多出 1 字节，余下为命令头
+	CHECK(cobs_bytes < size + size / 64);
+	CHECK(cobs_ms * 5 < slip_ms * 4);
+
+	// 设备不支持时保持 SLIP
+	config.cobs = false;
+	CHECK(burn(&config, 8, false, &cobs_burner, 1000, image, size, &stats) > 0);
+	CHECK(stats.rx_bytes >= slip_bytes);
+
+	free(image);
+	return true;
+}
+
+static bool
+test_write_block_size(void)
+{
+	const uint32_t size = 512 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 4000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+			.max_flash_block = 32 * 1024,
+	};
+
+	const struct cskburn_serial_burner_info *burners[] = {
+			NULL, &block_16k_burner, &block_32k_burner};
+	const uint32_t block_sizes[] = {4 * 1024, 16 * 1024, 32 * 1024};
+	const uint32_t windows[] = {1, 8};
+	int64_t elapsed[2][3];
+
+	for (uint32_t w = 0; w < 2; w++) {
+		for (uint32_t b = 0; b < 3; b++) {
+			elapsed[w][b] = burn(&config, windows[w], false, burners[b], 1000, image, size, &stats);
+			CHECK(elapsed[w][b] > 0);
+			CHECK(stats.flash_block_size == block_sizes[b]);
+			CHECK(stats.flash_blocks == size / stats.flash_block_size);
+			printf("window %u, %u byte blocks: %lld ms (%.0f KB/s)\n", windows[w],
+					stats.flash_block_size, (long long)elapsed[w][b],
+					size / 1024.0 / elapsed[w][b] * 1000);
+		}
+	}
+
+	// 逐块等待应答时，每块的往返时间被更多的数据分摊
+	CHECK(elapsed[0][2] * 10 < elapsed[0][0] * 9);
+
+	// burner 声明的块大于设备实际接受的块时逐步减小
+	config.max_flash_block = 16 * 1024;
+	CHECK(burn(&config, 8, false, &block_32k_burner, 1000, image, size, &stats) > 0);
+	CHECK(stats.flash_block_size == 16 * 1024);
+
+	free(image);
+	return true;
+}
+
+// 以 3 Mbaud 进入 burner 后按给定窗口写入 image，返回写入是否成功
+static bool
+write_at_3m(const fake_burner_config_t *config, uint32_t window, const uint8_t *image,
+		uint32_t size, fake_burner_stats_t *stats)
+{
+	cskburn_serial_device_t *dev = NULL;
+
+	fake_burner_t *fake = fake_burner_start(config);
+	CHECK(fake != NULL);
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 1000) == 0);
+	CHECK(cskburn_serial_set_write_window(dev, window) == 0);
+	CHECK(cskburn_serial_connect(dev, 0, 1000, CSKBURN_RESET_RTS_BOOT) == 0);
+	CHECK(cskburn_serial_enter(dev, 3000000, NULL, 0) == 0);
+
+	reader_t *reader = memreader_alloc(size);
+	memreader_feed(reader, image, size);
+	int ret = cskburn_serial_write(dev, TARGET_FLASH, WRITE_ADDR, reader, 0, NULL);
+	reader->close(&reader);
+	cskburn_serial_close(&dev);
+
+	fake_burner_stop(fake);
+	fake_burner_stats(fake, stats);
+	bool same = memcmp(fake_burner_flash(fake) + WRITE_ADDR, image, size) == 0;
+	fake_burner_free(&fake);
+	return ret == 0 && same;
+}
+
+static bool
+test_write_downshift(void)
+{
+	const uint32_t size = 256 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+
+	// 1.5 Mbaud 以上数据帧全部校验失败，而同步与切换波特率仍能成功
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 200,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.pace_baud = true,
+			.max_baud = 1500000,
+	};
+
+	// 在同一次 FLASH_BEGIN 中逐级降低波特率，从出错的块继续写入
+	const uint32_t windows[] = {1, 8};
+	for (uint32_t w = 0; w < 2; w++) {
+		CHECK(write_at_3m(&config, windows[w], image, size, &stats));
+		CHECK(stats.baud == 1500000);
+		CHECK(stats.flash_blocks == size / 4096);
+	}
+
+	// 降到初始波特率仍然出错时放弃
+	config.max_baud = 57600;
+	CHECK(!write_at_3m(&config, 8, image, size, &stats));
+	CHECK(stats.baud == 115200);
+
+	free(image);
+	return true;
+}
+
+// 取得 [HASH_ADDR, HASH_ADDR + size) 各块的 MD5，burner 非 NULL 时替换设备的 burner_info，返回耗时（毫秒），失败返回 -1
+static int64_t
+hash_map(const fake_burner_config_t *config, const struct cskburn_serial_burner_info *burner,
+		const uint8_t *image, uint32_t size, uint32_t chunk_size, uint8_t *digests,
+		fake_burner_stats_t *stats)
+{
+	int64_t elapsed = -1;
+	cskburn_serial_device_t *dev = NULL;
+
+	fake_burner_t *fake = fake_burner_start(config);
+	if (fake == NULL) {
+		fprintf(stderr, "failed to start fake burner\n");
+		return -1;
+	}
+	memcpy(fake_burner_flash(fake) + WRITE_ADDR, image, size);
+
+	if (cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 200) != 0) {
+		fprintf(stderr, "failed to open %s\n", fake_burner_path(fake));
+		goto exit;
+	}
+	if (burner != NULL) {
+		dev->burner_info = burner;
+		if (cskburn_serial_attach(dev, 3000000) != 0) {
+			fprintf(stderr, "failed to attach to %s\n", fake_burner_path(fake));
+			goto exit;
+		}
+	}
+
+	uint64_t t1 = time_monotonic();
+	int ret = cskburn_serial_hash_map(dev, WRITE_ADDR, size, chunk_size, digests);
+	uint64_t t2 = time_monotonic();
+	if (ret != 0) {
+		fprintf(stderr, "hash map failed: %d\n", ret);
+		goto exit;
+	}
+
+	fake_burner_stop(fake);
+	fake_burner_stats(fake, stats);
+	elapsed = (int64_t)(t2 - t1);
+
+exit:
+	if (dev != NULL) {
+		cskburn_serial_close(&dev);
+	}
+	fake_burner_free(&fake);
+	return elapsed;
+}
+
+static bool
+test_hash_map(void)
+{
+	const uint32_t size = 1024 * 1024 + 1000;
+	const uint32_t chunk_size = 4096;
+	const uint32_t chunks = (size + chunk_size - 1) / chunk_size;
+	uint8_t *image = make_image(size);
+	uint8_t *expected = malloc(chunks * 16);
+	uint8_t *digests = malloc(chunks * 16);
+	fake_burner_stats_t stats;
+
+	for (uint32_t i = 0; i < chunks; i++) {
+		uint32_t length = size - chunk_size * i < chunk_size ? size - chunk_size * i : chunk_size;
+		mbedtls_md5(image + chunk_size * i, length, expected + 16 * i);
+	}
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 2000,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.link_bytes_per_sec = 3000000 / 10,
+			.hash_map = true,
+	};
+
+	// 逐块请求，每块都要等一个往返
+	memset(digests, 0, chunks * 16);
+	int64_t per_chunk = hash_map(&config, NULL, image, size, chunk_size, digests, &stats);
+	CHECK(per_chunk > 0);
+	CHECK(memcmp(digests, expected, chunks * 16) == 0);
+	CHECK(stats.md5_requests == chunks);
+	CHECK(stats.hash_maps == 0);
+
+	// 一次请求取回全部摘要
+	memset(digests, 0, chunks * 16);
+	int64_t batched = hash_map(&config, &hash_map_burner, image, size, chunk_size, digests, &stats);
+	CHECK(batched > 0);
+	CHECK(memcmp(digests, expected, chunks * 16) == 0);
+	CHECK(stats.md5_requests == 0);
+	CHECK(stats.hash_maps == 1);
+
+	printf("hash map of %u chunks: %lld ms per chunk, %lld ms batched\n", chunks,
+			(long long)per_chunk, (long long)batched);
+	CHECK(batched * 4 < per_chunk);
+
+	// 丢失摘要帧后退回逐块请求，结果不变
+	config.hash_map_drop_frame = 2;
+	memset(digests, 0, chunks * 16);
+	CHECK(hash_map(&config, &hash_map_burner, image, size, chunk_size, digests, &stats) > 0);
+	CHECK(memcmp(digests, expected, chunks * 16) == 0);
+	CHECK(stats.hash_maps == 1);
+	CHECK(stats.md5_requests == chunks);
+
+	// burner 声明支持但设备拒绝时同样逐块请求
+	config.hash_map = false;
+	config.hash_map_drop_frame = 0;
+	memset(digests, 0, chunks * 16);
+	CHECK(hash_map(&config, &hash_map_burner, image, size, chunk_size, digests, &stats) > 0);
+	CHECK(memcmp(digests, expected, chunks * 16) == 0);
+	CHECK(stats.md5_requests == chunks);
+
+	free(digests);
+	free(expected);
+	free(image);
+	return true;
+}
+
+static bool
+test_stale_frames(void)
+{
+	cskburn_serial_device_t *dev = NULL;
+	uint8_t md5[16];
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 200,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.stale_frames = true,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	CHECK(fake != NULL);
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 200) == 0);
+
+	// 迟到的无关应答须被丢弃，而不是被当作本次 MD5 的结果
+	const uint8_t blank_4k_md5[16] = {0x6a, 0xe5, 0x9e, 0x64, 0x85, 0x03, 0x77, 0xee, 0x54, 0x70,
+			0xc8, 0x54, 0x76, 0x15, 0x51, 0xea};
+	for (int i = 0; i < 4; i++) {
+		CHECK(cskburn_serial_verify(dev, TARGET_FLASH, 0x1000 * i, 0x1000, md5) == 0);
+		CHECK(memcmp(md5, blank_4k_md5, sizeof(md5)) == 0);
+	}
+
+	cskburn_serial_close(&dev);
+	fake_burner_free(&fake);
+	return true;
+}
+
+static bool
+test_seq_echo(void)
+{
+	cskburn_serial_device_t *dev = NULL;
+	uint8_t md5[16];
+	uint32_t flash_id;
+	uint64_t flash_size;
+
+	fake_burner_config_t config = {
+			.flash_size = FLASH_SIZE,
+			.latency_us = 200,
+			.queue_full_seq = -1,
+			.drop_seq = -1,
+			.stale_frames = true,
+			// 第 1 个 READ_FLASH_ID 来自 attach
+			.late_flash_id = 2,
+			.seq_echo = true,
+	};
+
+	fake_burner_t *fake = fake_burner_start(&config);
+	CHECK(fake != NULL);
+	CHECK(cskburn_serial_open(&dev, fake_burner_path(fake), CHIP_VENUSA, 200) == 0);
+	dev->burner_info = &seq_echo_burner;
+	CHECK(cskburn_serial_attach(dev, 3000000) == 0);
+
+	// 超时的 READ_FLASH_ID 的应答迟到，op 与长度均相同，只能凭序号识别并丢弃
+	CHECK(cskburn_serial_get_flash_info(dev, &flash_id, &flash_size) != 0);
+	int ret = -1;
+	for (int i = 0; i < 4 && ret != 0; i++) {
+		ret = cskburn_serial_get_flash_info(dev, &flash_id, &flash_size);
+	}
+	CHECK(ret == 0);
+	CHECK(flash_id == 0x164020 && flash_size == 4 * 1024 * 1024);
+	CHECK(cskburn_serial_get_flash_info(dev, &flash_id, &flash_size) == 0);
+	CHECK(flash_id == 0x164020);
+
+	const uint8_t blank_4k_md5[16] = {0x6a, 0xe5, 0x9e, 0x64, 0x85, 0x03, 0x77, 0xee, 0x54, 0x70,
+			0xc8, 0x54, 0x76, 0x15, 0x51, 0xea};
+	CHECK(cskburn_serial_verify(dev, TARGET_FLASH, 0, 0x1000, md5) == 0);
+	CHECK(memcmp(md5, blank_4k_md5, sizeof(md5)) == 0);
+
+	cskburn_serial_close(&dev);
+	fake_burner_free(&fake);
+
+	// 窗口写入、重发与迟到的数据块应答在回显序号时照常工作
+	const uint32_t size = 256 * 1024;
+	uint8_t *image = make_image(size);
+	fake_burner_stats_t stats;
+	config.stale_frames = false;
+	config.late_flash_id = 0;
+	config.queue_full_seq = 5;
+	config.late_block = 20;
+	CHECK(burn(&config, 8, false, &seq_echo_burner, 1000, image, size, &stats) > 0);
+	free(image);
+	return true;
+}
+
+int
+main(void)
+{
+	set_log_level(LOGLEVEL_ERROR);
+
+	if (!test_write_window() || !test_write_retransmit() ||
+			!test_write_adaptive_timeout() || !test_write_skip_blank() || !test_write_stream() ||
+			!test_write_compressed() || !test_write_cobs() || !test_write_block_size() ||
+			!test_write_downshift() || !test_hash_map() || !test_stale_frames() ||
+			!test_seq_echo()) {
+		return 1;
+	}
+	puts("serial write tests passed");
+	return 0;
+}
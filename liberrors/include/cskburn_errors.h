@@ -49,6 +49,7 @@ typedef enum {
 	CSKBURN_ERR_BURNER_NO_RESPONSE = 5004,
 	CSKBURN_ERR_BAUD_REJECTED = 5005,
 	CSKBURN_ERR_BAUD_SYNC_LOST = 5006,
+	CSKBURN_ERR_BAUD_PROBE_FAILED = 5007,
 
 	/* 6xxx — device/flash info */
 	CSKBURN_ERR_CHIP_ID_READ_FAILED = 6001,
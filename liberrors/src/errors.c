@@ -70,6 +70,8 @@ cskburn_strerror(int err)
 			return "Burner rejected baud rate change";
 		case CSKBURN_ERR_BAUD_SYNC_LOST:
 			return "Lost sync with burner after baud rate change";
+		case CSKBURN_ERR_BAUD_PROBE_FAILED:
+			return "Baud rate probing could not check the link at the initial rate";
 
 		/* 6xxx — device info */
 		case CSKBURN_ERR_CHIP_ID_READ_FAILED:
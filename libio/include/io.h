@@ -9,6 +9,8 @@ typedef void (*reader_hook_t)(const uint8_t *buf, uint32_t size, void *ctx);
 
 struct _reader_t {
 	uint32_t (*read)(reader_t *reader, uint8_t *buf, uint32_t size);
+	// 按偏移读取，不经过 hook，也不改变 read 的位置；不支持时为 NULL
+	uint32_t (*read_at)(reader_t *reader, uint32_t offset, uint8_t *buf, uint32_t size);
 	void (*close)(reader_t **reader);
 	uint32_t size;
 	void *ctx;
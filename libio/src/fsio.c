@@ -9,6 +9,7 @@ typedef struct {
 } filereader_ctx_t;
 
 uint32_t filereader_read(reader_t *reader, uint8_t *buf, uint32_t size);
+uint32_t filereader_read_at(reader_t *reader, uint32_t offset, uint8_t *buf, uint32_t size);
 void filereader_close(reader_t **reader);
 
 reader_t *
@@ -24,6 +25,7 @@ filereader_open(const char *filename)
 
 	reader_t *reader = calloc(1, sizeof(reader_t));
 	reader->read = filereader_read;
+	reader->read_at = filereader_read_at;
 	reader->close = filereader_close;
 	reader->ctx = ctx;
 
@@ -45,6 +47,19 @@ filereader_read(reader_t *reader, uint8_t *buf, uint32_t size)
 	return bytes;
 }
 
+uint32_t
+filereader_read_at(reader_t *reader, uint32_t offset, uint8_t *buf, uint32_t size)
+{
+	filereader_ctx_t *ctx = (filereader_ctx_t *)reader->ctx;
+	long pos = ftell(ctx->fp);
+	if (pos < 0 || fseek(ctx->fp, (long)offset, SEEK_SET) != 0) {
+		return 0;
+	}
+	uint32_t bytes = fread(buf, 1, size, ctx->fp);
+	fseek(ctx->fp, pos, SEEK_SET);
+	return bytes;
+}
+
 void
 filereader_close(reader_t **reader)
 {
@@ -11,6 +11,7 @@ typedef struct {
 } memreader_ctx_t;
 
 uint32_t memreader_read(reader_t *reader, uint8_t *buf, uint32_t size);
+uint32_t memreader_read_at(reader_t *reader, uint32_t offset, uint8_t *buf, uint32_t size);
 void memreader_close(reader_t **reader);
 
 reader_t *
@@ -29,6 +30,7 @@ memreader_alloc(uint32_t size)
 
 	reader_t *reader = calloc(1, sizeof(reader_t));
 	reader->read = memreader_read;
+	reader->read_at = memreader_read_at;
 	reader->close = memreader_close;
 	reader->ctx = ctx;
 	reader->size = 0;
@@ -83,6 +85,20 @@ memreader_read(reader_t *reader, uint8_t *buf, uint32_t size)
 	return size;
 }
 
+uint32_t
+memreader_read_at(reader_t *reader, uint32_t offset, uint8_t *buf, uint32_t size)
+{
+	memreader_ctx_t *ctx = (memreader_ctx_t *)reader->ctx;
+	if (offset >= reader->size) {
+		return 0;
+	}
+	if (size > reader->size - offset) {
+		size = reader->size - offset;
+	}
+	memcpy(buf, ctx->buffer + offset, size);
+	return size;
+}
+
 void
 memreader_close(reader_t **reader)
 {
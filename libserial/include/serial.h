@@ -16,6 +16,15 @@ int serial_set_speed(serial_dev_t *dev, uint32_t speed);
 ssize_t serial_read(serial_dev_t *dev, void *buf, size_t count, uint64_t timeout);
 ssize_t serial_write(serial_dev_t *dev, const void *buf, size_t count, uint64_t timeout);
 
+/**
+ * @brief  Wait until all written data has left the host
+ *
+ * @param dev serial device
+ * @param timeout maximum time to wait in milliseconds
+ * @return 0 if the output queue is empty, -ETIMEDOUT if data is still pending
+ */
+int serial_drain(serial_dev_t *dev, uint64_t timeout);
+
 void serial_discard_input(serial_dev_t *dev);
 void serial_discard_output(serial_dev_t *dev);
 
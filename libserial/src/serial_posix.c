@@ -1,12 +1,16 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <serial.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
-#include <sys/time.h>
 #include <termios.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
 #include "set_baud.h"
 #include "time_monotonic.h"
 
@@ -42,8 +46,9 @@ set_interface_attribs(int fd, int speed)
 	tty.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
 	tty.c_oflag &= ~OPOST;
 
+	// 以非阻塞方式读写，等待由 poll 完成，VMIN/VTIME 不再参与超时控制
 	tty.c_cc[VMIN] = 0;
-	tty.c_cc[VTIME] = 1;
+	tty.c_cc[VTIME] = 0;
 
 	ret = tcsetattr(fd, TCSANOW, &tty);
 	if (ret != 0) {
@@ -53,6 +58,26 @@ set_interface_attribs(int fd, int speed)
 	return set_baud(fd, speed);
 }
 
+// 关闭 USB 串口芯片（FTDI、CH34x 等）驱动的接收合并延时，使少量数据也能立即交给上层。
+// 并非所有驱动都支持，失败时忽略
+static void
+set_low_latency(int fd)
+{
+#if defined(__linux__) && defined(ASYNC_LOW_LATENCY)
+	struct serial_struct ss;
+	if (ioctl(fd, TIOCGSERIAL, &ss) != 0) {
+		return;
+	}
+	if (ss.flags & ASYNC_LOW_LATENCY) {
+		return;
+	}
+	ss.flags |= ASYNC_LOW_LATENCY;
+	ioctl(fd, TIOCSSERIAL, &ss);
+#else
+	(void)fd;
+#endif
+}
+
 static int
 set_modem_control(int fd, int flag, int val)
 {
@@ -94,6 +119,8 @@ serial_open(const char *path, serial_dev_t **dev)
 		return ret;
 	}
 
+	set_low_latency(fd);
+
 	(*dev) = (serial_dev_t *)calloc(1, sizeof(serial_dev_t));
 	(*dev)->fd = fd;
 
@@ -114,36 +141,26 @@ serial_set_speed(serial_dev_t *dev, uint32_t speed)
 	return set_baud(dev->fd, speed);
 }
 
-static inline void
-set_fd_timeout(serial_dev_t *dev, fd_set *fds, struct timeval *tv, uint64_t timeout)
-{
-	FD_ZERO(fds);
-	FD_SET(dev->fd, fds);
-
-	tv->tv_sec = timeout / 1000;
-	tv->tv_usec = (timeout % 1000) * 1000;
-}
-
-static ssize_t
-do_serial_read(serial_dev_t *dev, void *buf, size_t count, uint64_t timeout)
+// 等待 fd 可读或可写，返回 0 表示超时
+static int
+wait_fd(serial_dev_t *dev, short events, uint64_t start, uint64_t timeout)
 {
-	ssize_t ret;
-
-	fd_set fds;
-	struct timeval tv;
-	set_fd_timeout(dev, &fds, &tv, timeout);
-
-	ret = select(dev->fd + 1, &fds, NULL, NULL, &tv);
-	if (ret < 0) {
-		return -errno;
-	}
+	for (;;) {
+		uint64_t elapsed = TIME_SINCE_MS(start);
+		if (elapsed >= timeout) {
+			return 0;
+		}
 
-	ret = read(dev->fd, buf, count);
-	if (ret < 0) {
-		return -errno;
+		struct pollfd pfd = {.fd = dev->fd, .events = events};
+		int ret = poll(&pfd, 1, (int)(timeout - elapsed));
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		return ret;
 	}
-
-	return ret;
 }
 
 ssize_t
@@ -152,58 +169,70 @@ serial_read(serial_dev_t *dev, void *buf, size_t count, uint64_t timeout)
 	ssize_t ret;
 
 	uint64_t start = time_monotonic();
-	while ((ret = do_serial_read(dev, buf, count, timeout)) <= 0) {
-		if (ret == 0 || ret == -EAGAIN) {
-			if (TIME_SINCE_MS(start) >= timeout) {
-				return -ETIMEDOUT;
-			}
-		} else {
+	for (;;) {
+		// 先直接读取，缓冲区中已有数据时无需额外的 poll 调用
+		ret = read(dev->fd, buf, count);
+		if (ret > 0) {
 			return ret;
 		}
-	}
+		if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+			return -errno;
+		}
 
-	return ret;
+		if ((ret = wait_fd(dev, POLLIN, start, timeout)) < 0) {
+			return ret;
+		} else if (ret == 0) {
+			return -ETIMEDOUT;
+		}
+	}
 }
 
-static ssize_t
-do_serial_write(serial_dev_t *dev, const void *buf, size_t count, uint64_t timeout)
+ssize_t
+serial_write(serial_dev_t *dev, const void *buf, size_t count, uint64_t timeout)
 {
 	ssize_t ret;
 
-	fd_set fds;
-	struct timeval tv;
-	set_fd_timeout(dev, &fds, &tv, timeout);
-
-	ret = select(dev->fd + 1, NULL, &fds, NULL, &tv);
-	if (ret < 0) {
-		return -errno;
-	}
+	uint64_t start = time_monotonic();
+	for (;;) {
+		ret = write(dev->fd, buf, count);
+		if (ret > 0) {
+			return ret;
+		}
+		if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+			return -errno;
+		}
 
-	ret = write(dev->fd, buf, count);
-	if (ret < 0) {
-		return -errno;
+		if ((ret = wait_fd(dev, POLLOUT, start, timeout)) < 0) {
+			return ret;
+		} else if (ret == 0) {
+			return -ETIMEDOUT;
+		}
 	}
-
-	return ret;
 }
 
-ssize_t
-serial_write(serial_dev_t *dev, const void *buf, size_t count, uint64_t timeout)
+int
+serial_drain(serial_dev_t *dev, uint64_t timeout)
 {
-	ssize_t ret;
-
+#ifdef TIOCOUTQ
 	uint64_t start = time_monotonic();
-	while ((ret = do_serial_write(dev, buf, count, timeout)) <= 0) {
-		if (ret == 0 || ret == -EAGAIN) {
-			if (TIME_SINCE_MS(start) >= timeout) {
-				return -ETIMEDOUT;
-			}
-		} else {
-			return ret;
+	int pending = 0;
+	while (ioctl(dev->fd, TIOCOUTQ, &pending) == 0) {
+		if (pending <= 0) {
+			return 0;
+		}
+		if (TIME_SINCE_MS(start) >= timeout) {
+			return -ETIMEDOUT;
 		}
+		// 输出队列清空没有对应的 poll 事件，只能短暂休眠后再次查询
+		usleep(200);
 	}
+#endif
 
-	return ret;
+	// 不支持查询输出队列时退化为 tcdrain，它会一直阻塞到数据发送完毕
+	if (tcdrain(dev->fd) != 0) {
+		return -errno;
+	}
+	return 0;
 }
 
 void
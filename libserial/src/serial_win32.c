@@ -233,6 +233,19 @@ serial_write(serial_dev_t *dev, const void *buf, size_t count, uint64_t timeout)
 	return (ssize_t)wrote;
 }
 
+int
+serial_drain(serial_dev_t *dev, uint64_t timeout)
+{
+	(void)timeout;
+
+	// 驱动将缓冲区内的数据全部发出后才返回
+	if (FlushFileBuffers(dev->handle) == 0) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
 void
 serial_discard_input(serial_dev_t *dev)
 {
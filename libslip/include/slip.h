@@ -8,6 +8,16 @@
 struct _slip_dev_t;
 typedef struct _slip_dev_t slip_dev_t;
 
+typedef enum {
+	SLIP_FRAMING_SLIP = 0,
+	// COBS (Consistent Overhead Byte Stuffing) with 0x00 as the delimiter
+	SLIP_FRAMING_COBS = 1,
+} slip_framing_t;
+
+// Worst case length of a frame carrying len bytes, including the delimiters
+#define SLIP_FRAME_LEN(len) ((len) * 2 + 2)
+#define COBS_FRAME_LEN(len) ((len) + (len) / 254 + 3)
+
 /**
  * @brief Allocate and initialize a SLIP object
  *
@@ -26,6 +36,30 @@ slip_dev_t *slip_init(serial_dev_t *serial, size_t tx_buf_len, size_t rx_buf_len
  */
 void slip_deinit(slip_dev_t **dev);
 
+/**
+ * @brief Resize the transmit buffer, e.g. after negotiating larger frames with the peer
+ *
+ * @param dev SLIP object
+ * @param tx_buf_len New length of transmit buffer
+ *
+ * @return 0 if succeed
+ * @retval -ENOMEM if the buffer cannot be allocated, the old buffer is kept
+ */
+int slip_set_tx_len(slip_dev_t *dev, size_t tx_buf_len);
+
+/**
+ * @brief Switch the framing used from now on, SLIP is used after slip_init()
+ *
+ * Data already received but not yet returned by slip_read() is parsed again with the new
+ * framing, so switch only when no frame in the old framing is expected anymore. Frames
+ * are always written with a leading and a trailing delimiter, so the peer can drop
+ * anything received before the switch.
+ *
+ * @param dev SLIP object
+ * @param framing Framing to use
+ */
+void slip_set_framing(slip_dev_t *dev, slip_framing_t framing);
+
 /**
  * @brief Read from a SLIP object
  *
@@ -34,9 +68,14 @@ void slip_deinit(slip_dev_t **dev);
  * @param count Number of bytes to read
  * @param timeout Timeout in milliseconds
  *
+ * Frames already buffered by a previous call are returned first, one per call, without
+ * touching the serial device.
+ *
  * @return Number of bytes read
  * @retval -ETIMEDOUT if timeout
- * @retval -ENOMEM if buffer is too small to hold the upcoming packet
+ * @retval -ENOMEM if buffer is too small to hold the upcoming packet, the packet is dropped
+ * @retval -EINVAL if the upcoming packet contains an invalid escape sequence or is a
+ * truncated COBS frame, the packet is dropped
  * @retval -errno on other errors from serial device
  */
 ssize_t slip_read(slip_dev_t *dev, uint8_t *buf, size_t count, uint64_t timeout);
@@ -56,4 +95,42 @@ ssize_t slip_read(slip_dev_t *dev, uint8_t *buf, size_t count, uint64_t timeout)
  */
 ssize_t slip_write(slip_dev_t *dev, const uint8_t *buf, size_t count, uint64_t timeout);
 
+/**
+ * @brief Get the number of complete frames received but not yet returned by slip_read()
+ *
+ * @param dev SLIP object
+ *
+ * @return Number of buffered frames
+ */
+size_t slip_buffered_frames(slip_dev_t *dev);
+
+/**
+ * @brief Start a thread that keeps draining the serial device into the receive buffer
+ *
+ * slip_read() then only decodes frames already buffered by the thread, so the caller may
+ * spend time between reads without the device-side buffers overflowing. The thread stalls
+ * when the receive buffer is full, which should be sized to hold all frames the peer may
+ * send ahead. Not available on Windows.
+ *
+ * @param dev SLIP object
+ *
+ * @return 0 if succeed
+ * @retval -ENOTSUP if threads are not supported on this platform
+ */
+int slip_start_rx_thread(slip_dev_t *dev);
+
+/**
+ * @brief Stop the receive thread, data already buffered is kept
+ *
+ * @param dev SLIP object
+ */
+void slip_stop_rx_thread(slip_dev_t *dev);
+
+/**
+ * @brief Discard all pending input, both in the serial device and in the SLIP receive buffer
+ *
+ * @param dev SLIP object
+ */
+void slip_discard_input(slip_dev_t *dev);
+
 #endif  // __LIB_SLIP__
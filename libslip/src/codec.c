@@ -0,0 +1,256 @@
+#include "codec.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+// 按 8 字节一组判断是否含有指定字节（SWAR），无需依赖特定指令集
+static inline bool
+has_byte(uint64_t v, uint8_t b)
+{
+	uint64_t x = v ^ (ONES * b);
+	return ((x - ONES) & ~x & HIGHS) != 0;
+}
+
+size_t
+slip_find_special(const uint8_t *buf, size_t len)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+		memcpy(&v, buf + i, sizeof(v));
+		if (has_byte(v, END) || has_byte(v, ESC)) {
+			break;
+		}
+	}
+
+	for (; i < len; i++) {
+		if (buf[i] == END || buf[i] == ESC) {
+			return i;
+		}
+	}
+
+	return len;
+}
+
+// 扫描得到的普通数据段短于此长度时，说明特殊字节较密集，改为逐字节处理一段，
+// 避免为每个极短的段调用一次扫描和 memcpy
+#define SHORT_RUN 8
+#define BYTEWISE_SPAN 256
+
+ssize_t
+slip_escape(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len)
+{
+	size_t o = 0;
+	size_t i = 0;
+
+	while (i < in_len) {
+		// 不含特殊字节的连续数据整段复制，紧随其后的特殊字节单独转义
+		size_t run = slip_find_special(in + i, in_len - i);
+		if (run >= SHORT_RUN) {
+			if (o + run > out_len) {
+				return -ENOMEM;
+			}
+			memcpy(out + o, in + i, run);
+			o += run;
+			i += run;
+			if (i == in_len) {
+				break;
+			}
+
+			if (o + 2 > out_len) {
+				return -ENOMEM;
+			}
+			out[o++] = ESC;
+			out[o++] = in[i++] == END ? ESC_END : ESC_ESC;
+			continue;
+		}
+
+		// 每个字节至多转义为 2 字节，按最坏情况预先确认输出空间，循环中不再逐字节检查
+		size_t span = in_len - i < BYTEWISE_SPAN ? in_len - i : BYTEWISE_SPAN;
+		if (span > (out_len - o) / 2) {
+			span = (out_len - o) / 2;
+			if (span == 0) {
+				if (o == out_len || in[i] == END || in[i] == ESC) {
+					return -ENOMEM;
+				}
+				out[o++] = in[i++];
+				continue;
+			}
+		}
+
+		for (size_t end = i + span; i < end; i++) {
+			uint8_t b = in[i];
+			if (b == END) {
+				out[o++] = ESC;
+				out[o++] = ESC_END;
+			} else if (b == ESC) {
+				out[o++] = ESC;
+				out[o++] = ESC_ESC;
+			} else {
+				out[o++] = b;
+			}
+		}
+	}
+
+	return o;
+}
+
+ssize_t
+slip_unescape(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len, bool *esc)
+{
+	size_t o = 0;
+	size_t i = 0;
+	// out 可能与任意对象别名，使用局部变量以免每写一个字节都重新读取 *esc
+	bool escaped = *esc;
+
+	while (i < in_len) {
+		if (escaped) {
+			if (in[i] != ESC_END && in[i] != ESC_ESC) {
+				return -EINVAL;
+			}
+			if (o + 1 > out_len) {
+				return -ENOMEM;
+			}
+			out[o++] = in[i++] == ESC_END ? END : ESC;
+			escaped = false;
+			continue;
+		}
+
+		// 不含转义的连续数据整段复制
+		const uint8_t *p = memchr(in + i, ESC, in_len - i);
+		size_t run = p == NULL ? in_len - i : (size_t)(p - (in + i));
+		if (run >= SHORT_RUN) {
+			if (o + run > out_len) {
+				return -ENOMEM;
+			}
+			memcpy(out + o, in + i, run);
+			o += run;
+			i += run;
+			if (i < in_len) {
+				escaped = true;
+				i++;
+			}
+			continue;
+		}
+
+		// 每个字节至多产生 1 字节输出，按输入长度预先确认输出空间，循环中不再逐字节检查
+		size_t span = in_len - i < BYTEWISE_SPAN ? in_len - i : BYTEWISE_SPAN;
+		if (span > out_len - o) {
+			span = out_len - o;
+			if (span == 0) {
+				if (in[i] != ESC) {
+					return -ENOMEM;
+				}
+				escaped = true;
+				i++;
+				continue;
+			}
+		}
+
+		// 转义序列在一次迭代中整体处理，每次迭代恰好输出 1 字节
+		for (size_t end = i + span; i < end;) {
+			uint8_t b = in[i];
+			if (b != ESC) {
+				out[o++] = b;
+				i++;
+			} else if (i + 1 == in_len) {
+				escaped = true;
+				i++;
+				break;
+			} else {
+				b = in[i + 1];
+				if (b != ESC_END && b != ESC_ESC) {
+					return -EINVAL;
+				}
+				out[o++] = b == ESC_END ? END : ESC;
+				i += 2;
+			}
+		}
+	}
+
+	*esc = escaped;
+	return o;
+}
+
+ssize_t
+cobs_encode(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len)
+{
+	size_t o = 0;
+
+	// 每个分组以其长度开头，至多 254 个非零字节；除最后一组外，
+	// 长度不足 255 的分组之后隐含一个 0x00
+	do {
+		size_t run = in_len < 254 ? in_len : 254;
+		const uint8_t *p = memchr(in, COBS_DELIM, run);
+		if (p != NULL) {
+			run = p - in;
+		}
+
+		if (o + 1 + run > out_len) {
+			return -ENOMEM;
+		}
+		out[o++] = (uint8_t)(run + 1);
+		memcpy(out + o, in, run);
+		o += run;
+		in += run;
+		in_len -= run;
+
+		if (p != NULL) {
+			// 跳过被分组长度代替的 0x00；其后即使没有数据也须再有一个分组
+			in++;
+			in_len--;
+			if (in_len == 0) {
+				if (o + 1 > out_len) {
+					return -ENOMEM;
+				}
+				out[o++] = 1;
+			}
+		} else if (run < 254) {
+			break;
+		}
+	} while (in_len > 0);
+
+	return o;
+}
+
+ssize_t
+cobs_decode(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len, cobs_state_t *state)
+{
+	size_t o = 0;
+
+	while (in_len > 0) {
+		if (state->left == 0) {
+			// 前一分组隐含的 0x00 只有在其后还有分组时才输出
+			if (state->zero) {
+				if (o + 1 > out_len) {
+					return -ENOMEM;
+				}
+				out[o++] = 0;
+			}
+			if (*in == COBS_DELIM) {
+				return -EINVAL;
+			}
+			state->left = *in - 1;
+			state->zero = *in != 0xFF;
+			in++;
+			in_len--;
+			continue;
+		}
+
+		size_t run = in_len < state->left ? in_len : state->left;
+		if (o + run > out_len) {
+			return -ENOMEM;
+		}
+		memcpy(out + o, in, run);
+		o += run;
+		in += run;
+		in_len -= run;
+		state->left -= run;
+	}
+
+	return o;
+}
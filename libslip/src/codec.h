@@ -0,0 +1,74 @@
+#ifndef __LIB_SLIP_CODEC__
+#define __LIB_SLIP_CODEC__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define END 0300
+#define ESC 0333
+#define ESC_END 0334
+#define ESC_ESC 0335
+
+/**
+ * @brief Find the first END or ESC byte
+ *
+ * @return Offset of the byte, or len if there is none
+ */
+size_t slip_find_special(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Escape data into the body of a SLIP frame, without the surrounding END bytes
+ *
+ * @return Number of bytes written to out
+ * @retval -ENOMEM if out is too small
+ */
+ssize_t slip_escape(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len);
+
+/**
+ * @brief Unescape part of a SLIP frame body, which must not contain END bytes
+ *
+ * @param esc Whether the previous part ended with ESC, updated on return
+ *
+ * @return Number of bytes written to out
+ * @retval -ENOMEM if out is too small
+ * @retval -EINVAL if an invalid escape sequence is found
+ */
+ssize_t slip_unescape(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len, bool *esc);
+
+// COBS 以 0x00 为帧分隔符，帧内不含 0x00
+#define COBS_DELIM 0x00
+
+// COBS 解码状态，跨段保留
+typedef struct {
+	uint8_t left;  // 当前分组中尚未复制的字节数
+	bool zero;     // 当前分组结束时是否须补一个 0x00
+} cobs_state_t;
+
+/**
+ * @brief Encode data into the body of a COBS frame, without the delimiters
+ *
+ * The body is at most in_len + in_len / 254 + 1 bytes long.
+ *
+ * @return Number of bytes written to out
+ * @retval -ENOMEM if out is too small
+ */
+ssize_t cobs_encode(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len);
+
+/**
+ * @brief Decode part of a COBS frame body, which must not contain delimiters
+ *
+ * @param state Decoding state, zero-initialized before the first part
+ *
+ * The caller checks that state->left is 0 at the end of the frame, otherwise the frame
+ * is truncated.
+ *
+ * @return Number of bytes written to out
+ * @retval -ENOMEM if out is too small
+ * @retval -EINVAL if a delimiter is found
+ */
+ssize_t cobs_decode(
+		uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len, cobs_state_t *state);
+
+#endif  // __LIB_SLIP_CODEC__
@@ -1,32 +1,75 @@
 #include "slip.h"
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#define SLIP_RX_THREAD 1
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#endif
+
+#include "codec.h"
 #include "log.h"
 #include "serial.h"
 #include "time_monotonic.h"
 
-#define END 0300
-#define ESC 0333
-#define ESC_END 0334
-#define ESC_ESC 0335
+// 接收线程每次读取串口的超时时间，也是停止线程时的最长等待时间
+#define RX_THREAD_POLL_MS 20
+
+// 接收线程运行时，rx_head 与 rx_tail 分别由调用方与接收线程单方面推进，
+// 以 acquire/release 语义读写即可，无需加锁
+#if SLIP_RX_THREAD
+typedef atomic_size_t slip_index_t;
+#define INDEX_LOAD(index) atomic_load_explicit(&(index), memory_order_acquire)
+#define INDEX_STORE(index, value) atomic_store_explicit(&(index), (value), memory_order_release)
+#else
+typedef size_t slip_index_t;
+#define INDEX_LOAD(index) (index)
+#define INDEX_STORE(index, value) ((index) = (value))
+#endif
 
 struct _slip_dev_t {
 	serial_dev_t *serial;
 
+	// 帧格式及其分隔符，SLIP 为 END，COBS 为 0x00
+	slip_framing_t framing;
+	uint8_t delim;
+
 	uint8_t *tx_buf;
 	size_t tx_len;
 
+	// 接收环形缓冲区，跨调用保留已读入但尚未取走的数据。三个位置均单调递增，
+	// 取模 rx_len 后得到实际下标：
+	//   rx_head: 下一帧（或帧前无效数据）的起始
+	//   rx_scan: 此前的数据已统计过帧边界
+	//   rx_tail: 已从串口读入的数据末尾
 	uint8_t *rx_buf;
 	size_t rx_len;
-
-	enum {
-		STATE_SKIP,
-		STATE_BYTE,
-		STATE_ESC,
-	} state;
+	slip_index_t rx_head;
+	size_t rx_scan;
+	slip_index_t rx_tail;
+
+	// 帧边界统计状态：rx_scan 处是否位于帧内、当前帧已有多少字节，以及 rx_head 到 rx_scan
+	// 之间完整帧的数量
+	bool rx_in_frame;
+	size_t rx_frame_len;
+	size_t rx_frames;
+
+#if SLIP_RX_THREAD
+	// 接收线程：持续把串口数据读入环形缓冲区，调用方只负责解帧。
+	// rx_lock/rx_cond 仅用于等待，数据本身不受锁保护
+	bool rx_thread_running;
+	pthread_t rx_thread;
+	pthread_mutex_t rx_lock;
+	pthread_cond_t rx_cond;
+	atomic_bool rx_stop;
+	atomic_bool rx_full;
+	atomic_int rx_error;
+#endif
 };
 
 slip_dev_t *
@@ -38,6 +81,8 @@ slip_init(serial_dev_t *serial, size_t tx_buf_len, size_t rx_buf_len)
 	}
 
 	slip->serial = serial;
+	slip->framing = SLIP_FRAMING_SLIP;
+	slip->delim = END;
 
 	slip->tx_len = tx_buf_len;
 	slip->tx_buf = calloc(1, tx_buf_len);
@@ -58,110 +103,414 @@ slip_init(serial_dev_t *serial, size_t tx_buf_len, size_t rx_buf_len)
 void
 slip_deinit(slip_dev_t **dev)
 {
+	slip_stop_rx_thread(*dev);
 	free((*dev)->tx_buf);
 	free((*dev)->rx_buf);
 	free(*dev);
 	*dev = NULL;
 }
 
-ssize_t
-slip_read(slip_dev_t *dev, uint8_t *buf, size_t count, uint64_t timeout)
+// 丢弃环形缓冲区中已读入的全部数据。rx_tail 可能正由接收线程推进，因此只移动 rx_head
+static void
+slip_reset_input(slip_dev_t *dev)
 {
-	uint8_t *const rx_buf_head = dev->rx_buf;
-	uint8_t *const rx_buf_tail = dev->rx_buf + dev->rx_len;
+	size_t tail = INDEX_LOAD(dev->rx_tail);
+	INDEX_STORE(dev->rx_head, tail);
+	dev->rx_scan = tail;
+	dev->rx_in_frame = false;
+	dev->rx_frame_len = 0;
+	dev->rx_frames = 0;
+}
 
-	uint8_t *rx_head = rx_buf_head;
-	uint8_t *rx_tail = rx_buf_head;
+int
+slip_set_tx_len(slip_dev_t *dev, size_t tx_buf_len)
+{
+	uint8_t *tx_buf = realloc(dev->tx_buf, tx_buf_len);
+	if (tx_buf == NULL) {
+		return -ENOMEM;
+	}
+	dev->tx_buf = tx_buf;
+	dev->tx_len = tx_buf_len;
+	return 0;
+}
 
-	uint8_t *buf_head = buf;
-	uint8_t *buf_tail = buf + count;
+void
+slip_set_framing(slip_dev_t *dev, slip_framing_t framing)
+{
+	dev->framing = framing;
+	dev->delim = framing == SLIP_FRAMING_COBS ? COBS_DELIM : END;
+
+	// 已读入的数据按新的分隔符重新统计帧边界
+	dev->rx_scan = INDEX_LOAD(dev->rx_head);
+	dev->rx_in_frame = false;
+	dev->rx_frame_len = 0;
+	dev->rx_frames = 0;
+}
 
-	dev->state = STATE_SKIP;
+// 统计新读入数据中的帧边界。帧以分隔符开始、以分隔符结束，两帧之间的无效数据被忽略；
+// 连续两个分隔符视作前一帧的结束符与本帧起始符相连
+static void
+slip_scan(slip_dev_t *dev)
+{
+	size_t tail = INDEX_LOAD(dev->rx_tail);
+	while (dev->rx_scan < tail) {
+		size_t offset = dev->rx_scan % dev->rx_len;
+		size_t len = tail - dev->rx_scan;
+		if (len > dev->rx_len - offset) {
+			len = dev->rx_len - offset;
+		}
 
-	uint64_t start = time_monotonic();
-	while (rx_tail < rx_buf_tail) {
-		ssize_t r = serial_read(dev->serial, rx_tail, rx_buf_tail - rx_tail, timeout);
-		if (r < 0) {
-			return r;
+		const uint8_t *p = memchr(dev->rx_buf + offset, dev->delim, len);
+		size_t run = p == NULL ? len : (size_t)(p - (dev->rx_buf + offset));
+		if (dev->rx_in_frame) {
+			dev->rx_frame_len += run;
+		}
+		dev->rx_scan += run;
+
+		if (p == NULL) {
+			continue;
+		}
+
+		if (!dev->rx_in_frame || dev->rx_frame_len == 0) {
+			dev->rx_in_frame = true;
+			dev->rx_frame_len = 0;
+		} else {
+			dev->rx_in_frame = false;
+			dev->rx_frames++;
+		}
+		dev->rx_scan++;
+	}
+}
+
+// 在环形缓冲区 [from, to) 中查找分隔符，找不到时返回 to
+static size_t
+slip_find_end(slip_dev_t *dev, size_t from, size_t to)
+{
+	while (from < to) {
+		size_t offset = from % dev->rx_len;
+		size_t len = to - from;
+		if (len > dev->rx_len - offset) {
+			len = dev->rx_len - offset;
+		}
+
+		const uint8_t *p = memchr(dev->rx_buf + offset, dev->delim, len);
+		if (p != NULL) {
+			return from + (p - (dev->rx_buf + offset));
+		}
+		from += len;
+	}
+	return to;
+}
+
+// 从接收缓冲区中取出一个完整的帧，调用前须确保 rx_frames > 0
+static ssize_t
+slip_decode(slip_dev_t *dev, uint8_t *buf, size_t count)
+{
+	size_t start, end;
+
+	while (true) {
+		// 帧起始之前的字节都是无效数据，可以直接丢弃
+		start = slip_find_end(dev, INDEX_LOAD(dev->rx_head), dev->rx_scan) + 1;
+		end = slip_find_end(dev, start, dev->rx_scan);
+		if (end >= dev->rx_scan) {
+			// 不会发生：rx_frames 保证了 rx_scan 之前至少有一个完整的帧
+			slip_reset_input(dev);
+			return -EIO;
+		}
+
+		if (end > start) {
+			break;
+		}
+
+		// 空帧，视作前一帧的结束符与本帧起始符相连
+		INDEX_STORE(dev->rx_head, end);
+	}
+
+	ssize_t ret = 0;
+	size_t len = 0;
+	bool esc = false;
+	cobs_state_t cobs = {0};
+
+	// 帧体最多被缓冲区末尾分成两段
+	for (size_t from = start; from < end && ret >= 0;) {
+		size_t offset = from % dev->rx_len;
+		size_t seg = end - from;
+		if (seg > dev->rx_len - offset) {
+			seg = dev->rx_len - offset;
+		}
+
+		if (dev->framing == SLIP_FRAMING_COBS) {
+			ret = cobs_decode(buf + len, count - len, dev->rx_buf + offset, seg, &cobs);
+		} else {
+			ret = slip_unescape(buf + len, count - len, dev->rx_buf + offset, seg, &esc);
+		}
+		if (ret >= 0) {
+			len += ret;
 		}
+		from += seg;
+	}
+
+	if (ret >= 0 && (esc || cobs.left != 0)) {
+		ret = -EINVAL;
+	}
+
+	// 出错时整帧丢弃，但仍然视作已取走，保证后续的帧可以正常读取
+	INDEX_STORE(dev->rx_head, end + 1);
+	dev->rx_frames--;
+	if (ret < 0) {
+		return ret;
+	}
+
+	LOG_DUMP(buf, len);
+	return len;
+}
+
+// 从串口读入一次数据到环形缓冲区。只读入连续的空闲部分，余下的数据留在串口中等待下一轮
+static ssize_t
+slip_fill(slip_dev_t *dev, uint64_t timeout)
+{
+	size_t tail = INDEX_LOAD(dev->rx_tail);
+	size_t used = tail - INDEX_LOAD(dev->rx_head);
+	size_t offset = tail % dev->rx_len;
+	size_t space = dev->rx_len - used;
+	if (space > dev->rx_len - offset) {
+		space = dev->rx_len - offset;
+	}
+
+	uint8_t *rx_tail = dev->rx_buf + offset;
+	ssize_t r = serial_read(dev->serial, rx_tail, space, timeout);
+	if (r < 0) {
+		return r;
+	}
 
-		LOG_TRACE("Read %zd bytes in %d ms", r, TIME_SINCE_MS(start));
 #if TRACE_SLIP
-		LOG_DUMP(rx_tail, r);
+	LOG_DUMP(rx_tail, r);
 #endif
 
-		rx_tail += r;
-
-		for (uint8_t b = *rx_head; rx_head < rx_tail; b = *(++rx_head)) {
-			switch (dev->state) {
-				case STATE_SKIP:
-					if (b == END) {
-						dev->state = STATE_BYTE;
-					}
-					break;
-				case STATE_BYTE:
-					if (b == ESC) {
-						dev->state = STATE_ESC;
-					} else if (b == END) {
-						LOG_DUMP(buf, buf_head - buf);
-						return buf_head - buf;
-					} else {
-						if (buf_head + 1 > buf_tail) return -ENOMEM;
-						*buf_head++ = b;
-					}
-					break;
-				case STATE_ESC:
-					if (b == ESC_END) {
-						if (buf_head + 1 > buf_tail) return -ENOMEM;
-						*buf_head++ = END;
-						dev->state = STATE_BYTE;
-					} else if (b == ESC_ESC) {
-						if (buf_head + 1 > buf_tail) return -ENOMEM;
-						*buf_head++ = ESC;
-						dev->state = STATE_BYTE;
-					} else {
-						return -EINVAL;
-					}
-					break;
+	INDEX_STORE(dev->rx_tail, tail + r);
+	return r;
+}
+
+#if SLIP_RX_THREAD
+static void
+rx_wake(slip_dev_t *dev)
+{
+	pthread_mutex_lock(&dev->rx_lock);
+	pthread_cond_broadcast(&dev->rx_cond);
+	pthread_mutex_unlock(&dev->rx_lock);
+}
+
+// 等待 index 离开 seen，或者超时。macOS 不支持为条件变量指定单调时钟，
+// 因此按不超过 RX_THREAD_POLL_MS 的小段等待，由调用方以单调时钟判断总超时
+static void
+rx_wait(slip_dev_t *dev, slip_index_t *index, size_t seen, uint64_t timeout)
+{
+	if (timeout > RX_THREAD_POLL_MS) {
+		timeout = RX_THREAD_POLL_MS;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += (long)(timeout * 1000000);
+	ts.tv_sec += ts.tv_nsec / 1000000000;
+	ts.tv_nsec %= 1000000000;
+
+	pthread_mutex_lock(&dev->rx_lock);
+	if (INDEX_LOAD(*index) == seen && !atomic_load(&dev->rx_stop) &&
+			atomic_load(&dev->rx_error) == 0) {
+		pthread_cond_timedwait(&dev->rx_cond, &dev->rx_lock, &ts);
+	}
+	pthread_mutex_unlock(&dev->rx_lock);
+}
+
+static void *
+rx_thread_main(void *arg)
+{
+	slip_dev_t *dev = arg;
+
+	while (!atomic_load(&dev->rx_stop)) {
+		size_t head = INDEX_LOAD(dev->rx_head);
+		if (INDEX_LOAD(dev->rx_tail) - head >= dev->rx_len) {
+			// 缓冲区已满，等调用方取走数据，其余数据暂留在串口中
+			atomic_store(&dev->rx_full, true);
+			rx_wait(dev, &dev->rx_head, head, RX_THREAD_POLL_MS);
+			continue;
+		}
+
+		ssize_t r = slip_fill(dev, RX_THREAD_POLL_MS);
+		if (r == -ETIMEDOUT || r == 0) {
+			continue;
+		} else if (r < 0) {
+			atomic_store(&dev->rx_error, (int)r);
+			rx_wake(dev);
+			break;
+		}
+
+		rx_wake(dev);
+	}
+
+	return NULL;
+}
+#endif
+
+// 调用方取走数据后，唤醒因缓冲区已满而等待的接收线程
+static void
+slip_release(slip_dev_t *dev)
+{
+#if SLIP_RX_THREAD
+	if (dev->rx_thread_running && atomic_exchange(&dev->rx_full, false)) {
+		rx_wake(dev);
+	}
+#endif
+}
+
+// 等待新数据读入环形缓冲区，返回 0 表示已有新数据
+static ssize_t
+slip_wait_input(slip_dev_t *dev, uint64_t start, uint64_t timeout)
+{
+#if SLIP_RX_THREAD
+	if (dev->rx_thread_running) {
+		while (INDEX_LOAD(dev->rx_tail) == dev->rx_scan) {
+			int err = atomic_load(&dev->rx_error);
+			if (err != 0) {
+				return err;
 			}
+
+			uint64_t elapsed = TIME_SINCE_MS(start);
+			if (elapsed >= timeout) {
+				return -ETIMEDOUT;
+			}
+			rx_wait(dev, &dev->rx_tail, dev->rx_scan, timeout - elapsed);
 		}
+		return 0;
 	}
+#endif
 
-	return -ENOMEM;
+	ssize_t r = slip_fill(dev, timeout);
+	if (r < 0) {
+		return r;
+	}
+
+	LOG_TRACE("Read %zd bytes in %d ms", r, TIME_SINCE_MS(start));
+	return 0;
 }
 
 ssize_t
-slip_write(slip_dev_t *dev, const uint8_t *buf, size_t count, uint64_t timeout)
+slip_read(slip_dev_t *dev, uint8_t *buf, size_t count, uint64_t timeout)
 {
-	uint8_t *const tx_buf_head = dev->tx_buf;
-	uint8_t *const tx_buf_tail = dev->tx_buf + dev->tx_len;
+	uint64_t start = time_monotonic();
 
-	uint8_t *tx_head = tx_buf_head;
-	uint8_t *tx_tail = tx_buf_head;
+	// 接收线程可能已读入新的数据
+	slip_scan(dev);
 
-	const uint8_t *buf_head = buf;
-	const uint8_t *buf_tail = buf + count;
+	while (dev->rx_frames == 0) {
+		// 已扫描过的帧外无效数据无需保留
+		if (!dev->rx_in_frame) {
+			INDEX_STORE(dev->rx_head, dev->rx_scan);
+		}
 
-	if (tx_tail + 1 > tx_buf_tail) return -ENOMEM;
-	*tx_tail++ = END;
+		size_t used = INDEX_LOAD(dev->rx_tail) - INDEX_LOAD(dev->rx_head);
+		if (used >= dev->rx_len) {
+			// 单帧超过了接收缓冲区容量
+			slip_reset_input(dev);
+			slip_release(dev);
+			return -ENOMEM;
+		}
 
-	for (buf_head = buf; buf_head < buf_tail; buf_head++) {
-		if (*buf_head == END) {
-			if (tx_tail + 2 > tx_buf_tail) return -ENOMEM;
-			*tx_tail++ = ESC;
-			*tx_tail++ = ESC_END;
-		} else if (*buf_head == ESC) {
-			if (tx_tail + 2 > tx_buf_tail) return -ENOMEM;
-			*tx_tail++ = ESC;
-			*tx_tail++ = ESC_ESC;
-		} else {
-			if (tx_tail + 1 > tx_buf_tail) return -ENOMEM;
-			*tx_tail++ = *buf_head;
+		ssize_t r = slip_wait_input(dev, start, timeout);
+		if (r < 0) {
+			return r;
 		}
+
+		slip_scan(dev);
 	}
 
-	if (tx_tail + 1 > tx_buf_tail) return -ENOMEM;
-	*tx_tail++ = END;
+	ssize_t ret = slip_decode(dev, buf, count);
+	slip_release(dev);
+	return ret;
+}
+
+int
+slip_start_rx_thread(slip_dev_t *dev)
+{
+#if SLIP_RX_THREAD
+	if (dev->rx_thread_running) {
+		return 0;
+	}
+
+	atomic_init(&dev->rx_stop, false);
+	atomic_init(&dev->rx_full, false);
+	atomic_init(&dev->rx_error, 0);
+
+	if (pthread_mutex_init(&dev->rx_lock, NULL) != 0) {
+		return -ENOMEM;
+	}
+	if (pthread_cond_init(&dev->rx_cond, NULL) != 0) {
+		pthread_mutex_destroy(&dev->rx_lock);
+		return -ENOMEM;
+	}
+
+	int ret = pthread_create(&dev->rx_thread, NULL, rx_thread_main, dev);
+	if (ret != 0) {
+		pthread_cond_destroy(&dev->rx_cond);
+		pthread_mutex_destroy(&dev->rx_lock);
+		return -ret;
+	}
+
+	dev->rx_thread_running = true;
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+void
+slip_stop_rx_thread(slip_dev_t *dev)
+{
+#if SLIP_RX_THREAD
+	if (!dev->rx_thread_running) {
+		return;
+	}
+
+	atomic_store(&dev->rx_stop, true);
+	rx_wake(dev);
+	pthread_join(dev->rx_thread, NULL);
+
+	pthread_cond_destroy(&dev->rx_cond);
+	pthread_mutex_destroy(&dev->rx_lock);
+	dev->rx_thread_running = false;
+#endif
+}
+
+size_t
+slip_buffered_frames(slip_dev_t *dev)
+{
+	return dev->rx_frames;
+}
+
+ssize_t
+slip_write(slip_dev_t *dev, const uint8_t *buf, size_t count, uint64_t timeout)
+{
+	uint8_t *tx_head = dev->tx_buf;
+	uint8_t *tx_tail = dev->tx_buf;
+
+	if (dev->tx_len < 2) {
+		return -ENOMEM;
+	}
+	*tx_tail++ = dev->delim;
+
+	ssize_t len;
+	if (dev->framing == SLIP_FRAMING_COBS) {
+		len = cobs_encode(tx_tail, dev->tx_len - 2, buf, count);
+	} else {
+		len = slip_escape(tx_tail, dev->tx_len - 2, buf, count);
+	}
+	if (len < 0) {
+		return len;
+	}
+	tx_tail += len;
+
+	*tx_tail++ = dev->delim;
 
 	uint64_t start = time_monotonic();
 	while (tx_head < tx_tail) {
@@ -178,5 +527,13 @@ slip_write(slip_dev_t *dev, const uint8_t *buf, size_t count, uint64_t timeout)
 		tx_head += r;
 	}
 
-	return buf_head - buf;
+	return count;
+}
+
+void
+slip_discard_input(slip_dev_t *dev)
+{
+	serial_discard_input(dev->serial);
+	slip_reset_input(dev);
+	slip_release(dev);
 }
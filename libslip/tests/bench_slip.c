@@ -0,0 +1,186 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+#include "time_monotonic.h"
+
+#define FRAME_SIZE (4 * 1024)
+#define TOTAL_SIZE (256 * 1024 * 1024)
+
+// 逐字节处理的参考实现，与替换前的 slip_write / slip_read 内层循环相同
+static size_t
+escape_bytewise(uint8_t *out, const uint8_t *in, size_t len)
+{
+	size_t o = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (in[i] == END) {
+			out[o++] = ESC;
+			out[o++] = ESC_END;
+		} else if (in[i] == ESC) {
+			out[o++] = ESC;
+			out[o++] = ESC_ESC;
+		} else {
+			out[o++] = in[i];
+		}
+	}
+	return o;
+}
+
+static size_t
+unescape_bytewise(uint8_t *out, const uint8_t *in, size_t len)
+{
+	size_t o = 0;
+	bool esc = false;
+	for (size_t i = 0; i < len; i++) {
+		if (esc) {
+			out[o++] = in[i] == ESC_END ? END : ESC;
+			esc = false;
+		} else if (in[i] == ESC) {
+			esc = true;
+		} else {
+			out[o++] = in[i];
+		}
+	}
+	return o;
+}
+
+static volatile size_t sink;
+
+static void
+report(const char *name, uint64_t t1, uint64_t t2)
+{
+	double ms = (double)(t2 - t1);
+	if (ms < 1) {
+		ms = 1;
+	}
+	printf("  %-22s %8.1f MB/s\n", name, TOTAL_SIZE / 1048576.0 / (ms / 1000.0));
+}
+
+static void
+bench(const char *title, const uint8_t *frame)
+{
+	uint8_t *escaped = malloc(FRAME_SIZE * 2);
+	uint8_t *decoded = malloc(FRAME_SIZE);
+	size_t escaped_len = escape_bytewise(escaped, frame, FRAME_SIZE);
+	const uint32_t rounds = TOTAL_SIZE / FRAME_SIZE;
+	uint64_t t1;
+
+	printf("%s (%u bytes escaped to %zu):\n", title, FRAME_SIZE, escaped_len);
+
+	t1 = time_monotonic();
+	for (uint32_t i = 0; i < rounds; i++) {
+		sink += escape_bytewise(escaped, frame, FRAME_SIZE);
+	}
+	report("escape (bytewise)", t1, time_monotonic());
+
+	t1 = time_monotonic();
+	for (uint32_t i = 0; i < rounds; i++) {
+		sink += slip_escape(escaped, FRAME_SIZE * 2, frame, FRAME_SIZE);
+	}
+	report("escape (bulk)", t1, time_monotonic());
+
+	t1 = time_monotonic();
+	for (uint32_t i = 0; i < rounds; i++) {
+		sink += unescape_bytewise(decoded, escaped, escaped_len);
+	}
+	report("unescape (bytewise)", t1, time_monotonic());
+
+	t1 = time_monotonic();
+	for (uint32_t i = 0; i < rounds; i++) {
+		bool esc = false;
+		sink += slip_unescape(decoded, FRAME_SIZE, escaped, escaped_len, &esc);
+	}
+	report("unescape (bulk)", t1, time_monotonic());
+
+	if (memcmp(decoded, frame, FRAME_SIZE) != 0) {
+		printf("  round trip mismatch!\n");
+	}
+
+	size_t encoded_len = cobs_encode(escaped, FRAME_SIZE * 2, frame, FRAME_SIZE);
+	printf("  COBS encodes to %zu bytes\n", encoded_len);
+
+	t1 = time_monotonic();
+	for (uint32_t i = 0; i < rounds; i++) {
+		sink += cobs_encode(escaped, FRAME_SIZE * 2, frame, FRAME_SIZE);
+	}
+	report("COBS encode", t1, time_monotonic());
+
+	t1 = time_monotonic();
+	for (uint32_t i = 0; i < rounds; i++) {
+		cobs_state_t state = {0};
+		sink += cobs_decode(decoded, FRAME_SIZE, escaped, encoded_len, &state);
+	}
+	report("COBS decode", t1, time_monotonic());
+
+	if (memcmp(decoded, frame, FRAME_SIZE) != 0) {
+		printf("  COBS round trip mismatch!\n");
+	}
+
+	free(decoded);
+	free(escaped);
+}
+
+// 按 FRAME_SIZE 分帧，统计文件以两种帧格式发送时的线上字节数（含分隔符）
+static int
+compare_file(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) {
+		perror(path);
+		return 1;
+	}
+
+	uint8_t frame[FRAME_SIZE], out[FRAME_SIZE * 2];
+	uint64_t raw = 0, slip = 0, cobs = 0, worst = 0;
+	size_t len;
+	while ((len = fread(frame, 1, sizeof(frame), fp)) > 0) {
+		size_t escaped = escape_bytewise(out, frame, len);
+		raw += len;
+		slip += escaped + 2;
+		cobs += cobs_encode(out, sizeof(out), frame, len) + 2;
+		if (escaped - len > worst) {
+			worst = escaped - len;
+		}
+	}
+	fclose(fp);
+
+	if (raw == 0) {
+		printf("%s: empty\n", path);
+		return 0;
+	}
+	printf("%s: %llu bytes, SLIP +%.2f%% (worst frame +%llu), COBS +%.2f%%\n", path,
+			(unsigned long long)raw, (slip - raw) * 100.0 / raw, (unsigned long long)worst,
+			(cobs - raw) * 100.0 / raw);
+	return 0;
+}
+
+// 不带参数时测量编解码速度；带文件参数时比较各文件以两种帧格式发送的开销
+int
+main(int argc, char *argv[])
+{
+	if (argc > 1) {
+		int ret = 0;
+		for (int i = 1; i < argc; i++) {
+			ret |= compare_file(argv[i]);
+		}
+		return ret;
+	}
+
+	uint8_t *frame = malloc(FRAME_SIZE);
+
+	uint32_t state = 0x12345678;
+	for (uint32_t i = 0; i < FRAME_SIZE; i++) {
+		state = state * 1103515245 + 12345;
+		frame[i] = state >> 16;
+	}
+	bench("random", frame);
+
+	memset(frame, END, FRAME_SIZE);
+	bench("all 0xC0", frame);
+
+	free(frame);
+	return 0;
+}
@@ -0,0 +1,478 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "log.h"
+#include "serial.h"
+#include "slip.h"
+#include "time_monotonic.h"
+
+#define CHECK(expr)                                                                             \
+	do {                                                                                        \
+		if (!(expr)) {                                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr);          \
+			return false;                                                                       \
+		}                                                                                       \
+	} while (0)
+
+static int master = -1;
+static serial_dev_t *serial = NULL;
+static bool rx_thread = false;
+
+static bool
+open_pty(void)
+{
+	char path[128];
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 ||
+			ptsname_r(master, path, sizeof(path)) != 0) {
+		return false;
+	}
+
+	return serial_open(path, &serial) == 0;
+}
+
+static void
+send_raw(const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t r = write(master, buf, len);
+		if (r <= 0) {
+			return;
+		}
+		buf += r;
+		len -= r;
+	}
+}
+
+static size_t
+encode(uint8_t *out, const uint8_t *buf, size_t len)
+{
+	size_t n = 0;
+	out[n++] = END;
+	for (size_t i = 0; i < len; i++) {
+		if (buf[i] == END) {
+			out[n++] = ESC;
+			out[n++] = ESC_END;
+		} else if (buf[i] == ESC) {
+			out[n++] = ESC;
+			out[n++] = ESC_ESC;
+		} else {
+			out[n++] = buf[i];
+		}
+	}
+	out[n++] = END;
+	return n;
+}
+
+static void
+send_frame(const uint8_t *buf, size_t len)
+{
+	uint8_t *out = malloc(len * 2 + 2);
+	send_raw(out, encode(out, buf, len));
+	free(out);
+}
+
+static slip_dev_t *
+open_slip(size_t tx_buf_len, size_t rx_buf_len)
+{
+	slip_dev_t *slip = slip_init(serial, tx_buf_len, rx_buf_len);
+	if (slip != NULL && rx_thread && slip_start_rx_thread(slip) != 0) {
+		slip_deinit(&slip);
+	}
+	return slip;
+}
+
+static bool
+test_burst(void)
+{
+	slip_dev_t *slip = open_slip(64, 256);
+	uint8_t buf[64];
+
+	// 三帧一次性到达，外加帧前的无效数据与空帧
+	uint8_t burst[256];
+	size_t n = 0;
+	burst[n++] = 'x';
+	burst[n++] = 'y';
+	n += encode(burst + n, (const uint8_t *)"one", 3);
+	burst[n++] = END;
+	n += encode(burst + n, (const uint8_t[]){0x01, END, 0x02, ESC, 0x03}, 5);
+	n += encode(burst + n, (const uint8_t *)"three", 5);
+	send_raw(burst, n);
+	usleep(10 * 1000);
+
+	CHECK(slip_buffered_frames(slip) == 0);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 3 && memcmp(buf, "one", 3) == 0);
+	CHECK(slip_buffered_frames(slip) == 2);
+
+	// 后续两帧直接从缓冲区取出，即使超时为 0 也不受影响
+	CHECK(slip_read(slip, buf, sizeof(buf), 0) == 5);
+	CHECK(memcmp(buf, (const uint8_t[]){0x01, END, 0x02, ESC, 0x03}, 5) == 0);
+	CHECK(slip_buffered_frames(slip) == 1);
+	CHECK(slip_read(slip, buf, sizeof(buf), 0) == 5 && memcmp(buf, "three", 5) == 0);
+	CHECK(slip_buffered_frames(slip) == 0);
+
+	CHECK(slip_read(slip, buf, sizeof(buf), 20) == -ETIMEDOUT);
+
+	slip_deinit(&slip);
+	return true;
+}
+
+static bool
+test_split(void)
+{
+	slip_dev_t *slip = open_slip(64, 256);
+	uint8_t buf[64];
+
+	uint8_t frame[64];
+	size_t n = encode(frame, (const uint8_t[]){'a', END, 'b', ESC, 'c'}, 5);
+
+	// 帧在转义序列中间被截断，剩余部分到达后才能取出
+	send_raw(frame, 3);
+	CHECK(slip_read(slip, buf, sizeof(buf), 20) == -ETIMEDOUT);
+	send_raw(frame + 3, n - 3);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 5);
+	CHECK(memcmp(buf, (const uint8_t[]){'a', END, 'b', ESC, 'c'}, 5) == 0);
+
+	slip_deinit(&slip);
+	return true;
+}
+
+static bool
+test_wrap(void)
+{
+	// 接收缓冲区很小，反复写入使数据跨越缓冲区末尾
+	slip_dev_t *slip = open_slip(64, 40);
+	uint8_t buf[32];
+
+	for (int round = 0; round < 50; round++) {
+		uint8_t payload[3][12];
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 12; j++) {
+				payload[i][j] = (uint8_t)(round * 31 + i * 7 + j);
+			}
+			send_frame(payload[i], sizeof(payload[i]));
+		}
+
+		for (int i = 0; i < 3; i++) {
+			CHECK(slip_read(slip, buf, sizeof(buf), 100) == 12);
+			CHECK(memcmp(buf, payload[i], 12) == 0);
+		}
+	}
+
+	slip_deinit(&slip);
+	return true;
+}
+
+static bool
+test_errors(void)
+{
+	slip_dev_t *slip = open_slip(64, 64);
+	uint8_t buf[8];
+
+	// 超出调用方缓冲区的帧被整帧丢弃，不影响下一帧
+	send_frame((const uint8_t *)"0123456789", 10);
+	send_frame((const uint8_t *)"ok", 2);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == -ENOMEM);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 2 && memcmp(buf, "ok", 2) == 0);
+
+	// 非法转义
+	send_raw((const uint8_t[]){END, 'a', ESC, 'b', END}, 5);
+	send_frame((const uint8_t *)"ok", 2);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == -EINVAL);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 2 && memcmp(buf, "ok", 2) == 0);
+
+	// 单帧超过接收缓冲区容量
+	uint8_t big[100];
+	memset(big, 'z', sizeof(big));
+	send_frame(big, sizeof(big));
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == -ENOMEM);
+
+	slip_discard_input(slip);
+	CHECK(slip_buffered_frames(slip) == 0);
+	send_frame((const uint8_t *)"ok", 2);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 2 && memcmp(buf, "ok", 2) == 0);
+
+	slip_deinit(&slip);
+	return true;
+}
+
+static bool
+test_codec(void)
+{
+	uint8_t in[300], escaped[600], out[300];
+	uint32_t state = 1;
+
+	for (int round = 0; round < 1000; round++) {
+		size_t len = round % sizeof(in);
+		for (size_t i = 0; i < len; i++) {
+			state = state * 1103515245 + 12345;
+			uint8_t r = state >> 16;
+			// 各轮特殊字节的比例不同，覆盖整段复制、逐字节处理及两者的切换
+			uint8_t mask = round % 3 == 0 ? 3 : round % 3 == 1 ? 63 : (i / 32) % 2 ? 1 : 255;
+			in[i] = (r & mask) == 0 ? END : (r & mask) == 1 ? ESC : r;
+		}
+
+		size_t special = slip_find_special(in, len);
+		for (size_t i = 0; i < special; i++) {
+			CHECK(in[i] != END && in[i] != ESC);
+		}
+		CHECK(special == len || in[special] == END || in[special] == ESC);
+
+		ssize_t n = slip_escape(escaped, sizeof(escaped), in, len);
+		CHECK(n >= (ssize_t)len);
+		CHECK(memchr(escaped, END, n) == NULL);
+
+		// 分两段解码，验证跨段的转义状态
+		bool esc = false;
+		size_t half = n / 2;
+		ssize_t a = slip_unescape(out, sizeof(out), escaped, half, &esc);
+		CHECK(a >= 0);
+		ssize_t b = slip_unescape(out + a, sizeof(out) - a, escaped + half, n - half, &esc);
+		CHECK(b >= 0 && !esc);
+		CHECK((size_t)(a + b) == len && memcmp(out, in, len) == 0);
+
+		// 输出缓冲区恰好够用时成功，少一个字节即失败
+		CHECK(slip_escape(escaped, n, in, len) == n);
+		esc = false;
+		CHECK(slip_unescape(out, len, escaped, n, &esc) == (ssize_t)len);
+		if (len > 0) {
+			CHECK(slip_escape(escaped, n - 1, in, len) == -ENOMEM);
+			esc = false;
+			CHECK(slip_unescape(out, len - 1, escaped, n, &esc) == -ENOMEM);
+		}
+	}
+
+	CHECK(slip_escape(escaped, 2, (const uint8_t[]){'a', END}, 2) == -ENOMEM);
+	bool esc = false;
+	CHECK(slip_unescape(out, sizeof(out), (const uint8_t[]){ESC, 'x'}, 2, &esc) == -EINVAL);
+
+	return true;
+}
+
+static bool
+test_cobs_codec(void)
+{
+	uint8_t in[600], encoded[COBS_FRAME_LEN(600)], out[600];
+	uint32_t state = 1;
+
+	for (int round = 0; round < 2000; round++) {
+		// 覆盖 254 字节分组边界附近的长度
+		size_t len = round < 600 ? round : round % 600;
+		for (size_t i = 0; i < len; i++) {
+			state = state * 1103515245 + 12345;
+			uint8_t r = state >> 16;
+			in[i] = round < 600 ? (uint8_t)(i + 1) : (r & 3) == 0 ? 0 : r;
+		}
+		if (round >= 1000 && len > 0) {
+			in[len - 1] = 0;
+		}
+
+		ssize_t n = cobs_encode(encoded, sizeof(encoded), in, len);
+		CHECK(n > 0 && (size_t)n <= len + len / 254 + 1);
+		CHECK(memchr(encoded, COBS_DELIM, n) == NULL);
+
+		// 分两段解码，验证跨段的分组状态
+		cobs_state_t cobs = {0};
+		size_t half = (size_t)n * (round % 7) / 6;
+		ssize_t a = cobs_decode(out, sizeof(out), encoded, half, &cobs);
+		CHECK(a >= 0);
+		ssize_t b = cobs_decode(out + a, sizeof(out) - a, encoded + half, n - half, &cobs);
+		CHECK(b >= 0 && cobs.left == 0);
+		CHECK((size_t)(a + b) == len && memcmp(out, in, len) == 0);
+	}
+
+	CHECK(cobs_encode(encoded, 2, (const uint8_t[]){'a', 'b'}, 2) == -ENOMEM);
+	cobs_state_t cobs = {0};
+	CHECK(cobs_decode(out, sizeof(out), (const uint8_t[]){0x03, 'a'}, 2, &cobs) == 1);
+	CHECK(cobs.left == 1);
+
+	return true;
+}
+
+static void
+send_cobs_frame(const uint8_t *buf, size_t len)
+{
+	uint8_t *out = malloc(COBS_FRAME_LEN(len));
+	out[0] = COBS_DELIM;
+	ssize_t n = cobs_encode(out + 1, COBS_FRAME_LEN(len) - 2, buf, len);
+	out[n + 1] = COBS_DELIM;
+	send_raw(out, n + 2);
+	free(out);
+}
+
+static bool
+test_framing(void)
+{
+	slip_dev_t *slip = open_slip(64, 40);
+	uint8_t buf[32];
+
+	send_frame((const uint8_t *)"slip", 4);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 4 && memcmp(buf, "slip", 4) == 0);
+
+	// 切换前已到达、尚未取走的数据按新的帧格式解析
+	send_cobs_frame((const uint8_t[]){0, END, 0, ESC}, 4);
+	usleep(10 * 1000);
+	slip_set_framing(slip, SLIP_FRAMING_COBS);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 4);
+	CHECK(memcmp(buf, (const uint8_t[]){0, END, 0, ESC}, 4) == 0);
+
+	// 帧跨越接收缓冲区末尾
+	for (int round = 0; round < 50; round++) {
+		uint8_t payload[12];
+		for (int j = 0; j < 12; j++) {
+			payload[j] = (uint8_t)(round * 31 + j * 7) & 0x3F;
+		}
+		send_cobs_frame(payload, sizeof(payload));
+		CHECK(slip_read(slip, buf, sizeof(buf), 100) == 12);
+		CHECK(memcmp(buf, payload, 12) == 0);
+	}
+
+	// 截断的分组
+	send_raw((const uint8_t[]){COBS_DELIM, 0x05, 'a', COBS_DELIM}, 4);
+	send_cobs_frame((const uint8_t *)"ok", 2);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == -EINVAL);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 2 && memcmp(buf, "ok", 2) == 0);
+
+	// 写出的帧首尾均为分隔符
+	uint8_t wire[16];
+	CHECK(slip_write(slip, (const uint8_t[]){'a', 0, 'b'}, 3, 100) == 3);
+	usleep(10 * 1000);
+	CHECK(read(master, wire, sizeof(wire)) == 6);
+	CHECK(memcmp(wire, (const uint8_t[]){COBS_DELIM, 0x02, 'a', 0x02, 'b', COBS_DELIM}, 6) == 0);
+
+	slip_set_framing(slip, SLIP_FRAMING_SLIP);
+	send_frame((const uint8_t[]){0, END}, 2);
+	CHECK(slip_read(slip, buf, sizeof(buf), 100) == 2);
+	CHECK(memcmp(buf, (const uint8_t[]){0, END}, 2) == 0);
+
+	slip_deinit(&slip);
+	return true;
+}
+
+// 3 Mbaud 下 8N1 每字节 10 bit
+#define STRESS_BYTES_PER_SEC (3000000 / 10)
+#define STRESS_FRAMES 600
+
+static uint8_t
+stress_byte(uint32_t frame, uint32_t i)
+{
+	uint32_t x = frame * 2654435761u + i * 40503u;
+	// 提高特殊字节的比例
+	return (x & 7) == 0 ? END : (x & 7) == 1 ? ESC : (uint8_t)(x >> 8);
+}
+
+static size_t
+stress_len(uint32_t frame)
+{
+	return 16 + (frame * 7919u) % 2033;
+}
+
+// 按 3 Mbaud 的线速从 master 端持续发出帧，模拟设备连续推送数据
+static void *
+stress_sender(void *arg)
+{
+	uint8_t frame[4096], out[8192 + 2];
+	uint64_t start = time_monotonic();
+	uint64_t sent = 0;
+
+	for (uint32_t n = 0; n < STRESS_FRAMES; n++) {
+		size_t len = stress_len(n);
+		for (size_t i = 0; i < len; i++) {
+			frame[i] = stress_byte(n, i);
+		}
+		size_t out_len = encode(out, frame, len);
+
+		for (size_t off = 0; off < out_len; off += 256) {
+			size_t chunk = out_len - off < 256 ? out_len - off : 256;
+			send_raw(out + off, chunk);
+			sent += chunk;
+
+			uint64_t due_ms = sent * 1000 / STRESS_BYTES_PER_SEC;
+			uint64_t elapsed = TIME_SINCE_MS(start);
+			if (due_ms > elapsed) {
+				usleep((due_ms - elapsed) * 1000);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static bool
+test_stress(void)
+{
+	slip_dev_t *slip = open_slip(64, 64 * 1024);
+	uint8_t buf[4096];
+	pthread_t sender;
+
+	CHECK(pthread_create(&sender, NULL, stress_sender, NULL) == 0);
+
+	bool ok = true;
+	for (uint32_t n = 0; n < STRESS_FRAMES && ok; n++) {
+		ssize_t r = slip_read(slip, buf, sizeof(buf), 1000);
+		if (r != (ssize_t)stress_len(n)) {
+			fprintf(stderr, "frame %u: got %zd bytes, want %zu\n", n, r, stress_len(n));
+			ok = false;
+			break;
+		}
+		for (size_t i = 0; i < (size_t)r; i++) {
+			if (buf[i] != stress_byte(n, i)) {
+				fprintf(stderr, "frame %u: mismatch at %zu\n", n, i);
+				ok = false;
+				break;
+			}
+		}
+
+		// 模拟调用方处理数据（写盘、计算 MD5）时的停顿
+		if (n % 32 == 31) {
+			usleep(5 * 1000);
+		}
+	}
+
+	pthread_join(sender, NULL);
+	slip_deinit(&slip);
+	return ok;
+}
+
+int
+main(void)
+{
+	set_log_level(LOGLEVEL_ERROR);
+
+	if (!open_pty()) {
+		fprintf(stderr, "failed to open pty\n");
+		return 1;
+	}
+
+	bool ok = test_codec() && test_cobs_codec();
+
+	// 同一组用例分别在调用方线程直接读取与接收线程两种模式下运行
+	for (int i = 0; i < 2 && ok; i++) {
+		rx_thread = i == 1;
+		ok = test_burst() && test_split() && test_wrap() && test_errors() && test_framing() &&
+			test_stress();
+		if (!ok) {
+			fprintf(stderr, "failed with rx thread %s\n", rx_thread ? "on" : "off");
+		}
+	}
+
+	serial_close(&serial);
+	close(master);
+
+	if (!ok) {
+		return 1;
+	}
+	puts("slip tests passed");
+	return 0;
+}